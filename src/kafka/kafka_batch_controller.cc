@@ -0,0 +1,31 @@
+// Copyright (c) 2017 Lanceolata
+
+#include "kafka/kafka_batch_controller.h"
+#include <algorithm>
+
+namespace log2hdfs {
+
+void KafkaBatchController::SetLimits(const KafkaBatchLimits& limits) {
+  limits_ = limits;
+  size_ = std::min(std::max(size_, limits_.min_size), limits_.max_size);
+  timeout_ms_ = std::min(std::max(timeout_ms_, limits_.min_timeout_ms),
+                         limits_.max_timeout_ms);
+}
+
+void KafkaBatchController::Update(size_t consumed, bool eof) {
+  if (consumed >= size_ && !eof) {
+    // lagging, larger batches
+    size_ = std::min(size_ * 2, limits_.max_size);
+    timeout_ms_ = limits_.min_timeout_ms;
+  } else if (consumed > 0 || eof) {
+    // near head, hand over partial batches quickly
+    if (consumed < size_ / 2)
+      size_ = std::max(size_ / 2, limits_.min_size);
+    timeout_ms_ = std::max(timeout_ms_ / 2, limits_.min_timeout_ms);
+  } else {
+    // idle, back off
+    timeout_ms_ = std::min(timeout_ms_ * 2, limits_.max_timeout_ms);
+  }
+}
+
+}   // namespace log2hdfs
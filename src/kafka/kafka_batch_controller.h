@@ -0,0 +1,83 @@
+// Copyright (c) 2017 Lanceolata
+
+#ifndef LOG2HDFS_KAFKA_KAFKA_BATCH_CONTROLLER_H_
+#define LOG2HDFS_KAFKA_KAFKA_BATCH_CONTROLLER_H_
+
+#include <stddef.h>
+
+namespace log2hdfs {
+
+/**
+ * Consume batch limits
+ */
+struct KafkaBatchLimits {
+  KafkaBatchLimits():
+      min_size(100), max_size(10000),
+      min_timeout_ms(10), max_timeout_ms(1000) {}
+
+  /**
+   * @returns True if limits valid, false otherwise.
+   */
+  bool Valid() const {
+    return min_size > 0 && min_size <= max_size && max_size <= 1000000 &&
+           min_timeout_ms > 0 && min_timeout_ms <= max_timeout_ms;
+  }
+
+  size_t min_size;
+  size_t max_size;
+  int min_timeout_ms;
+  int max_timeout_ms;
+};
+
+/**
+ * Adaptive consume batch size and timeout.
+ *
+ * Full batches mean the consumer lags behind, batch size doubles to
+ * catch up with fewer calls. Partial batches mean the consumer is near
+ * the head, batch size and timeout halve so messages are handed over
+ * without waiting for a full batch. Empty batches double the timeout,
+ * idle consumers do not spin.
+ *
+ * Not thread safe, each consume thread owns one.
+ */
+class KafkaBatchController {
+ public:
+  /**
+   * Constructor
+   *
+   * Starts with min size and max timeout.
+   */
+  explicit KafkaBatchController(const KafkaBatchLimits& limits):
+      limits_(limits), size_(limits.min_size),
+      timeout_ms_(limits.max_timeout_ms) {}
+
+  /**
+   * Update limits, current size and timeout are clamped.
+   */
+  void SetLimits(const KafkaBatchLimits& limits);
+
+  /**
+   * Adjust size and timeout by result of last consume.
+   *
+   * @param consumed            messages returned by last consume
+   * @param eof                 partition end reached
+   */
+  void Update(size_t consumed, bool eof);
+
+  size_t size() const {
+    return size_;
+  }
+
+  int timeout_ms() const {
+    return timeout_ms_;
+  }
+
+ private:
+  KafkaBatchLimits limits_;
+  size_t size_;
+  int timeout_ms_;
+};
+
+}   // namespace log2hdfs
+
+#endif  // LOG2HDFS_KAFKA_KAFKA_BATCH_CONTROLLER_H_
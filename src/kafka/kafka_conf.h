@@ -18,6 +18,7 @@ namespace log2hdfs {
 
 class KafkaProducer;
 class KafkaConsumer;
+class KafkaGroupConsumer;
 
 /**
  * KafkaConf Set() result code
@@ -94,6 +95,16 @@ class KafkaGlobalConf {
    */
   KafkaConfResult Get(const std::string& name, std::string* value) const;
 
+  /**
+   * Copy function
+   * 
+   * @returns std::unique_ptr<KafkaGlobalConf>
+   */
+  std::unique_ptr<KafkaGlobalConf> Copy() const {
+    return std::unique_ptr<KafkaGlobalConf>(
+               new KafkaGlobalConf(rd_kafka_conf_dup(rk_conf_)));
+  }
+
   /**
    * Set err callback
    */
@@ -123,6 +134,7 @@ class KafkaGlobalConf {
  private:
   friend class KafkaProducer;
   friend class KafkaConsumer;
+  friend class KafkaGroupConsumer;
 
   rd_kafka_conf_t* rk_conf_;
 };
@@ -202,9 +214,33 @@ class KafkaTopicConf {
                new KafkaTopicConf(rd_kafka_topic_conf_dup(rkt_conf_)));
   }
 
+  /**
+   * Set topic opaque, see rd_kafka_topic_opaque().
+   */
+  void SetOpaque(void* opaque) {
+    rd_kafka_topic_conf_set_opaque(rkt_conf_, opaque);
+  }
+
+  /**
+   * Set partitioner callback
+   */
+  bool SetPartitionerCb(int32_t (*partitioner)(const rd_kafka_topic_t* rkt,
+                                               const void* keydata,
+                                               size_t keylen,
+                                               int32_t partition_cnt,
+                                               void* rkt_opaque,
+                                               void* msg_opaque)) {
+    if (!partitioner)
+      return false;
+
+    rd_kafka_topic_conf_set_partitioner_cb(rkt_conf_, partitioner);
+    return true;
+  }
+
  private:
   friend class KafkaProducer;
   friend class KafkaConsumer;
+  friend class KafkaGroupConsumer;
 
   rd_kafka_topic_conf_t* rkt_conf_;
 };
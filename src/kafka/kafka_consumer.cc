@@ -4,14 +4,24 @@
 #include "kafka/kafka_conf.h"
 #include "kafka/kafka_topic.h"
 #include "kafka/kafka_topic_consumer.h"
+#include "kafka/kafka_group_consumer.h"
 #include "kafka/kafka_error.h"
+#include "kafka/kafka_message.h"
 #include "easylogging++.h"
 
 namespace log2hdfs {
 
+namespace {
+
+const char* TopicName(const rd_kafka_message_t* message) {
+  return message->rkt ? rd_kafka_topic_name(message->rkt) : "";
+}
+
+}   // namespace
+
 std::shared_ptr<KafkaConsumer> KafkaConsumer::Init(
-    KafkaGlobalConf* conf, std::string* errstr) {
-  if (!conf) {
+    KafkaGlobalConf* conf, size_t workers, std::string* errstr) {
+  if (!conf || workers == 0) {
     if (errstr)
       *errstr = "Invalid parameters";
     return nullptr;
@@ -34,7 +44,10 @@ std::shared_ptr<KafkaConsumer> KafkaConsumer::Init(
       *errstr = "KafkaHandle init failed";
     return nullptr;
   }
-  return std::make_shared<KafkaConsumer>(std::move(handle));
+  std::shared_ptr<KafkaConsumer> consumer = std::make_shared<KafkaConsumer>(
+      std::move(handle), conf->Copy());
+  consumer->StartWorkers(workers);
+  return consumer;
 }
 
 std::shared_ptr<KafkaTopicConsumer> KafkaConsumer::CreateTopicConsumer(
@@ -52,8 +65,8 @@ std::shared_ptr<KafkaTopicConsumer> KafkaConsumer::CreateTopicConsumer(
   }
 
   std::lock_guard<std::mutex> guard(mutex_);
-  auto it = topics_.find(topic);
-  if (it != topics_.end()) {
+  if (topics_.find(topic) != topics_.end() ||
+          groups_.find(topic) != groups_.end()) {
     if (errstr)
       *errstr = "topic consumer already created";
     return nullptr;
@@ -76,23 +89,82 @@ std::shared_ptr<KafkaTopicConsumer> KafkaConsumer::CreateTopicConsumer(
     return nullptr;
   }
 
+  // spread partitions over worker queues
+  std::vector<rd_kafka_queue_t*> queues;
+  for (size_t i = 0; i < partitions.size(); ++i) {
+    queues.push_back(workers_[next_queue_++ % workers_.size()]->queue);
+  }
+
   std::shared_ptr<KafkaTopicConsumer> ktc;
   ktc = KafkaTopicConsumer::Init(handle_, kt, partitions,
-                                 offsets, std::move(cb));
+                                 offsets, queues);
   if (!ktc) {
     if (errstr)
       *errstr = "KafkaTopicConsumer init failed";
     return nullptr;
   }
   topics_.insert(std::make_pair(topic, ktc));
+
+  std::lock_guard<std::mutex> cb_guard(cb_mutex_);
+  callbacks_[rkt] = std::move(cb);
   return ktc;
 }
 
+std::shared_ptr<KafkaGroupConsumer> KafkaConsumer::CreateGroupConsumer(
+    const std::string& topic,
+    const std::string& group,
+    KafkaTopicConf* conf,
+    std::shared_ptr<KafkaConsumeCb> cb,
+    std::string* errstr) {
+  if (topic.empty() || !conf || !cb) {
+    if (errstr)
+      *errstr = "Invlaid parameters";
+    return nullptr;
+  }
+
+  std::lock_guard<std::mutex> guard(mutex_);
+  if (topics_.find(topic) != topics_.end() ||
+          groups_.find(topic) != groups_.end()) {
+    if (errstr)
+      *errstr = "topic consumer already created";
+    return nullptr;
+  }
+
+  std::shared_ptr<KafkaGroupConsumer> kgc = KafkaGroupConsumer::Init(
+      conf_.get(), topic, group, conf, std::move(cb), errstr);
+  if (!kgc)
+    return nullptr;
+
+  kgc->SetBatchLimits(GetBatchLimits());
+
+  groups_.insert(std::make_pair(topic, kgc));
+  return kgc;
+}
+
+bool KafkaConsumer::SetBatchLimits(const KafkaBatchLimits& limits) {
+  if (!limits.Valid())
+    return false;
+
+  {
+    std::lock_guard<std::mutex> lock(limits_mutex_);
+    limits_ = limits;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto it = groups_.begin(); it != groups_.end(); ++it) {
+    it->second->SetBatchLimits(limits);
+  }
+  return true;
+}
+
 void KafkaConsumer::StartAllTopic() {
   std::lock_guard<std::mutex> lock(mutex_);
   for (auto it = topics_.begin(); it != topics_.end(); ++it) {
     it->second->Start();
   }
+  for (auto it = groups_.begin(); it != groups_.end(); ++it) {
+    it->second->Start();
+  }
 }
 
 void KafkaConsumer::StopAllTopic() {
@@ -100,7 +172,11 @@ void KafkaConsumer::StopAllTopic() {
   for (auto it = topics_.begin(); it != topics_.end(); ++it) {
     it->second->Stop();
   }
-  for (auto it = topics_.begin(); it != topics_.end(); ++it) {
+  for (auto it = groups_.begin(); it != groups_.end(); ++it) {
+    it->second->Stop();
+  }
+  Drain();
+  for (auto it = groups_.begin(); it != groups_.end(); ++it) {
     it->second->Join();
   }
 }
@@ -108,26 +184,160 @@ void KafkaConsumer::StopAllTopic() {
 bool KafkaConsumer::StartTopic(const std::string& topic) {
   std::lock_guard<std::mutex> lock(mutex_);
   auto it = topics_.find(topic);
-  if (it == topics_.end())
-    return false;
+  if (it != topics_.end()) {
+    it->second->Start();
+    return true;
+  }
 
-  it->second->Start();
-  return true;
+  auto it2 = groups_.find(topic);
+  if (it2 != groups_.end()) {
+    it2->second->Start();
+    return true;
+  }
+  return false;
 }
 
 bool KafkaConsumer::StopTopic(const std::string& topic) {
   std::unique_lock<std::mutex> lock(mutex_);
   auto it = topics_.find(topic);
-  if (it == topics_.end())
-    return false;
+  if (it != topics_.end()) {
+    std::shared_ptr<KafkaTopicConsumer> ktc = it->second;
+    topics_.erase(it);
+    lock.unlock();
 
-  std::shared_ptr<KafkaTopicConsumer> ktc = it->second;
-  topics_.erase(it);
-  lock.unlock();
+    ktc->Stop();
+    {
+      std::lock_guard<std::mutex> cb_guard(cb_mutex_);
+      callbacks_.erase(ktc->rkt());
+    }
+    // no message of topic is consumed after return
+    Drain();
+    return true;
+  }
 
-  ktc->Stop();
-  ktc->Join();
-  return true;
+  auto it2 = groups_.find(topic);
+  if (it2 != groups_.end()) {
+    std::shared_ptr<KafkaGroupConsumer> kgc = it2->second;
+    groups_.erase(it2);
+    lock.unlock();
+
+    kgc->Stop();
+    kgc->Join();
+    return true;
+  }
+  return false;
+}
+
+void KafkaConsumer::StartWorkers(size_t num) {
+  stop_.store(false);
+  for (size_t i = 0; i < num; ++i) {
+    std::unique_ptr<Worker> worker(new Worker());
+    worker->queue = rd_kafka_queue_new(handle_->rk_);
+    workers_.push_back(std::move(worker));
+  }
+  for (auto& worker : workers_) {
+    worker->thread = std::thread(&KafkaConsumer::WorkerInternal, this,
+                                 worker.get());
+  }
+  LOG(INFO) << "KafkaConsumer StartWorkers workers[" << num << "]";
+}
+
+void KafkaConsumer::StopWorkers() {
+  stop_.store(true);
+  for (auto& worker : workers_) {
+    if (worker->thread.joinable())
+      worker->thread.join();
+    rd_kafka_queue_destroy(worker->queue);
+  }
+  workers_.clear();
+}
+
+void KafkaConsumer::Drain() {
+  for (auto& worker : workers_) {
+    std::lock_guard<std::mutex> lock(worker->mutex);
+  }
+}
+
+std::shared_ptr<KafkaConsumeCb> KafkaConsumer::GetCallback(
+    const rd_kafka_topic_t* rkt) {
+  std::lock_guard<std::mutex> lock(cb_mutex_);
+  auto it = callbacks_.find(rkt);
+  if (it == callbacks_.end())
+    return nullptr;
+  return it->second;
+}
+
+KafkaBatchLimits KafkaConsumer::GetBatchLimits() const {
+  std::lock_guard<std::mutex> lock(limits_mutex_);
+  return limits_;
+}
+
+void KafkaConsumer::WorkerInternal(Worker* worker) {
+  LOG(INFO) << "KafkaConsumer worker thread created";
+
+  KafkaBatchController controller(GetBatchLimits());
+  std::vector<rd_kafka_message_t*> messages;
+  while (!stop_.load()) {
+    // limits might be updated at runtime
+    controller.SetLimits(GetBatchLimits());
+    size_t size = controller.size();
+    if (messages.size() < size)
+      messages.resize(size);
+
+    ssize_t n = rd_kafka_consume_batch_queue(worker->queue,
+        controller.timeout_ms(), messages.data(), size);
+    if (n == -1) {
+      LOG(ERROR) << "KafkaConsumer WorkerInternal "
+                 << "rd_kafka_consume_batch_queue failed with errno["
+                 << errno << "] errstr[" << KafkaErrnoToStr(errno) << "]";
+      continue;
+    }
+
+    std::lock_guard<std::mutex> lock(worker->mutex);
+    bool eof = false;
+    const rd_kafka_topic_t* rkt = NULL;
+    std::shared_ptr<KafkaConsumeCb> cb;
+    for (ssize_t i = 0; i < n; ++i) {
+      rd_kafka_message_t *message = messages[i];
+      if (message->rkt != rkt) {
+        rkt = message->rkt;
+        cb = GetCallback(rkt);
+      }
+
+      switch (message->err) {
+        case RD_KAFKA_RESP_ERR_NO_ERROR:
+          if (cb) {
+            KafkaMessage msg(message);
+            cb->Consume(msg);
+          } else {
+            // topic removed, message fetched before consume stopped
+            rd_kafka_message_destroy(message);
+          }
+          break;
+        case RD_KAFKA_RESP_ERR__PARTITION_EOF:
+          LOG(INFO) << "KafkaConsumer WorkerInternal topic["
+                    << TopicName(message) << "] partition["
+                    << message->partition << "] end";
+          if (cb) {
+            cb->OnEof(TopicName(message), message->partition,
+                      message->offset);
+          }
+          rd_kafka_message_destroy(message);
+          eof = true;
+          break;
+        default:
+          LOG(WARNING) << "KafkaConsumer WorkerInternal topic["
+                       << TopicName(message) << "] partition["
+                       << message->partition << "] error["
+                       << message->err << "]";
+          rd_kafka_message_destroy(message);
+      }
+    }
+    controller.Update(n, eof);
+    handle_->Poll(0);
+  }
+
+  LOG(INFO) << "KafkaConsumer worker thread exiting";
 }
 
 }   // namespace log2hdfs
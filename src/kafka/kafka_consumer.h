@@ -7,6 +7,8 @@
 #include <vector>
 #include <memory>
 #include <mutex>
+#include <atomic>
+#include <thread>
 #include <unordered_map>
 
 #ifdef __cplusplus
@@ -18,17 +20,22 @@ extern "C" {
 #endif
 
 #include "kafka/kafka_handle.h"
+#include "kafka/kafka_conf.h"
+#include "kafka/kafka_batch_controller.h"
 
 namespace log2hdfs {
 
-class KafkaGlobalConf;
-class KafkaTopicConf;
 class KafkaHandle;
 class KafkaTopicConsumer;
+class KafkaGroupConsumer;
 class KafkaConsumeCb;
 
 /**
  * Kafka consumer
+ *
+ * Partitions of all topic consumers are spread over a fixed number of
+ * queues, each queue is drained by one worker thread which dispatches
+ * messages to the KafkaConsumeCb of their topic.
  */
 class KafkaConsumer {
  public:
@@ -36,28 +43,33 @@ class KafkaConsumer {
    * Static function to create a KafkaConsumer shared_ptr.
    * 
    * @param conf                kafka global conf
+   * @param workers             consume worker threads number
    * @param errstr              err string to set
    * 
    * @returns std::shared_ptr<KafkaConsumer>
    */
   static std::shared_ptr<KafkaConsumer> Init(
-      KafkaGlobalConf* conf, std::string* errstr);
+      KafkaGlobalConf* conf, size_t workers, std::string* errstr);
 
   /**
    * Constructor
    * 
    * @param handle              KafkaHandle shared_ptr
+   * @param conf                kafka global conf, used by group consumers
    */
-  explicit KafkaConsumer(std::shared_ptr<KafkaHandle> handle):
-      handle_(std::move(handle)) {}
+  KafkaConsumer(std::shared_ptr<KafkaHandle> handle,
+                std::unique_ptr<KafkaGlobalConf> conf):
+      handle_(std::move(handle)), conf_(std::move(conf)),
+      stop_(true), next_queue_(0) {}
 
   /**
    * Destructor
    * 
-   * Stop All consume threads and clear topics.
+   * Stop All topics consume and worker threads.
    */
   ~KafkaConsumer() {
     StopAllTopic();
+    StopWorkers();
   }
 
   KafkaConsumer(const KafkaConsumer& other) = delete;
@@ -77,6 +89,37 @@ class KafkaConsumer {
     return handle_->MemberId();
   }
 
+  /**
+   * See KafkaHandle QueryWatermarkOffsets().
+   */
+  bool QueryWatermarkOffsets(const std::string& topic, int32_t partition,
+                             int64_t* low, int64_t* high, int timeout_ms,
+                             std::string* errstr) {
+    return handle_->QueryWatermarkOffsets(topic, partition, low, high,
+                                          timeout_ms, errstr);
+  }
+
+  /**
+   * See KafkaHandle OffsetsForTimes().
+   */
+  bool OffsetsForTimes(const std::string& topic,
+                       const std::vector<int32_t>& partitions,
+                       int64_t timestamp_ms,
+                       std::vector<int64_t>* offsets,
+                       int timeout_ms,
+                       std::string* errstr) {
+    return handle_->OffsetsForTimes(topic, partitions, timestamp_ms,
+                                    offsets, timeout_ms, errstr);
+  }
+
+  /**
+   * See KafkaHandle PartitionCount().
+   */
+  bool PartitionCount(const std::string& topic, int* count,
+                      int timeout_ms, std::string* errstr) {
+    return handle_->PartitionCount(topic, count, timeout_ms, errstr);
+  }
+
   /**
    * Create topic consumer
    * 
@@ -100,6 +143,40 @@ class KafkaConsumer {
       std::shared_ptr<KafkaConsumeCb> cb,
       std::string* errstr);
 
+  /**
+   * Create topic group consumer
+   * 
+   * Partitions are balanced between members of the consumer group,
+   * offsets are committed to the group. See KafkaGroupConsumer.
+   * 
+   * @param topic               topic name
+   * @param group               consumer group id, empty to use group.id
+   *                            of global conf
+   * @param conf                kafka topic conf
+   * @param cb                  KafkaConsumeCb callback
+   * @param errstr              err string to set
+   * 
+   * @returns std::shared_ptr<KafkaGroupConsumer> if success;
+   *          nullptr otherwise.
+   *
+   * If topic consumer already created, return nullptr.
+   */
+  std::shared_ptr<KafkaGroupConsumer> CreateGroupConsumer(
+      const std::string& topic,
+      const std::string& group,
+      KafkaTopicConf* conf,
+      std::shared_ptr<KafkaConsumeCb> cb,
+      std::string* errstr);
+
+  /**
+   * Update consume batch limits of workers and group consumers.
+   *
+   * @param limits              batch limits
+   *
+   * @returns True if limits valid; false otherwise.
+   */
+  bool SetBatchLimits(const KafkaBatchLimits& limits);
+
   /**
    * Start all topic consume.
    */
@@ -129,10 +206,47 @@ class KafkaConsumer {
   bool StopTopic(const std::string& topic);
 
  private:
+  /**
+   * Consume worker, drains one queue.
+   */
+  struct Worker {
+    Worker(): queue(NULL) {}
+
+    rd_kafka_queue_t* queue;
+    // held while a batch is dispatched, see Drain()
+    std::mutex mutex;
+    std::thread thread;
+  };
+
+  void StartWorkers(size_t num);
+
+  void StopWorkers();
+
+  void WorkerInternal(Worker* worker);
+
+  // wait for batches being dispatched by workers
+  void Drain();
+
+  std::shared_ptr<KafkaConsumeCb> GetCallback(const rd_kafka_topic_t* rkt);
+
+  KafkaBatchLimits GetBatchLimits() const;
+
   std::shared_ptr<KafkaHandle> handle_;
+  std::unique_ptr<KafkaGlobalConf> conf_;
+  std::atomic<bool> stop_;
+  std::vector<std::unique_ptr<Worker>> workers_;
+  // next queue to assign partition
+  size_t next_queue_;
+  std::mutex cb_mutex_;
+  std::unordered_map<const rd_kafka_topic_t*,
+      std::shared_ptr<KafkaConsumeCb>> callbacks_;
+  mutable std::mutex limits_mutex_;
+  KafkaBatchLimits limits_;
   mutable std::mutex mutex_;
   std::unordered_map<std::string,
       std::shared_ptr<KafkaTopicConsumer>> topics_;
+  std::unordered_map<std::string,
+      std::shared_ptr<KafkaGroupConsumer>> groups_;
 };
 
 }   // namespace log2hdfs
@@ -0,0 +1,258 @@
+// Copyright (c) 2017 Lanceolata
+
+#include "kafka/kafka_group_consumer.h"
+#include <sstream>
+#include "kafka/kafka_conf.h"
+#include "kafka/kafka_error.h"
+#include "easylogging++.h"
+
+namespace log2hdfs {
+
+namespace {
+
+bool ConfValue(const rd_kafka_conf_t* rk_conf, const char* name,
+               std::string* value) {
+  char buf[512];
+  size_t size = sizeof(buf);
+  if (rd_kafka_conf_get(rk_conf, name, buf, &size) != RD_KAFKA_CONF_OK)
+    return false;
+  value->assign(buf);
+  return true;
+}
+
+bool TopicConfValue(const rd_kafka_topic_conf_t* rkt_conf, const char* name,
+                    std::string* value) {
+  char buf[512];
+  size_t size = sizeof(buf);
+  if (rd_kafka_topic_conf_get(rkt_conf, name, buf, &size)
+          != RD_KAFKA_CONF_OK)
+    return false;
+  value->assign(buf);
+  return true;
+}
+
+}   // namespace
+
+std::shared_ptr<KafkaGroupConsumer> KafkaGroupConsumer::Init(
+    KafkaGlobalConf* conf,
+    const std::string& topic,
+    const std::string& group,
+    KafkaTopicConf* topic_conf,
+    std::shared_ptr<KafkaConsumeCb> cb,
+    std::string* errstr) {
+  if (!conf || topic.empty() || !topic_conf || !cb) {
+    if (errstr)
+      *errstr = "Invalid parameters";
+    return nullptr;
+  }
+
+  std::shared_ptr<KafkaGroupConsumer> consumer =
+      std::make_shared<KafkaGroupConsumer>(topic, std::move(cb));
+
+  char errbuf[512];
+  rd_kafka_conf_t* rk_conf = rd_kafka_conf_dup(conf->rk_conf_);
+  if (!group.empty() && rd_kafka_conf_set(rk_conf, "group.id",
+          group.c_str(), errbuf, sizeof(errbuf)) != RD_KAFKA_CONF_OK) {
+    if (errstr)
+      *errstr = std::string(errbuf);
+    rd_kafka_conf_destroy(rk_conf);
+    return nullptr;
+  }
+
+  std::string value;
+  if (!ConfValue(rk_conf, "group.id", &value) || value.empty()) {
+    if (errstr)
+      *errstr = "group.id required";
+    rd_kafka_conf_destroy(rk_conf);
+    return nullptr;
+  }
+
+  // offsets stored after messages handled by callback
+  if (rd_kafka_conf_set(rk_conf, "enable.auto.offset.store", "false",
+                        errbuf, sizeof(errbuf)) != RD_KAFKA_CONF_OK) {
+    if (errstr)
+      *errstr = std::string(errbuf);
+    rd_kafka_conf_destroy(rk_conf);
+    return nullptr;
+  }
+
+  // group offsets live in the coordinator, not in local offset files
+  rd_kafka_topic_conf_t* rkt_conf =
+      rd_kafka_topic_conf_dup(topic_conf->rkt_conf_);
+  if (TopicConfValue(rkt_conf, "offset.store.method", &value) &&
+          value == "file") {
+    rd_kafka_topic_conf_set(rkt_conf, "offset.store.method", "broker",
+                            errbuf, sizeof(errbuf));
+  }
+  rd_kafka_conf_set_default_topic_conf(rk_conf, rkt_conf);
+
+  rd_kafka_conf_set_opaque(rk_conf, consumer.get());
+  rd_kafka_conf_set_rebalance_cb(rk_conf, &KafkaGroupConsumer::RebalanceCb);
+
+  rd_kafka_t* rk = rd_kafka_new(RD_KAFKA_CONSUMER, rk_conf,
+                                errbuf, sizeof(errbuf));
+  if (!rk) {
+    if (errstr)
+      *errstr = std::string(errbuf);
+    rd_kafka_conf_destroy(rk_conf);
+    return nullptr;
+  }
+
+  // serve rebalance events and messages from the consumer queue
+  rd_kafka_poll_set_consumer(rk);
+  consumer->rk_ = rk;
+  return consumer;
+}
+
+KafkaGroupConsumer::~KafkaGroupConsumer() {
+  Stop();
+  Join();
+  if (rk_)
+    rd_kafka_destroy(rk_);
+}
+
+void KafkaGroupConsumer::Start() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (started_)
+    return;
+
+  rd_kafka_topic_partition_list_t* topics =
+      rd_kafka_topic_partition_list_new(1);
+  rd_kafka_topic_partition_list_add(topics, topic_.c_str(),
+                                    RD_KAFKA_PARTITION_UA);
+  rd_kafka_resp_err_t err = rd_kafka_subscribe(rk_, topics);
+  rd_kafka_topic_partition_list_destroy(topics);
+  if (err != RD_KAFKA_RESP_ERR_NO_ERROR) {
+    LOG(WARNING) << "KafkaGroupConsumer Start rd_kafka_subscribe topic["
+                 << topic_ << "] failed with error["
+                 << KafkaErrorToStr(err) << "]";
+    return;
+  }
+
+  LOG(INFO) << "KafkaGroupConsumer Start rd_kafka_subscribe topic["
+            << topic_ << "] success";
+  started_ = true;
+  stop_.store(false);
+  thread_ = std::thread(&KafkaGroupConsumer::StartInternal, this);
+}
+
+void KafkaGroupConsumer::Stop() {
+  stop_.store(true);
+}
+
+void KafkaGroupConsumer::Join() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (thread_.joinable())
+    thread_.join();
+}
+
+void KafkaGroupConsumer::RebalanceCb(
+    rd_kafka_t* rk, rd_kafka_resp_err_t err,
+    rd_kafka_topic_partition_list_t* partitions, void* opaque) {
+  KafkaGroupConsumer* consumer = static_cast<KafkaGroupConsumer*>(opaque);
+  consumer->Rebalance(err, partitions);
+}
+
+void KafkaGroupConsumer::Rebalance(
+    rd_kafka_resp_err_t err, rd_kafka_topic_partition_list_t* partitions) {
+  std::vector<int32_t> vec;
+  std::stringstream stream;
+  for (int i = 0; i < partitions->cnt; ++i) {
+    if (topic_ != partitions->elems[i].topic)
+      continue;
+    vec.push_back(partitions->elems[i].partition);
+    stream << partitions->elems[i].partition << ",";
+  }
+
+  rd_kafka_resp_err_t res;
+  switch (err) {
+    case RD_KAFKA_RESP_ERR__ASSIGN_PARTITIONS:
+      LOG(INFO) << "KafkaGroupConsumer Rebalance topic[" << topic_
+                << "] assigned partitions[" << stream.str() << "]";
+      cb_->OnAssign(topic_, vec);
+      rd_kafka_assign(rk_, partitions);
+      break;
+    case RD_KAFKA_RESP_ERR__REVOKE_PARTITIONS:
+      LOG(INFO) << "KafkaGroupConsumer Rebalance topic[" << topic_
+                << "] revoked partitions[" << stream.str() << "]";
+      cb_->OnRevoke(topic_, vec);
+      // hand off, the next owner resumes after stored offsets
+      res = rd_kafka_commit(rk_, NULL, 0);
+      if (res != RD_KAFKA_RESP_ERR_NO_ERROR &&
+              res != RD_KAFKA_RESP_ERR__NO_OFFSET) {
+        LOG(WARNING) << "KafkaGroupConsumer Rebalance rd_kafka_commit "
+                     << "topic[" << topic_ << "] failed with error["
+                     << KafkaErrorToStr(res) << "]";
+      }
+      rd_kafka_assign(rk_, NULL);
+      break;
+    default:
+      LOG(WARNING) << "KafkaGroupConsumer Rebalance topic[" << topic_
+                   << "] failed with error[" << KafkaErrorToStr(err)
+                   << "]";
+      rd_kafka_assign(rk_, NULL);
+  }
+}
+
+void KafkaGroupConsumer::StartInternal() {
+  LOG(INFO) << "KafkaGroupConsumer thread topic[" << topic_ << "] created";
+
+  KafkaBatchController controller(GetBatchLimits());
+  std::vector<rd_kafka_message_t*> messages;
+  rd_kafka_queue_t* queue = rd_kafka_queue_get_consumer(rk_);
+  while (!stop_.load()) {
+    // limits might be updated at runtime
+    controller.SetLimits(GetBatchLimits());
+    size_t size = controller.size();
+    if (messages.size() < size)
+      messages.resize(size);
+
+    ssize_t n = rd_kafka_consume_batch_queue(queue,
+        controller.timeout_ms(), messages.data(), size);
+    if (n == -1) {
+      LOG(ERROR) << "KafkaGroupConsumer StartInternal "
+                 << "rd_kafka_consume_batch_queue topic[" << topic_
+                 << "] failed with errno[" << errno << "] errstr["
+                 << KafkaErrnoToStr(errno) << "]";
+      continue;
+    }
+
+    bool eof = false;
+    for (ssize_t i = 0; i < n; ++i) {
+      rd_kafka_message_t *message = messages[i];
+      switch (message->err) {
+        case RD_KAFKA_RESP_ERR_NO_ERROR: {
+          KafkaMessage msg(message);
+          cb_->Consume(msg);
+          rd_kafka_offset_store(message->rkt, message->partition,
+                                message->offset);
+          break;
+        }
+        case RD_KAFKA_RESP_ERR__PARTITION_EOF:
+          rd_kafka_message_destroy(message);
+          eof = true;
+          break;
+        default:
+          LOG(WARNING) << "KafkaGroupConsumer StartInternal topic["
+                       << topic_ << "] partition[" << message->partition
+                       << "] error[" << KafkaErrorToStr(message->err)
+                       << "]";
+          rd_kafka_message_destroy(message);
+      }
+    }
+    controller.Update(n, eof);
+  }
+
+  rd_kafka_queue_destroy(queue);
+
+  // revokes assignment through RebalanceCb and leaves the group
+  rd_kafka_resp_err_t err = rd_kafka_consumer_close(rk_);
+  if (err != RD_KAFKA_RESP_ERR_NO_ERROR) {
+    LOG(WARNING) << "KafkaGroupConsumer StartInternal "
+                 << "rd_kafka_consumer_close topic[" << topic_
+                 << "] failed with error[" << KafkaErrorToStr(err) << "]";
+  }
+  LOG(INFO) << "KafkaGroupConsumer thread topic[" << topic_ << "] exiting";
+}
+
+}   // namespace log2hdfs
@@ -0,0 +1,146 @@
+// Copyright (c) 2017 Lanceolata
+
+#ifndef LOG2HDFS_KAFKA_KAFKA_GROUP_CONSUMER_H_
+#define LOG2HDFS_KAFKA_KAFKA_GROUP_CONSUMER_H_
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include "librdkafka/rdkafka.h"
+#ifdef __cplusplus
+}
+#endif
+
+#include "kafka/kafka_topic_consumer.h"
+#include "kafka/kafka_batch_controller.h"
+
+namespace log2hdfs {
+
+class KafkaGlobalConf;
+class KafkaTopicConf;
+
+/**
+ * Kafka balanced group consumer
+ *
+ * Subscribes one topic with its own client handle, partitions are
+ * balanced between all members of the consumer group and offsets are
+ * committed to the group coordinator.
+ *
+ * Before partitions are revoked, KafkaConsumeCb::OnRevoke() is called
+ * and stored offsets are committed synchronously, the next owner
+ * resumes after the last consumed message.
+ */
+class KafkaGroupConsumer {
+ public:
+  /**
+   * Static function to create a KafkaGroupConsumer shared_ptr.
+   *
+   * @param conf                kafka global conf
+   * @param topic               topic name
+   * @param group               consumer group id, empty to use group.id
+   *                            of conf
+   * @param topic_conf          kafka topic conf
+   * @param cb                  KafkaConsumeCb callback
+   * @param errstr              err string to set
+   *
+   * @returns std::shared_ptr<KafkaGroupConsumer> if success;
+   *          nullptr otherwise.
+   */
+  static std::shared_ptr<KafkaGroupConsumer> Init(
+      KafkaGlobalConf* conf,
+      const std::string& topic,
+      const std::string& group,
+      KafkaTopicConf* topic_conf,
+      std::shared_ptr<KafkaConsumeCb> cb,
+      std::string* errstr);
+
+  /**
+   * Constructor
+   *
+   * @param topic               topic name
+   * @param cb                  KafkaConsumeCb callback
+   */
+  KafkaGroupConsumer(const std::string& topic,
+                     std::shared_ptr<KafkaConsumeCb> cb):
+      rk_(NULL), topic_(topic), cb_(std::move(cb)), started_(false),
+      stop_(true) {}
+
+  /**
+   * Destructor
+   *
+   * Stop consume thread, leave the group and destroy client handle.
+   */
+  ~KafkaGroupConsumer();
+
+  KafkaGroupConsumer(const KafkaGroupConsumer& other) = delete;
+  KafkaGroupConsumer& operator=(const KafkaGroupConsumer& other) = delete;
+
+  /**
+   * @returns Topic name
+   */
+  const std::string& Name() const {
+    return topic_;
+  }
+
+  /**
+   * Update consume batch limits.
+   */
+  void SetBatchLimits(const KafkaBatchLimits& limits) {
+    std::lock_guard<std::mutex> lock(limits_mutex_);
+    limits_ = limits;
+  }
+
+  /**
+   * Subscribe topic and start consume thread.
+   */
+  void Start();
+
+  /**
+   * Stop consume thread.
+   */
+  void Stop();
+
+  /**
+   * Join consume thread.
+   *
+   * Consume thread leaves the group before exiting, a stopped consumer
+   * can not be started again.
+   */
+  void Join();
+
+ private:
+  static void RebalanceCb(rd_kafka_t* rk, rd_kafka_resp_err_t err,
+                          rd_kafka_topic_partition_list_t* partitions,
+                          void* opaque);
+
+  void Rebalance(rd_kafka_resp_err_t err,
+                 rd_kafka_topic_partition_list_t* partitions);
+
+  void StartInternal();
+
+  KafkaBatchLimits GetBatchLimits() const {
+    std::lock_guard<std::mutex> lock(limits_mutex_);
+    return limits_;
+  }
+
+  rd_kafka_t* rk_;
+  std::string topic_;
+  std::shared_ptr<KafkaConsumeCb> cb_;
+  mutable std::mutex mutex_;
+  bool started_;
+  std::atomic<bool> stop_;
+  std::thread thread_;
+  mutable std::mutex limits_mutex_;
+  KafkaBatchLimits limits_;
+};
+
+}   // namespace log2hdfs
+
+#endif  // LOG2HDFS_KAFKA_KAFKA_GROUP_CONSUMER_H_
@@ -1,6 +1,9 @@
 // Copyright (c) 2017 Lanceolata
 
 #include "kafka/kafka_handle.h"
+#include <algorithm>
+#include <chrono>
+#include "kafka/kafka_error.h"
 
 namespace log2hdfs {
 
@@ -18,4 +21,121 @@ const std::string KafkaHandle::MemberId() const {
   return memberid;
 }
 
+// Poll interval of Flush
+#define FLUSH_POLL_MS 100
+
+bool KafkaHandle::Flush(int timeout_ms) {
+  auto deadline = std::chrono::steady_clock::now() +
+      std::chrono::milliseconds(timeout_ms);
+  while (rd_kafka_outq_len(rk_) > 0) {
+    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+        deadline - std::chrono::steady_clock::now()).count();
+    if (left <= 0)
+      return false;
+    rd_kafka_poll(rk_, std::min(static_cast<int>(left), FLUSH_POLL_MS));
+  }
+  return true;
+}
+
+bool KafkaHandle::QueryWatermarkOffsets(const std::string& topic,
+                                        int32_t partition,
+                                        int64_t* low, int64_t* high,
+                                        int timeout_ms,
+                                        std::string* errstr) {
+  if (topic.empty() || !low || !high) {
+    if (errstr)
+      *errstr = "Invalid parameters";
+    return false;
+  }
+
+  rd_kafka_resp_err_t err = rd_kafka_query_watermark_offsets(
+      rk_, topic.c_str(), partition, low, high, timeout_ms);
+  if (err != RD_KAFKA_RESP_ERR_NO_ERROR) {
+    if (errstr)
+      *errstr = KafkaErrorToStr(err);
+    return false;
+  }
+  return true;
+}
+
+bool KafkaHandle::OffsetsForTimes(const std::string& topic,
+                                  const std::vector<int32_t>& partitions,
+                                  int64_t timestamp_ms,
+                                  std::vector<int64_t>* offsets,
+                                  int timeout_ms,
+                                  std::string* errstr) {
+  if (topic.empty() || partitions.empty() || !offsets) {
+    if (errstr)
+      *errstr = "Invalid parameters";
+    return false;
+  }
+
+  // offset field carries timestamp in and offset out
+  rd_kafka_topic_partition_list_t* list =
+      rd_kafka_topic_partition_list_new(partitions.size());
+  for (auto& partition : partitions) {
+    rd_kafka_topic_partition_list_add(list, topic.c_str(), partition)
+        ->offset = timestamp_ms;
+  }
+
+  rd_kafka_resp_err_t err = rd_kafka_offsets_for_times(rk_, list,
+                                                       timeout_ms);
+  if (err == RD_KAFKA_RESP_ERR_NO_ERROR) {
+    offsets->clear();
+    for (int i = 0; i < list->cnt; ++i) {
+      if (list->elems[i].err != RD_KAFKA_RESP_ERR_NO_ERROR) {
+        err = list->elems[i].err;
+        break;
+      }
+      offsets->push_back(list->elems[i].offset);
+    }
+  }
+  rd_kafka_topic_partition_list_destroy(list);
+
+  if (err != RD_KAFKA_RESP_ERR_NO_ERROR) {
+    if (errstr)
+      *errstr = KafkaErrorToStr(err);
+    return false;
+  }
+  return true;
+}
+
+bool KafkaHandle::PartitionCount(const std::string& topic, int* count,
+                                 int timeout_ms, std::string* errstr) {
+  if (topic.empty() || !count) {
+    if (errstr)
+      *errstr = "Invalid parameters";
+    return false;
+  }
+
+  // all topics, a topic handle created here would take the topic conf
+  // of later consumers
+  const struct rd_kafka_metadata* metadata;
+  rd_kafka_resp_err_t err = rd_kafka_metadata(rk_, 1, NULL, &metadata,
+                                              timeout_ms);
+  if (err != RD_KAFKA_RESP_ERR_NO_ERROR) {
+    if (errstr)
+      *errstr = KafkaErrorToStr(err);
+    return false;
+  }
+
+  err = RD_KAFKA_RESP_ERR__UNKNOWN_TOPIC;
+  for (int i = 0; i < metadata->topic_cnt; ++i) {
+    const struct rd_kafka_metadata_topic& t = metadata->topics[i];
+    if (topic == t.topic) {
+      err = t.err;
+      *count = t.partition_cnt;
+      break;
+    }
+  }
+  rd_kafka_metadata_destroy(metadata);
+
+  if (err != RD_KAFKA_RESP_ERR_NO_ERROR) {
+    if (errstr)
+      *errstr = KafkaErrorToStr(err);
+    return false;
+  }
+  return true;
+}
+
 }   // namespace log2hdfs
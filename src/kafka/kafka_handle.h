@@ -4,6 +4,7 @@
 #define LOG2HDFS_KAFKA_KAFKA_HANDLE_H_
 
 #include <string>
+#include <vector>
 #include <memory>
 
 #ifdef __cplusplus
@@ -118,9 +119,69 @@ class KafkaHandle {
     return n;
   }
 
+  /**
+   * Polls the provided kafka handle until out queue is empty, like
+   * PollOutq() but bounded by timeout.
+   *
+   * @param timeout_ms          max wait time
+   *
+   * @returns True if out queue drained; false on timeout.
+   */
+  bool Flush(int timeout_ms);
+
+  /**
+   * Query broker for low (oldest) and high (next) offsets of partition.
+   *
+   * @param topic               topic name
+   * @param partition           partition
+   * @param low                 low offset to set
+   * @param high                high offset to set
+   * @param timeout_ms          query timeout
+   * @param errstr              err string to set
+   *
+   * @returns True if success; false otherwise.
+   */
+  bool QueryWatermarkOffsets(const std::string& topic, int32_t partition,
+                             int64_t* low, int64_t* high, int timeout_ms,
+                             std::string* errstr);
+
+  /**
+   * Look up the earliest offsets whose timestamps are greater than or
+   * equal to the given timestamp.
+   *
+   * @param topic               topic name
+   * @param partitions          partitions
+   * @param timestamp_ms        milliseconds since epoch (UTC)
+   * @param offsets             offsets to set, -1 if no such message
+   * @param timeout_ms          query timeout
+   * @param errstr              err string to set
+   *
+   * @returns True if success; false otherwise.
+   */
+  bool OffsetsForTimes(const std::string& topic,
+                       const std::vector<int32_t>& partitions,
+                       int64_t timestamp_ms,
+                       std::vector<int64_t>* offsets,
+                       int timeout_ms,
+                       std::string* errstr);
+
+  /**
+   * Query broker for partition count of topic.
+   *
+   * @param topic               topic name
+   * @param count               partition count to set
+   * @param timeout_ms          query timeout
+   * @param errstr              err string to set
+   *
+   * @returns True if success; false otherwise.
+   */
+  bool PartitionCount(const std::string& topic, int* count,
+                      int timeout_ms, std::string* errstr);
+
  private:
   friend class KafkaProducer;
   friend class KafkaConsumer;
+  friend class KafkaTopicProducer;
 
   rd_kafka_t* rk_;
 };
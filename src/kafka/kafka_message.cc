@@ -4,6 +4,8 @@
 
 namespace log2hdfs {
 
+const char* KafkaMessage::kEventTimeHeader = "log2hdfs.event_time";
+
 std::unique_ptr<KafkaMessage> KafkaMessage::Init(
     rd_kafka_message_t* rkmessage) {
   if (!rkmessage)
@@ -19,4 +21,16 @@ MessageTimestamp KafkaMessage::Timestamp() const {
   return ts;
 }
 
+bool KafkaMessage::HasHeader(const char* name) const {
+  rd_kafka_headers_t* headers;
+  if (rd_kafka_message_headers(rkmessage_, &headers) !=
+          RD_KAFKA_RESP_ERR_NO_ERROR)
+    return false;
+
+  const void* value;
+  size_t size;
+  return rd_kafka_header_get_last(headers, name, &value, &size) ==
+         RD_KAFKA_RESP_ERR_NO_ERROR;
+}
+
 }   // namespace log2hdfs
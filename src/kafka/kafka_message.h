@@ -50,6 +50,12 @@ class MessageTimestamp {
  */
 class KafkaMessage {
  public:
+  /**
+   * Header of messages whose create time is event time extracted from
+   * payload by producer.
+   */
+  static const char* kEventTimeHeader;
+
   /**
    * Static function to create a KafkaGlobalConf unique_ptr.
    * 
@@ -148,6 +154,11 @@ class KafkaMessage {
    */
   MessageTimestamp Timestamp() const;
 
+  /**
+   * @returns True if message has header name, false otherwise.
+   */
+  bool HasHeader(const char* name) const;
+
   /**
    * @returns The msg_opaque as provided to KafkaProducer::produce()
    */
@@ -91,6 +91,20 @@ class KafkaProducer {
     return handle_->PollOutq(length, timeout_ms);
   }
 
+  /**
+   * See KafkaHandle Flush().
+   */
+  bool Flush(int timeout_ms) {
+    return handle_->Flush(timeout_ms);
+  }
+
+  /**
+   * See KafkaHandle OutqLen().
+   */
+  int OutqLen() {
+    return handle_->OutqLen();
+  }
+
   /**
    * Create kafka topic producer
    * 
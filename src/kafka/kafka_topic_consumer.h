@@ -7,9 +7,6 @@
 #include <vector>
 #include <memory>
 #include <mutex>
-#include <atomic>
-#include <thread>
-#include <unordered_map>
 
 #ifdef __cplusplus
 extern "C" {
@@ -33,14 +30,47 @@ class KafkaConsumeCb {
   /**
    * The consume callback is used with log2hdfs::KafkaTopicConsumer
    * and will be called for each consumed message.
+   *
+   * Called by consume workers of log2hdfs::KafkaConsumer, messages of
+   * different partitions might be consumed concurrently.
    */
   virtual void Consume(const KafkaMessage& msg) = 0;
 
+  /**
+   * Called by log2hdfs::KafkaGroupConsumer before partitions assigned
+   * to this member are consumed.
+   */
+  virtual void OnAssign(const std::string& topic,
+                        const std::vector<int32_t>& partitions) {}
+
+  /**
+   * Called by log2hdfs::KafkaGroupConsumer before partitions are taken
+   * away from this member. Offsets of consumed messages are committed
+   * after it returns, so data written so far must be made durable here.
+   */
+  virtual void OnRevoke(const std::string& topic,
+                        const std::vector<int32_t>& partitions) {}
+
+  /**
+   * Called by consume workers of log2hdfs::KafkaConsumer when partition
+   * reached the end of log, needs enable.partition.eof.
+   *
+   * @param topic               topic name
+   * @param partition           partition
+   * @param offset              offset of next message to fetch
+   */
+  virtual void OnEof(const std::string& topic, int32_t partition,
+                     int64_t offset) {}
+
   virtual ~KafkaConsumeCb() {}
 };
 
 /**
  * Kafka topic consumer
+ *
+ * Partitions are consumed onto shared queues of log2hdfs::KafkaConsumer,
+ * each partition is forwarded to exactly one queue so its messages are
+ * consumed in order by one worker.
  */
 class KafkaTopicConsumer {
  public:
@@ -51,7 +81,7 @@ class KafkaTopicConsumer {
    * @param topic              KafkaTopic shared_ptr
    * @param partitions         topic partitions
    * @param offsets            partitions offsets
-   * @param cb                 topic consume callback
+   * @param queues             partitions consume queues
    *  
    * @returns std::shared_ptr<KafkaTopicConsumer>
    */
@@ -60,7 +90,7 @@ class KafkaTopicConsumer {
       std::shared_ptr<KafkaTopic> topic,
       const std::vector<int32_t>& partitions,
       const std::vector<int64_t>& offsets,
-      std::shared_ptr<KafkaConsumeCb> cb);
+      const std::vector<rd_kafka_queue_t*>& queues);
 
   /**
    * Constructor
@@ -69,26 +99,24 @@ class KafkaTopicConsumer {
    * @param topic              KafkaTopic shared_ptr
    * @param partitions         topic partitions
    * @param offsets            partitions offsets
-   * @param cb                 topic consume callback
+   * @param queues             partitions consume queues
    */
   KafkaTopicConsumer(
       std::shared_ptr<KafkaHandle> handle,
       std::shared_ptr<KafkaTopic> topic,
       const std::vector<int32_t>& partitions,
       const std::vector<int64_t>& offsets,
-      std::shared_ptr<KafkaConsumeCb> cb):
+      const std::vector<rd_kafka_queue_t*>& queues):
       handle_(std::move(handle)), topic_(std::move(topic)),
-      partitions_(partitions), offsets_(offsets),
-      cb_(std::move(cb)), stop_(true) {}
+      partitions_(partitions), offsets_(offsets), queues_(queues) {}
 
   /**
    * Destructor
    * 
-   * Stop all consume threads and join them.
+   * Stop consume all partitions.
    */
   ~KafkaTopicConsumer() {
     Stop();
-    Join();
   }
 
   KafkaTopicConsumer(const KafkaTopicConsumer& other) = delete;
@@ -102,33 +130,34 @@ class KafkaTopicConsumer {
   }
 
   /**
-   * Start all consume threads.
+   * @returns librdkafka topic of messages
    */
-  void Start();
+  const rd_kafka_topic_t* rkt() const {
+    return topic_->rkt_;
+  }
 
   /**
-   * Stop all consume threads.
+   * Start consume all partitions onto their queues.
    */
-  void Stop();
+  void Start();
 
   /**
-   * Join all consume threads.
-   * 
-   * Need to call Stop() before call Join().
+   * Stop consume all partitions.
+   *
+   * Messages already fetched might still be consumed by workers, see
+   * KafkaConsumer StopTopic().
    */
-  void Join();
+  void Stop();
 
  private:
-  void StartInternal(int32_t partition);
-
   std::shared_ptr<KafkaHandle> handle_;
   std::shared_ptr<KafkaTopic> topic_;
   std::vector<int32_t> partitions_;
   std::vector<int64_t> offsets_;
-  std::shared_ptr<KafkaConsumeCb> cb_;
+  std::vector<rd_kafka_queue_t*> queues_;
   mutable std::mutex mutex_;
-  std::atomic<bool> stop_;
-  std::vector<std::thread> threads_;
+  // partitions consume started
+  std::vector<int32_t> started_;
 };
 
 }   // namespace log2hdfs
@@ -15,6 +15,7 @@ extern "C" {
 #endif
 
 #include "kafka/kafka_handle.h"
+#include "kafka/kafka_message.h"
 #include "kafka/kafka_topic.h"
 
 namespace log2hdfs {
@@ -81,6 +82,84 @@ class KafkaTopicProducer {
                             NULL, 0, NULL);
   }
 
+  /**
+   * Produce messages in one call.
+   *
+   * Without RD_KAFKA_MSG_F_COPY payload must stay valid until delivery
+   * report callback. _private of every message is passed to delivery
+   * report callback as msg_opaque. err of every message is reset before
+   * produce and set for messages that failed.
+   *
+   * @param messages            messages to produce
+   * @param num                 number of messages
+   * @param msgflags            0 or RD_KAFKA_MSG_F_COPY
+   *
+   * @return number of messages enqueued.
+   */
+  int ProduceBatch(rd_kafka_message_t* messages, int num,
+                   int msgflags = 0) {
+    if (!messages || num <= 0)
+      return 0;
+
+    for (int i = 0; i < num; ++i)
+      messages[i].err = RD_KAFKA_RESP_ERR_NO_ERROR;
+    return rd_kafka_produce_batch(topic_->rkt_, RD_KAFKA_PARTITION_UA,
+                                  msgflags, messages, num);
+  }
+
+  /**
+   * Produce messages with create time.
+   *
+   * produce_batch can not carry timestamps, messages are produced one
+   * by one with producev. Messages with create time carry header
+   * KafkaMessage::kEventTimeHeader, consumers trust the create time as
+   * event time only with it. Same contract as ProduceBatch() otherwise.
+   *
+   * @param messages            messages to produce
+   * @param timestamps          create time of messages in milliseconds,
+   *                            0 means not extracted, sent with now
+   * @param num                 number of messages
+   * @param msgflags            0 or RD_KAFKA_MSG_F_COPY
+   *
+   * @return number of messages enqueued.
+   */
+  int ProduceBatch(rd_kafka_message_t* messages, const int64_t* timestamps,
+                   int num, int msgflags = 0) {
+    if (!messages || !timestamps || num <= 0)
+      return 0;
+
+    int n = 0;
+    for (int i = 0; i < num; ++i) {
+      rd_kafka_message_t& msg = messages[i];
+      if (timestamps[i] > 0) {
+        msg.err = rd_kafka_producev(
+            handle_->rk_,
+            RD_KAFKA_V_RKT(topic_->rkt_),
+            RD_KAFKA_V_PARTITION(RD_KAFKA_PARTITION_UA),
+            RD_KAFKA_V_MSGFLAGS(msgflags),
+            RD_KAFKA_V_VALUE(msg.payload, msg.len),
+            RD_KAFKA_V_KEY(msg.key, msg.key_len),
+            RD_KAFKA_V_OPAQUE(msg._private),
+            RD_KAFKA_V_TIMESTAMP(timestamps[i]),
+            RD_KAFKA_V_HEADER(KafkaMessage::kEventTimeHeader, NULL, 0),
+            RD_KAFKA_V_END);
+      } else {
+        msg.err = rd_kafka_producev(
+            handle_->rk_,
+            RD_KAFKA_V_RKT(topic_->rkt_),
+            RD_KAFKA_V_PARTITION(RD_KAFKA_PARTITION_UA),
+            RD_KAFKA_V_MSGFLAGS(msgflags),
+            RD_KAFKA_V_VALUE(msg.payload, msg.len),
+            RD_KAFKA_V_KEY(msg.key, msg.key_len),
+            RD_KAFKA_V_OPAQUE(msg._private),
+            RD_KAFKA_V_END);
+      }
+      if (msg.err == RD_KAFKA_RESP_ERR_NO_ERROR)
+        ++n;
+    }
+    return n;
+  }
+
  private:
   std::shared_ptr<KafkaHandle> handle_;
   std::shared_ptr<KafkaTopic> topic_;
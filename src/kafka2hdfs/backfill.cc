@@ -0,0 +1,239 @@
+// Copyright (c) 2017 Lanceolata
+
+#include "kafka2hdfs/backfill.h"
+#include "kafka/kafka_consumer.h"
+#include "kafka2hdfs/consume_callback.h"
+#include "kafka2hdfs/path_format.h"
+#include "kafka2hdfs/topic_conf.h"
+#include "kafka2hdfs/upload.h"
+#include "util/fp_cache.h"
+#include "easylogging++.h"
+
+namespace log2hdfs {
+
+// Watermark and offsets for times query timeout
+#define BACKFILL_QUERY_TIMEOUT_MS 10000
+
+// ------------------------------------------------------------------
+// BackfillCallback
+
+void BackfillCallback::SetRange(const std::vector<int32_t>& partitions,
+                                const std::vector<int64_t>& starts,
+                                const std::vector<int64_t>& ends) {
+  ranges_.clear();
+  size_t remaining = 0;
+  for (size_t i = 0; i < partitions.size(); ++i) {
+    Range range;
+    range.end = ends[i];
+    range.done = starts[i] >= ends[i];
+    if (!range.done)
+      ++remaining;
+    ranges_[partitions[i]] = range;
+  }
+  remaining_.store(remaining);
+}
+
+void BackfillCallback::Consume(const KafkaMessage& msg) {
+  auto it = ranges_.find(msg.Partition());
+  if (it == ranges_.end() || it->second.done)
+    return;
+
+  Range* range = &it->second;
+  // gap at end of range, compacted or deleted
+  if (msg.Offset() >= range->end) {
+    SetDone(msg.TopicName(), msg.Partition(), range);
+    return;
+  }
+
+  cb_->Consume(msg);
+  consumed_.fetch_add(1);
+  if (msg.Offset() + 1 >= range->end)
+    SetDone(msg.TopicName(), msg.Partition(), range);
+}
+
+void BackfillCallback::OnEof(const std::string& topic, int32_t partition,
+                             int64_t offset) {
+  auto it = ranges_.find(partition);
+  if (it == ranges_.end() || it->second.done)
+    return;
+
+  if (offset >= it->second.end)
+    SetDone(topic, partition, &it->second);
+}
+
+void BackfillCallback::SetDone(const std::string& topic, int32_t partition,
+                               Range* range) {
+  range->done = true;
+  remaining_.fetch_sub(1);
+  LOG(INFO) << "BackfillCallback topic[" << topic << "] partition["
+            << partition << "] reached end offset[" << range->end << "]";
+}
+
+// ------------------------------------------------------------------
+// Backfill
+
+std::unique_ptr<Backfill> Backfill::Init(
+    std::shared_ptr<TopicConf> conf,
+    std::shared_ptr<KafkaConsumer> consumer,
+    std::shared_ptr<HdfsHandle> handle) {
+  if (!conf || !consumer || !handle) {
+    LOG(ERROR) << "Backfill Init invalid parameters";
+    return nullptr;
+  }
+
+  std::shared_ptr<FpCache> cache = FpCache::Init();
+  if (!cache) {
+    LOG(ERROR) << "Backfill Init FpCache Init failed";
+    return nullptr;
+  }
+
+  std::shared_ptr<PathFormat> format = PathFormat::Init(conf);
+  if (!format) {
+    LOG(ERROR) << "Backfill Init PathFormat Init failed";
+    return nullptr;
+  }
+
+  std::shared_ptr<KafkaConsumeCb> cb = ConsumeCallback::Init(
+      conf, format, cache);
+  if (!cb) {
+    LOG(ERROR) << "Backfill Init ConsumeCallback Init failed";
+    return nullptr;
+  }
+
+  std::unique_ptr<Upload> upload = Upload::Init(conf, format, cache,
+                                                std::move(handle));
+  if (!upload) {
+    LOG(ERROR) << "Backfill Init Upload Init failed";
+    return nullptr;
+  }
+
+  return std::unique_ptr<Backfill>(new Backfill(std::move(conf),
+             std::move(consumer), std::move(cache),
+             std::make_shared<BackfillCallback>(std::move(cb)),
+             std::move(upload)));
+}
+
+Backfill::Backfill(std::shared_ptr<TopicConf> conf,
+                   std::shared_ptr<KafkaConsumer> consumer,
+                   std::shared_ptr<FpCache> cache,
+                   std::shared_ptr<BackfillCallback> cb,
+                   std::unique_ptr<Upload> upload):
+    conf_(std::move(conf)), consumer_(std::move(consumer)),
+    cache_(std::move(cache)), cb_(std::move(cb)),
+    upload_(std::move(upload)), started_(false) {}
+
+Backfill::~Backfill() {
+  if (started_)
+    consumer_->StopTopic(conf_->topic());
+}
+
+bool Backfill::Resolve(std::vector<int32_t>* partitions,
+                       std::vector<int64_t>* starts,
+                       std::vector<int64_t>* ends) {
+  const std::string& topic = conf_->topic();
+  *partitions = conf_->partitions();
+  std::string errstr;
+
+  if (conf_->backfill_start_time() >= 0) {
+    if (!consumer_->OffsetsForTimes(topic, *partitions,
+            conf_->backfill_start_time(), starts,
+            BACKFILL_QUERY_TIMEOUT_MS, &errstr)) {
+      LOG(ERROR) << "Backfill Resolve OffsetsForTimes start topic["
+                 << topic << "] failed with errstr[" << errstr << "]";
+      return false;
+    }
+  } else {
+    *starts = conf_->backfill_start();
+  }
+
+  if (conf_->backfill_end_time() >= 0) {
+    if (!consumer_->OffsetsForTimes(topic, *partitions,
+            conf_->backfill_end_time(), ends,
+            BACKFILL_QUERY_TIMEOUT_MS, &errstr)) {
+      LOG(ERROR) << "Backfill Resolve OffsetsForTimes end topic["
+                 << topic << "] failed with errstr[" << errstr << "]";
+      return false;
+    }
+  } else if (!conf_->backfill_end().empty()) {
+    *ends = conf_->backfill_end();
+  } else {
+    ends->assign(partitions->size(), RD_KAFKA_OFFSET_END);
+  }
+
+  // clamp to retained messages, offset end(or no message after
+  // timestamp) is high watermark
+  for (size_t i = 0; i < partitions->size(); ++i) {
+    int64_t low, high;
+    if (!consumer_->QueryWatermarkOffsets(topic, (*partitions)[i],
+            &low, &high, BACKFILL_QUERY_TIMEOUT_MS, &errstr)) {
+      LOG(ERROR) << "Backfill Resolve QueryWatermarkOffsets topic["
+                 << topic << "] partition[" << (*partitions)[i]
+                 << "] failed with errstr[" << errstr << "]";
+      return false;
+    }
+
+    for (int64_t* offset : {&(*starts)[i], &(*ends)[i]}) {
+      if (*offset == RD_KAFKA_OFFSET_END || *offset > high) {
+        *offset = high;
+      } else if (*offset < low) {
+        *offset = low;
+      }
+    }
+
+    LOG(INFO) << "Backfill Resolve topic[" << topic << "] partition["
+              << (*partitions)[i] << "] range[" << (*starts)[i] << ", "
+              << (*ends)[i] << ")";
+  }
+  return true;
+}
+
+bool Backfill::Start() {
+  std::vector<int32_t> partitions;
+  std::vector<int64_t> starts, ends;
+  if (!Resolve(&partitions, &starts, &ends))
+    return false;
+
+  cb_->SetRange(partitions, starts, ends);
+
+  // empty ranges need not consume
+  std::vector<int32_t> consume_partitions;
+  std::vector<int64_t> consume_offsets;
+  for (size_t i = 0; i < partitions.size(); ++i) {
+    if (starts[i] < ends[i]) {
+      consume_partitions.push_back(partitions[i]);
+      consume_offsets.push_back(starts[i]);
+    }
+  }
+  if (consume_partitions.empty())
+    return true;
+
+  const std::string& topic = conf_->topic();
+  std::string errstr;
+  if (!consumer_->CreateTopicConsumer(topic,
+          conf_->kafka_topic_conf().get(), consume_partitions,
+          consume_offsets, cb_, &errstr)) {
+    LOG(ERROR) << "Backfill Start CreateTopicConsumer topic[" << topic
+               << "] failed with errstr[" << errstr << "]";
+    return false;
+  }
+
+  started_ = consumer_->StartTopic(topic);
+  return started_;
+}
+
+bool Backfill::Finish() {
+  const std::string& topic = conf_->topic();
+  if (started_) {
+    // no message of topic consumed after return
+    consumer_->StopTopic(topic);
+    started_ = false;
+  }
+
+  // callback is the only writer, files closed once erased from cache
+  std::vector<std::string> paths = cache_->CloseAll();
+  LOG(INFO) << "Backfill Finish topic[" << topic << "] consumed["
+            << Consumed() << "] sealed files[" << paths.size() << "]";
+  return upload_->Flush();
+}
+
+}   // namespace log2hdfs
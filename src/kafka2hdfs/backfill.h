@@ -0,0 +1,163 @@
+// Copyright (c) 2017 Lanceolata
+
+#ifndef LOG2HDFS_KAFKA2HDFS_BACKFILL_H_
+#define LOG2HDFS_KAFKA2HDFS_BACKFILL_H_
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <unordered_map>
+#include "kafka/kafka_topic_consumer.h"
+
+namespace log2hdfs {
+
+class FpCache;
+class HdfsHandle;
+class KafkaConsumer;
+class TopicConf;
+class Upload;
+
+// ------------------------------------------------------------------
+// BackfillCallback
+
+/**
+ * Wraps a KafkaConsumeCb, drops messages at or after end offsets.
+ */
+class BackfillCallback : public KafkaConsumeCb {
+ public:
+  explicit BackfillCallback(std::shared_ptr<KafkaConsumeCb> cb):
+      cb_(std::move(cb)), remaining_(0), consumed_(0) {}
+
+  BackfillCallback(const BackfillCallback& other) = delete;
+  BackfillCallback& operator=(const BackfillCallback& other) = delete;
+
+  /**
+   * Set end offsets(exclusive), must be called before consume started.
+   *
+   * @param partitions          partitions
+   * @param starts              start offsets
+   * @param ends                end offsets
+   */
+  void SetRange(const std::vector<int32_t>& partitions,
+                const std::vector<int64_t>& starts,
+                const std::vector<int64_t>& ends);
+
+  void Consume(const KafkaMessage& msg);
+
+  /**
+   * Range done if end of log is at or after end offset, messages left
+   * in range are control records or compacted away.
+   */
+  void OnEof(const std::string& topic, int32_t partition, int64_t offset);
+
+  /**
+   * @returns True if all partitions reached end offsets.
+   */
+  bool Done() const {
+    return remaining_.load() == 0;
+  }
+
+  /**
+   * @returns Messages consumed.
+   */
+  uint64_t Consumed() const {
+    return consumed_.load();
+  }
+
+ private:
+  struct Range {
+    int64_t end;
+    bool done;
+  };
+
+  void SetDone(const std::string& topic, int32_t partition, Range* range);
+
+  std::shared_ptr<KafkaConsumeCb> cb_;
+  // each partition updated by its consume worker only
+  std::unordered_map<int32_t, Range> ranges_;
+  std::atomic<size_t> remaining_;
+  std::atomic<uint64_t> consumed_;
+};
+
+// ------------------------------------------------------------------
+// Backfill
+
+/**
+ * Bounded range consume of one topic
+ *
+ * Consumes [start, end) of configured partitions through the regular
+ * ConsumeCallback into staging dirs of TopicConf, then uploads all
+ * files with Upload.
+ */
+class Backfill {
+ public:
+  /**
+   * Static function to create a Backfill unique_ptr.
+   *
+   * @param conf                topic conf init by InitBackfillConf()
+   * @param consumer            KafkaConsumer shared_ptr
+   * @param handle              HdfsHandle shared_ptr
+   *
+   * @returns std::unique_ptr<Backfill> if success; nullptr otherwise.
+   */
+  static std::unique_ptr<Backfill> Init(
+      std::shared_ptr<TopicConf> conf,
+      std::shared_ptr<KafkaConsumer> consumer,
+      std::shared_ptr<HdfsHandle> handle);
+
+  Backfill(std::shared_ptr<TopicConf> conf,
+           std::shared_ptr<KafkaConsumer> consumer,
+           std::shared_ptr<FpCache> cache,
+           std::shared_ptr<BackfillCallback> cb,
+           std::unique_ptr<Upload> upload);
+
+  ~Backfill();
+
+  Backfill(const Backfill& other) = delete;
+  Backfill& operator=(const Backfill& other) = delete;
+
+  /**
+   * Resolve range to offsets and start consume.
+   *
+   * @returns True if success; false otherwise.
+   */
+  bool Start();
+
+  /**
+   * @returns True if all partitions reached end offsets.
+   */
+  bool Done() const {
+    return cb_->Done();
+  }
+
+  /**
+   * @returns Messages consumed.
+   */
+  uint64_t Consumed() const {
+    return cb_->Consumed();
+  }
+
+  /**
+   * Stop consume, seal files and upload them.
+   *
+   * @returns True if all files uploaded; false otherwise.
+   */
+  bool Finish();
+
+ private:
+  bool Resolve(std::vector<int32_t>* partitions,
+               std::vector<int64_t>* starts,
+               std::vector<int64_t>* ends);
+
+  std::shared_ptr<TopicConf> conf_;
+  std::shared_ptr<KafkaConsumer> consumer_;
+  std::shared_ptr<FpCache> cache_;
+  std::shared_ptr<BackfillCallback> cb_;
+  std::unique_ptr<Upload> upload_;
+  bool started_;
+};
+
+}   // namespace log2hdfs
+
+#endif  // LOG2HDFS_KAFKA2HDFS_BACKFILL_H_
@@ -1,6 +1,8 @@
 // Copyright (c) 2017 Lanceolata
 
 #include "kafka2hdfs/consume_callback.h"
+#include "kafka2hdfs/done_marker.h"
+#include "kafka2hdfs/manifest.h"
 #include "kafka2hdfs/path_format.h"
 #include "kafka2hdfs/topic_conf.h"
 #include "util/system_utils.h"
@@ -29,13 +31,15 @@ Optional<ConsumeCallback::Type> ConsumeCallback::ParseType(
 std::shared_ptr<KafkaConsumeCb> ConsumeCallback::Init(
     std::shared_ptr<TopicConf> conf,
     std::shared_ptr<PathFormat> format,
-    std::shared_ptr<FpCache> cache) {
+    std::shared_ptr<FpCache> cache,
+    std::shared_ptr<Manifest> manifest,
+    std::shared_ptr<DoneMarker> marker) {
   if (!conf || !format || !cache) {
     LOG(ERROR) << "ConsumeCallback Init invalid parameters";
     return nullptr;
   }
 
-  std::shared_ptr<KafkaConsumeCb> res;
+  std::shared_ptr<ConsumeCallback> res;
   ConsumeCallback::Type type = conf->consume_type();
   switch (type) {
     case kV6:
@@ -58,31 +62,91 @@ std::shared_ptr<KafkaConsumeCb> ConsumeCallback::Init(
       LOG(ERROR) << "ConsumeCallback Init unknown type";
       res.reset();
   }
+
+  if (res) {
+    res->SetManifest(std::move(manifest));
+    res->SetDoneMarker(std::move(marker));
+  }
   return res;
 }
 
 std::shared_ptr<FILE> ConsumeCallback::GetCacheFp(const KafkaMessage& msg) {
+  // staged in a sealed file before restart
+  if (manifest_ && manifest_->Skip(msg.Partition(), msg.Offset()))
+    return nullptr;
+
   std::string filename;
-  if (!format_->BuildLocalFileName(msg, &filename)) {
+  time_t ts = 0;
+  if (!format_->BuildLocalFileName(msg, &filename, &ts)) {
     char *payload = static_cast<char *>(msg.Payload());
     LOG(WARNING) << "ConsumeCallback GetCacheFp BuildLocalFileName topic["
                  << msg.TopicName() << "] msg[" << payload << "] failed";
     return nullptr;
   }
 
-  std::shared_ptr<FILE> fptr = cache_->Get(filename);
+  if (!manifest_) {
+    std::shared_ptr<FILE> fptr = cache_->Get(filename);
+    if (!fptr) {
+      std::string path = dir_ + "/" + filename + "." +
+          std::to_string(time(NULL));
+      fptr = cache_->Get(filename, path);
+      if (!fptr) {
+        LOG(ERROR) << "ConsumeCallback GetCacheFp Get fptr filename["
+                   << filename << "] path[" << path << "] failed";
+        return nullptr;
+      }
+    }
+
+    // file exists in consume dir before watermark passes it
+    if (marker_)
+      marker_->Advance(msg.Partition(), ts);
+    return fptr;
+  }
+
+  // recorded under cache lock, fp cache Remove() and the following Seal()
+  // can not run between Get() and Add()
+  auto record = [this, &msg](const std::string& path) {
+    manifest_->Add(path, msg.Partition(), msg.Offset());
+  };
+
+  std::shared_ptr<FILE> fptr = cache_->Get(filename, record);
   if (!fptr) {
-    std::string path = dir_ + "/" + filename + "." + std::to_string(time(NULL));
-    fptr = cache_->Get(filename, path);
+    // offset anchored, a rewound restart rebuilds the same name
+    std::string new_path = dir_ + "/" + filename + "." +
+        std::to_string(msg.Partition()) + "_" +
+        std::to_string(msg.Offset());
+    fptr = cache_->Get(filename, new_path, record);
     if (!fptr) {
       LOG(ERROR) << "ConsumeCallback GetCacheFp Get fptr filename["
-                 << filename << "] path[" << path << "] failed";
+                 << filename << "] path[" << new_path << "] failed";
       return nullptr;
     }
   }
+
+  if (marker_)
+    marker_->Advance(msg.Partition(), ts);
   return fptr;
 }
 
+void ConsumeCallback::OnRevoke(const std::string& topic,
+                               const std::vector<int32_t>& partitions) {
+  // files mix messages of all partitions, group consume thread is the
+  // only writer, fclose flushes them before offsets committed
+  std::vector<std::string> paths = cache_->CloseAll();
+  for (auto& path : paths) {
+    if (manifest_)
+      manifest_->Seal(path);
+    LOG(INFO) << "ConsumeCallback OnRevoke topic[" << topic
+              << "] sealed path[" << path << "]";
+  }
+}
+
+void ConsumeCallback::OnEof(const std::string& topic, int32_t partition,
+                            int64_t offset) {
+  if (marker_)
+    marker_->OnEof(partition);
+}
+
 // ------------------------------------------------------------------
 // V6ConsumeCallback
 
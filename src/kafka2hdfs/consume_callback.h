@@ -4,6 +4,7 @@
 #define LOG2HDFS_KAFKA2HDFS_CONSUME_CALLBACK_H_
 
 #include <string>
+#include <vector>
 #include <memory>
 #include "kafka/kafka_topic_consumer.h"
 #include "util/fp_cache.h"
@@ -11,6 +12,8 @@
 
 namespace log2hdfs {
 
+class DoneMarker;
+class Manifest;
 class PathFormat;
 class TopicConf;
 
@@ -37,11 +40,16 @@ class ConsumeCallback : public KafkaConsumeCb {
 
   /**
    * Static function create KafkaConsumeCb shared_ptr.
+   *
+   * With manifest, staged files are named by partition and offset of
+   * their first message, and messages staged before restart skipped.
    */
   static std::shared_ptr<KafkaConsumeCb> Init(
       std::shared_ptr<TopicConf> conf,
       std::shared_ptr<PathFormat> format,
-      std::shared_ptr<FpCache> cache);
+      std::shared_ptr<FpCache> cache,
+      std::shared_ptr<Manifest> manifest = nullptr,
+      std::shared_ptr<DoneMarker> marker = nullptr);
 
   ConsumeCallback(const std::string& dir,
                   std::shared_ptr<PathFormat> format,
@@ -54,10 +62,33 @@ class ConsumeCallback : public KafkaConsumeCb {
 
   virtual std::shared_ptr<FILE> GetCacheFp(const KafkaMessage& msg);
 
+  void SetManifest(std::shared_ptr<Manifest> manifest) {
+    manifest_ = std::move(manifest);
+  }
+
+  void SetDoneMarker(std::shared_ptr<DoneMarker> marker) {
+    marker_ = std::move(marker);
+  }
+
+  /**
+   * Seal all open files before partitions handed off, files are
+   * uploaded as usual once complete.
+   */
+  virtual void OnRevoke(const std::string& topic,
+                        const std::vector<int32_t>& partitions);
+
+  /**
+   * Partition caught up, advances done marker of idle partition.
+   */
+  virtual void OnEof(const std::string& topic, int32_t partition,
+                     int64_t offset);
+
  protected:
   std::string dir_;
   std::shared_ptr<PathFormat> format_;
   std::shared_ptr<FpCache> cache_;
+  std::shared_ptr<Manifest> manifest_;
+  std::shared_ptr<DoneMarker> marker_;
 };
 
 // ------------------------------------------------------------------
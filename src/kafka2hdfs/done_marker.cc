@@ -0,0 +1,293 @@
+// Copyright (c) 2017 Lanceolata
+
+#include "kafka2hdfs/done_marker.h"
+#include <stdlib.h>
+#include <fstream>
+#include <sstream>
+#include "kafka/kafka_consumer.h"
+#include "kafka2hdfs/hdfs_handle.h"
+#include "kafka2hdfs/topic_conf.h"
+#include "util/string_utils.h"
+#include "util/system_utils.h"
+#include "easylogging++.h"
+
+namespace log2hdfs {
+
+#define DONE_MARKER_NAME "__done__.k2h"
+// Topic metadata query timeout
+#define DONE_MARKER_METADATA_TIMEOUT_MS 10000
+
+// ------------------------------------------------------------------
+// DoneMarker
+
+Optional<DoneMarker::Type> DoneMarker::ParseType(const std::string& type) {
+  if (type == "none") {
+    return Optional<DoneMarker::Type>(kNone);
+  } else if (type == "hour") {
+    return Optional<DoneMarker::Type>(kHour);
+  } else if (type == "day") {
+    return Optional<DoneMarker::Type>(kDay);
+  } else {
+    return Optional<DoneMarker::Type>::Invalid();
+  }
+}
+
+std::shared_ptr<DoneMarker> DoneMarker::Init(
+    std::shared_ptr<TopicConf> conf, KafkaConsumer* consumer) {
+  if (!conf || conf->done_marker() == kNone || !consumer) {
+    LOG(ERROR) << "DoneMarker Init invalid parameters";
+    return nullptr;
+  }
+
+  if (conf->group_mode()) {
+    LOG(ERROR) << "DoneMarker Init topic[" << conf->topic() << "] "
+               << "consume.mode = group not supported";
+    return nullptr;
+  }
+
+  std::vector<int32_t> partitions = conf->partitions();
+  if (partitions.empty()) {
+    LOG(ERROR) << "DoneMarker Init topic[" << conf->topic() << "] "
+                << "empty partitions";
+    return nullptr;
+  }
+
+  // metadata unavailable at startup is not fatal, checked on next start
+  int count;
+  std::string errstr;
+  if (!consumer->PartitionCount(conf->topic(), &count,
+          DONE_MARKER_METADATA_TIMEOUT_MS, &errstr)) {
+    LOG(WARNING) << "DoneMarker Init topic[" << conf->topic() << "] "
+                 << "PartitionCount failed with errstr[" << errstr
+                 << "], partitions not checked";
+  } else {
+    std::set<int32_t> covered;
+    for (auto partition : partitions) {
+      if (partition >= 0 && partition < count)
+        covered.insert(partition);
+    }
+
+    if (covered.size() != static_cast<size_t>(count)) {
+      LOG(ERROR) << "DoneMarker Init topic[" << conf->topic() << "] "
+                 << "partitions[" << covered.size() << "/" << count
+                 << "] configured, done marker needs all partitions";
+      return nullptr;
+    }
+  }
+
+  Type type = conf->done_marker();
+  std::shared_ptr<DoneMarker> res = std::make_shared<DoneMarker>(
+      std::move(conf), type, partitions);
+  if (!res->Load()) {
+    LOG(ERROR) << "DoneMarker Init Load path[" << res->path_ << "] failed";
+    return nullptr;
+  }
+  return res;
+}
+
+DoneMarker::DoneMarker(std::shared_ptr<TopicConf> conf,
+                       Type type,
+                       const std::vector<int32_t>& partitions):
+    conf_(std::move(conf)), type_(type), size_(0) {
+  topic_ = conf_->topic();
+  path_ = conf_->done_path();
+  for (auto partition : partitions) {
+    if (index_.find(partition) == index_.end())
+      index_[partition] = size_++;
+  }
+
+  // partitions block until messages or eof consumed
+  watermarks_.reset(new std::atomic<int64_t>[size_]);
+  eof_.reset(new std::atomic<bool>[size_]);
+  for (size_t i = 0; i < size_; ++i) {
+    watermarks_[i].store(0);
+    eof_[i].store(false);
+  }
+}
+
+void DoneMarker::Advance(int32_t partition, time_t ts) {
+  auto it = index_.find(partition);
+  if (it == index_.end())
+    return;
+
+  std::atomic<int64_t>& watermark = watermarks_[it->second];
+  int64_t cur = watermark.load(std::memory_order_relaxed);
+  while (ts > cur && !watermark.compare_exchange_weak(cur, ts,
+             std::memory_order_release, std::memory_order_relaxed)) {}
+
+  std::atomic<bool>& eof = eof_[it->second];
+  if (eof.load(std::memory_order_relaxed))
+    eof.store(false, std::memory_order_release);
+}
+
+void DoneMarker::OnEof(int32_t partition) {
+  auto it = index_.find(partition);
+  if (it == index_.end())
+    return;
+
+  eof_[it->second].store(true, std::memory_order_release);
+}
+
+time_t DoneMarker::Watermark() const {
+  time_t now = time(NULL);
+  time_t idle = now - conf_->complete_interval();
+  time_t res = now;
+  for (size_t i = 0; i < size_; ++i) {
+    time_t watermark = watermarks_[i].load(std::memory_order_acquire);
+    if (eof_[i].load(std::memory_order_acquire) && watermark < idle)
+      watermark = idle;
+
+    if (watermark < res)
+      res = watermark;
+  }
+  return res;
+}
+
+void DoneMarker::Uploaded(const std::string& name,
+                          const std::string& hdfs_path) {
+  time_t start;
+  if (!Bucket(name, &start))
+    return;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (dirs_[start].insert(DirName(hdfs_path)).second && !Save()) {
+    LOG(WARNING) << "DoneMarker Uploaded Save path[" << path_
+                 << "] failed with errno[" << errno << "]";
+  }
+}
+
+void DoneMarker::Mark(time_t watermark,
+                      const std::vector<std::string>& pending,
+                      const HdfsHandle& handle) {
+  std::set<time_t> busy;
+  time_t start;
+  for (auto& name : pending) {
+    if (Bucket(name, &start))
+      busy.insert(start);
+  }
+
+  std::map<time_t, std::set<std::string>> done;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    int delay = conf_->done_delay();
+    for (auto& bucket : dirs_) {
+      // later buckets end later
+      if (BucketEnd(bucket.first) + delay > watermark)
+        break;
+      if (busy.find(bucket.first) == busy.end())
+        done.insert(bucket);
+    }
+  }
+  if (done.empty())
+    return;
+
+  // hdfs calls without lock, dirs marked removed afterwards
+  for (auto& bucket : done) {
+    for (auto it = bucket.second.begin(); it != bucket.second.end();) {
+      std::string path = *it + "/" + DONE_MARKER_NAME;
+      if (handle.Touch(path)) {
+        LOG(INFO) << "DoneMarker Mark topic[" << topic_ << "] bucket["
+                  << bucket.first << "] path[" << path << "] success";
+        ++it;
+      } else {
+        LOG(WARNING) << "DoneMarker Mark topic[" << topic_ << "] path["
+                     << path << "] failed retry";
+        it = bucket.second.erase(it);
+      }
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto& bucket : done) {
+    auto it = dirs_.find(bucket.first);
+    if (it == dirs_.end())
+      continue;
+    for (auto& dir : bucket.second)
+      it->second.erase(dir);
+    if (it->second.empty())
+      dirs_.erase(it);
+  }
+
+  if (!Save()) {
+    LOG(WARNING) << "DoneMarker Mark Save path[" << path_ << "] failed "
+                 << "with errno[" << errno << "]";
+  }
+}
+
+bool DoneMarker::Bucket(const std::string& name, time_t* start) const {
+  // <topic>.<key>.<%Y%m%d%H%M%S>.<suffix>
+  std::string prefix = topic_ + ".";
+  if (!StartsWith(name, prefix))
+    return false;
+
+  std::vector<std::string> vec = SplitString(name.substr(prefix.size()),
+      ".", kTrimWhitespace, kSplitAll);
+  if (vec.size() < 2)
+    return false;
+
+  struct tm timeinfo;
+  if (strptime(vec[1].c_str(), "%Y%m%d%H%M%S", &timeinfo) == NULL)
+    return false;
+
+  timeinfo.tm_sec = 0;
+  timeinfo.tm_min = 0;
+  if (type_ == kDay)
+    timeinfo.tm_hour = 0;
+  timeinfo.tm_isdst = -1;
+  *start = mktime(&timeinfo);
+  return *start != -1;
+}
+
+time_t DoneMarker::BucketEnd(time_t start) const {
+  struct tm timeinfo;
+  localtime_r(&start, &timeinfo);
+  if (type_ == kDay) {
+    ++timeinfo.tm_mday;
+  } else {
+    ++timeinfo.tm_hour;
+  }
+  timeinfo.tm_isdst = -1;
+  return mktime(&timeinfo);
+}
+
+bool DoneMarker::Load() {
+  if (!IsFile(path_))
+    return true;
+
+  std::ifstream ifs(path_);
+  if (!ifs)
+    return false;
+
+  // lines of "bucket\tdir"
+  std::string line;
+  while (std::getline(ifs, line)) {
+    auto pos = line.find('\t');
+    if (pos == std::string::npos || pos + 1 == line.size())
+      continue;
+    dirs_[atol(line.substr(0, pos).c_str())].insert(line.substr(pos + 1));
+  }
+
+  LOG(INFO) << "DoneMarker Load path[" << path_ << "] buckets["
+            << dirs_.size() << "]";
+  return true;
+}
+
+bool DoneMarker::Save() {
+  std::string tmp_path = path_ + ".tmp";
+  {
+    std::ofstream ofs(tmp_path, std::ofstream::trunc);
+    if (!ofs)
+      return false;
+
+    for (auto& bucket : dirs_) {
+      for (auto& dir : bucket.second)
+        ofs << bucket.first << "\t" << dir << "\n";
+    }
+    ofs.close();
+    if (!ofs)
+      return false;
+  }
+  return Rename(tmp_path, path_);
+}
+
+}   // namespace log2hdfs
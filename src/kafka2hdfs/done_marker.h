@@ -0,0 +1,143 @@
+// Copyright (c) 2017 Lanceolata
+
+#ifndef LOG2HDFS_KAFKA2HDFS_DONE_MARKER_H_
+#define LOG2HDFS_KAFKA2HDFS_DONE_MARKER_H_
+
+#include <stdint.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+#include "util/optional.h"
+
+namespace log2hdfs {
+
+class HdfsHandle;
+class KafkaConsumer;
+class TopicConf;
+
+/**
+ * Done markers of hour or day buckets
+ *
+ * Consume threads advance the event time watermark of every partition,
+ * a partition caught up to the end of log follows wall clock minus
+ * complete.interval until its next message. Lagging or silent
+ * partitions keep blocking. Upload thread records hdfs dirs of files
+ * uploaded per bucket.
+ * Once the lowest watermark passes the end of a bucket by done.delay and
+ * no staged file of the bucket is left, `__done__.k2h` is written to
+ * every dir of the bucket.
+ *
+ * Dirs of buckets not yet marked are saved to `<topic dir>/done`.
+ */
+class DoneMarker {
+ public:
+  /**
+   * Bucket of done marker
+   */
+  enum Type {
+    kNone,
+    kHour,
+    kDay
+  };
+
+  /**
+   * Convert type string to DoneMarker type
+   */
+  static Optional<DoneMarker::Type> ParseType(const std::string& type);
+
+  /**
+   * Static function to create a DoneMarker shared_ptr.
+   *
+   * Only consume.mode = simple supported, partitions of other group
+   * members are unknown. Configured partitions must cover all
+   * partitions of topic, a marker of part of them is not a done marker.
+   *
+   * @param conf                topic conf
+   * @param consumer            consumer to query topic metadata
+   *
+   * @returns std::shared_ptr<DoneMarker> if success; nullptr otherwise.
+   */
+  static std::shared_ptr<DoneMarker> Init(std::shared_ptr<TopicConf> conf,
+                                          KafkaConsumer* consumer);
+
+  /**
+   * Constructor
+   */
+  DoneMarker(std::shared_ptr<TopicConf> conf,
+             Type type,
+             const std::vector<int32_t>& partitions);
+
+  DoneMarker(const DoneMarker& other) = delete;
+  DoneMarker& operator=(const DoneMarker& other) = delete;
+
+  /**
+   * Advance watermark of partition, called after message staged.
+   *
+   * Lock free.
+   */
+  void Advance(int32_t partition, time_t ts);
+
+  /**
+   * Partition caught up to the end of log, called on partition eof.
+   *
+   * Lock free.
+   */
+  void OnEof(int32_t partition);
+
+  /**
+   * @returns Lowest watermark of all partitions.
+   */
+  time_t Watermark() const;
+
+  /**
+   * Record dir of file uploaded.
+   *
+   * @param name                name of local file
+   * @param hdfs_path           hdfs path uploaded to
+   */
+  void Uploaded(const std::string& name, const std::string& hdfs_path);
+
+  /**
+   * Write markers of buckets done.
+   *
+   * @param watermark           watermark taken before pending listed
+   * @param pending             names of staged files not yet uploaded
+   * @param handle              hdfs handle
+   */
+  void Mark(time_t watermark, const std::vector<std::string>& pending,
+            const HdfsHandle& handle);
+
+ private:
+  // start of bucket of local file name
+  bool Bucket(const std::string& name, time_t* start) const;
+
+  time_t BucketEnd(time_t start) const;
+
+  bool Load();
+
+  bool Save();
+
+  std::shared_ptr<TopicConf> conf_;
+  Type type_;
+  std::string topic_;
+  std::string path_;
+  // partition <--> index, read only after constructed
+  std::unordered_map<int32_t, size_t> index_;
+  size_t size_;
+  std::unique_ptr<std::atomic<int64_t>[]> watermarks_;
+  // caught up to the end of log, no message since
+  std::unique_ptr<std::atomic<bool>[]> eof_;
+  std::mutex mutex_;
+  // bucket start <--> hdfs dirs
+  std::map<time_t, std::set<std::string>> dirs_;
+};
+
+}   // namespace log2hdfs
+
+#endif  // LOG2HDFS_KAFKA2HDFS_DONE_MARKER_H_
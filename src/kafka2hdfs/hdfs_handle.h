@@ -72,6 +72,26 @@ class HdfsHandle {
    */
   virtual bool Delete(const std::string& hdfs_path) const = 0;
 
+  /**
+   * Rename hdfs file
+   * 
+   * @param src_path            hdfs path
+   * @param dst_path            hdfs path, must not exist
+   * 
+   * @returns True if rename hdfs file success, false otherwise.
+   */
+  virtual bool Rename(const std::string& src_path,
+                      const std::string& dst_path) const = 0;
+
+  /**
+   * Create empty hdfs file, truncated if exists
+   * 
+   * @param hdfs_path           hdfs path
+   * 
+   * @returns True if create file success, false otherwise.
+   */
+  virtual bool Touch(const std::string& hdfs_path) const = 0;
+
   /**
    * Create hdfs directory
    * 
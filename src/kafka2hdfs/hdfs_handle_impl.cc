@@ -1,6 +1,7 @@
 // Copyright (c) 2017 Lanceolata
 
 #include "kafka2hdfs/hdfs_handle_impl.h"
+#include <fcntl.h>
 #include "util/configparser.h"
 #include "util/system_utils.h"
 #include "easylogging++.h"
@@ -126,6 +127,26 @@ bool CommandHdfsHandle::Delete(const std::string& hdfs_path) const {
   return hdfsDelete(fs_handle_, hdfs_path.c_str(), 0) == 0;
 }
 
+bool CommandHdfsHandle::Rename(const std::string& src_path,
+                               const std::string& dst_path) const {
+  if (src_path.empty() || dst_path.empty())
+    return false;
+
+  return hdfsRename(fs_handle_, src_path.c_str(), dst_path.c_str()) == 0;
+}
+
+bool CommandHdfsHandle::Touch(const std::string& hdfs_path) const {
+  if (hdfs_path.empty())
+    return false;
+
+  hdfsFile file = hdfsOpenFile(fs_handle_, hdfs_path.c_str(),
+                               O_WRONLY | O_CREAT, 0, 0, 0);
+  if (!file)
+    return false;
+
+  return hdfsCloseFile(fs_handle_, file) == 0;
+}
+
 bool CommandHdfsHandle::CreateDirectory(const std::string& hdfs_path) const {
   if (hdfs_path.empty())
     return false;
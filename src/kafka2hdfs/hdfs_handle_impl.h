@@ -37,6 +37,11 @@ class CommandHdfsHandle : public HdfsHandle {
 
   bool Delete(const std::string& local_path) const;
 
+  bool Rename(const std::string& src_path,
+              const std::string& dst_path) const;
+
+  bool Touch(const std::string& hdfs_path) const;
+
   bool CreateDirectory(const std::string& hdfs_path) const;
 
   bool LZOIndex(const std::string& hdfs_path) const;
@@ -3,9 +3,15 @@
 #include <unistd.h>
 #include <signal.h>
 #include "kafka/kafka_consumer.h"
+#include "kafka/kafka_group_consumer.h"
+#include "kafka2hdfs/backfill.h"
+#include "kafka2hdfs/done_marker.h"
 #include "kafka2hdfs/hdfs_handle.h"
+#include "kafka2hdfs/manifest.h"
 #include "kafka2hdfs/topic_conf.h"
 #include "util/configparser.h"
+#include "util/string_utils.h"
+#include "util/system_utils.h"
 #include "easylogging++.h"
 
 // Init logging
@@ -13,13 +19,28 @@ INITIALIZE_EASYLOGGINGPP
 
 using namespace log2hdfs;
 
+/*
+ * Default configuration
+ */
+#define DEFAULT_CONSUME_WORKERS "4"
+#define DEFAULT_CONSUME_BATCH_MIN "100"
+#define DEFAULT_CONSUME_BATCH_MAX "10000"
+#define DEFAULT_CONSUME_TIMEOUT_MIN "10"
+#define DEFAULT_CONSUME_TIMEOUT_MAX "1000"
+#define BACKFILL_PROGRESS_INTERVAL 10
+
 // Stop flag
 static bool stop = false;
+// Backfill run flag
+static bool backfill = false;
 // conf file path
 static char *conf_path = NULL;
 
 static std::shared_ptr<KafkaConsumer> consumer;
 static std::shared_ptr<HdfsHandle> handle;
+// sink <--> hdfs handle of section[hdfs.<sink>]
+static std::unordered_map<std::string,
+    std::shared_ptr<HdfsHandle>> sink_handles;
 static std::unordered_map<std::string,
     std::shared_ptr<TopicConf>> topic_confs;
 static std::unordered_map<std::string,
@@ -39,6 +60,87 @@ void err_cb(rd_kafka_t* rk, int err, const char* reason, void* opaque) {
                << " reason:" << reason;
 }
 
+// parse consume batch limits in section[global]
+bool ParseBatchLimits(std::shared_ptr<Section> section,
+                      KafkaBatchLimits* limits) {
+  if (!section)
+    return true;
+
+  limits->min_size = atol(section->Get("consume.batch.min",
+                              DEFAULT_CONSUME_BATCH_MIN).c_str());
+  limits->max_size = atol(section->Get("consume.batch.max",
+                              DEFAULT_CONSUME_BATCH_MAX).c_str());
+  limits->min_timeout_ms = atoi(section->Get("consume.timeout.min",
+                                    DEFAULT_CONSUME_TIMEOUT_MIN).c_str());
+  limits->max_timeout_ms = atoi(section->Get("consume.timeout.max",
+                                    DEFAULT_CONSUME_TIMEOUT_MAX).c_str());
+  return limits->Valid();
+}
+
+// create simple or group topic consumer
+bool CreateTopicConsumer(const std::string& topic,
+                         std::shared_ptr<TopicConf> topic_conf,
+                         std::shared_ptr<KafkaConsumeCb> cb,
+                         std::string* errstr) {
+  if (topic_conf->group_mode()) {
+    return consumer->CreateGroupConsumer(
+               topic,
+               topic_conf->consume_group(),
+               topic_conf->kafka_topic_conf().get(),
+               std::move(cb), errstr) != nullptr;
+  }
+  return consumer->CreateTopicConsumer(
+             topic,
+             topic_conf->kafka_topic_conf().get(),
+             topic_conf->partitions(),
+             topic_conf->offsets(),
+             std::move(cb), errstr) != nullptr;
+}
+
+// create uploads of sinks, hdfs handle from section[hdfs.<sink>] or
+// section[hdfs]
+bool AddSinks(std::shared_ptr<IniConfigParser> conf,
+              std::shared_ptr<TopicConf> topic_conf,
+              Upload* upload) {
+  for (auto& sink_conf : topic_conf->sinks()) {
+    const std::string& sink = sink_conf->sink();
+    std::shared_ptr<HdfsHandle> sink_handle = handle;
+    std::string section = "hdfs." + sink;
+    if (conf->HasSection(section)) {
+      auto it = sink_handles.find(sink);
+      if (it == sink_handles.end()) {
+        sink_handle = HdfsHandle::Init(conf->GetSection(section));
+        if (!sink_handle) {
+          LOG(ERROR) << "AddSinks HdfsHandle Init section[" << section
+                     << "] failed";
+          return false;
+        }
+        sink_handles[sink] = sink_handle;
+      } else {
+        sink_handle = it->second;
+      }
+    }
+
+    std::shared_ptr<FpCache> cache = FpCache::Init();
+    std::shared_ptr<PathFormat> format = PathFormat::Init(sink_conf);
+    if (!cache || !format) {
+      LOG(ERROR) << "AddSinks topic[" << topic_conf->topic() << "] sink["
+                 << sink << "] FpCache or PathFormat Init failed";
+      return false;
+    }
+
+    std::unique_ptr<Upload> sink_upload = Upload::Init(sink_conf,
+        format, cache, sink_handle);
+    if (!sink_upload) {
+      LOG(ERROR) << "AddSinks topic[" << topic_conf->topic() << "] sink["
+                 << sink << "] Upload Init failed";
+      return false;
+    }
+    upload->AddSink(std::move(sink_upload));
+  }
+  return true;
+}
+
 // signals handler
 void signals_handler(int sig) {
   if (sig != SIGUSR1) {
@@ -53,11 +155,17 @@ void signals_handler(int sig) {
     return;
   }
 
+  KafkaBatchLimits limits;
+  if (!ParseBatchLimits(conf->GetSection("global"), &limits) ||
+          !consumer->SetBatchLimits(limits)) {
+    LOG(WARNING) << "signals_handler invalid consume batch limits";
+  }
+
   std::string errstr;
   for (auto it = conf->Begin(); it != conf->End(); ++it) {
     const std::string topic = it->first;
     if (topic == "global" || topic == "kafka" || topic == "default"
-            || topic == "hdfs")
+            || topic == "hdfs" || StartsWith(topic, "hdfs."))
       continue;
 
     // handle running topic
@@ -96,26 +204,47 @@ void signals_handler(int sig) {
       continue;
     }
 
+    std::shared_ptr<Manifest> manifest;
+    if (topic_conf->manifest()) {
+      manifest = Manifest::Init(topic_conf->manifest_dir());
+      if (!manifest) {
+        LOG(ERROR) << "signals_handler Manifest Init topic[" << topic
+                   << "] failed";
+        continue;
+      }
+    }
+
+    std::shared_ptr<DoneMarker> marker;
+    if (topic_conf->done_marker() != DoneMarker::kNone) {
+      marker = DoneMarker::Init(topic_conf, consumer.get());
+      if (!marker) {
+        LOG(ERROR) << "signals_handler DoneMarker Init topic[" << topic
+                   << "] failed";
+        continue;
+      }
+    }
+
     std::shared_ptr<KafkaConsumeCb> cb = ConsumeCallback::Init(
-        topic_conf, format, cache);
+        topic_conf, format, cache, manifest, marker);
     if (!cb) {
       LOG(ERROR) << "signals_handler ConsumeCallback Init failed";
       continue;
     }
 
     std::unique_ptr<Upload> upload = Upload::Init(topic_conf,
-        format, cache, handle);
+        format, cache, handle, manifest, marker);
     if (!upload) {
       LOG(ERROR) << "signals_handler Upload Init failed";
       continue;
     }
 
-    if (!consumer->CreateTopicConsumer(
-                topic,
-                topic_conf->kafka_topic_conf().get(),
-                topic_conf->partitions(),
-                topic_conf->offsets(),
-                cb, &errstr)) {
+    if (!AddSinks(conf, topic_conf, upload.get())) {
+      LOG(ERROR) << "signals_handler AddSinks topic[" << topic
+                 << "] failed";
+      continue;
+    }
+
+    if (!CreateTopicConsumer(topic, topic_conf, cb, &errstr)) {
       LOG(ERROR) << "signals_handler CreateTopicConsumer topic[" << topic
                  << "] failed with errstr[" << errstr << "]";
       continue;
@@ -137,6 +266,7 @@ void signals_handler(int sig) {
       consumer->StopTopic(topic);
       topic_confs.erase(it++);
       topic_uploads[topic]->Join();
+      topic_uploads[topic]->Close();
       topic_uploads.erase(topic);
     }
   }
@@ -149,11 +279,135 @@ void set_signal_handlers() {
   signal(SIGUSR1, signals_handler);
 }
 
+// consume bounded ranges into staging root, upload and exit
+int RunBackfill(std::shared_ptr<IniConfigParser> conf,
+                KafkaGlobalConf* consumer_conf) {
+  std::shared_ptr<Section> global_section = conf->GetSection("global");
+  std::string root_dir;
+  if (global_section)
+    root_dir = NormalDirPath(global_section->Get("backfill.root.dir", ""));
+  if (root_dir.empty()) {
+    LOG(ERROR) << "Backfill invalid backfill.root.dir";
+    return EXIT_FAILURE;
+  }
+
+  // offsets of backfill are never stored nor committed, end of log
+  // reported for ranges ending with no message to consume
+  std::string errstr;
+  if (consumer_conf->Set("enable.auto.commit", "false", &errstr)
+          != KafkaConfResult::kConfOk ||
+      consumer_conf->Set("enable.auto.offset.store", "false", &errstr)
+          != KafkaConfResult::kConfOk ||
+      consumer_conf->Set("enable.partition.eof", "true", &errstr)
+          != KafkaConfResult::kConfOk) {
+    LOG(ERROR) << "Backfill set kafka conf failed with error["
+               << errstr << "]";
+    return EXIT_FAILURE;
+  }
+
+  std::vector<std::shared_ptr<TopicConf>> confs;
+  size_t partitions = 0;
+  for (auto it = conf->Begin(); it != conf->End(); ++it) {
+    const std::string topic = it->first;
+    if (topic == "global" || topic == "kafka" || topic == "default"
+            || topic == "hdfs" || StartsWith(topic, "hdfs."))
+      continue;
+
+    std::shared_ptr<TopicConf> topic_conf = TopicConf::Init(topic);
+    if (!topic_conf || !topic_conf->InitBackfillConf(it->second,
+                                                     root_dir)) {
+      LOG(ERROR) << "Backfill TopicConf InitBackfillConf topic[" << topic
+                 << "] failed";
+      return EXIT_FAILURE;
+    }
+    partitions += topic_conf->partitions().size();
+    confs.push_back(std::move(topic_conf));
+  }
+
+  if (confs.empty()) {
+    LOG(ERROR) << "Backfill no topic configured";
+    return EXIT_FAILURE;
+  }
+
+  // all partitions consumed in parallel
+  size_t workers = std::min(partitions, static_cast<size_t>(256));
+  consumer = KafkaConsumer::Init(consumer_conf, workers, &errstr);
+  if (!consumer) {
+    LOG(ERROR) << "Backfill KafkaConsumer Init failed with error["
+               << errstr << "]";
+    return EXIT_FAILURE;
+  }
+
+  // range consumed from behind, always use the largest batches
+  KafkaBatchLimits limits;
+  if (!ParseBatchLimits(global_section, &limits)) {
+    LOG(ERROR) << "Backfill invalid consume batch limits";
+    return EXIT_FAILURE;
+  }
+  limits.min_size = limits.max_size;
+  consumer->SetBatchLimits(limits);
+
+  std::vector<std::unique_ptr<Backfill>> backfills;
+  for (auto& topic_conf : confs) {
+    std::unique_ptr<Backfill> bf = Backfill::Init(topic_conf, consumer,
+                                                  handle);
+    if (!bf || !bf->Start()) {
+      LOG(ERROR) << "Backfill Start topic[" << topic_conf->topic()
+                 << "] failed";
+      return EXIT_FAILURE;
+    }
+    backfills.push_back(std::move(bf));
+  }
+
+  signal(SIGTERM, signals_handler);
+  signal(SIGINT, signals_handler);
+
+  time_t start = time(NULL);
+  time_t last = start;
+  while (!stop) {
+    bool done = true;
+    for (auto& bf : backfills) {
+      done = done && bf->Done();
+    }
+    if (done)
+      break;
+
+    sleep(1);
+    time_t now = time(NULL);
+    if (now - last >= BACKFILL_PROGRESS_INTERVAL) {
+      for (size_t i = 0; i < backfills.size(); ++i) {
+        uint64_t consumed = backfills[i]->Consumed();
+        LOG(INFO) << "Backfill topic[" << confs[i]->topic()
+                  << "] consumed[" << consumed << "] rate["
+                  << consumed / (now - start) << "/s]";
+      }
+      last = now;
+    }
+  }
+
+  if (stop) {
+    LOG(WARNING) << "Backfill interrupted, staging files left in["
+                 << root_dir << "]";
+    return EXIT_FAILURE;
+  }
+
+  bool res = true;
+  for (size_t i = 0; i < backfills.size(); ++i) {
+    if (!backfills[i]->Finish()) {
+      LOG(ERROR) << "Backfill Finish topic[" << confs[i]->topic()
+                 << "] upload failed";
+      res = false;
+    }
+  }
+  LOG(INFO) << "Backfill finished in[" << time(NULL) - start << "s]";
+  return res ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
 int main(int argc, char *argv[]) {
   int opt;
   char *log_conf_path = NULL;
 
-  while ((opt = getopt(argc, argv, "c:l:")) != -1) {
+  while ((opt = getopt(argc, argv, "c:l:b")) != -1) {
     switch (opt) {
       case 'c':
         conf_path = optarg;
@@ -164,20 +418,24 @@ int main(int argc, char *argv[]) {
         std::cerr << "Log config path for kafka2hdfs: " << log_conf_path
                   << std::endl;
         break;
+      case 'b':
+        backfill = true;
+        std::cerr << "Backfill run for kafka2hdfs" << std::endl;
+        break;
       default:
-        std::cerr << "Usage: ./kafka2hdfs -c conf_path -l log_conf_path"
+        std::cerr << "Usage: ./kafka2hdfs -c conf_path -l log_conf_path [-b]"
                   << std::endl;
     }
   }
 
   if (log_conf_path == NULL) {
-    std::cerr << "Usage: ./kafka2hdfs -c conf_path -l log_conf_path"
+    std::cerr << "Usage: ./kafka2hdfs -c conf_path -l log_conf_path [-b]"
               << std::endl;
     exit(EXIT_FAILURE);
   }
 
   if (conf_path == NULL) {
-    std::cerr << "Usage: ./kafka2hdfs -c conf_path -l log_conf_path"
+    std::cerr << "Usage: ./kafka2hdfs -c conf_path -l log_conf_path [-b]"
               << std::endl;
     exit(EXIT_FAILURE);
   }
@@ -235,10 +493,11 @@ int main(int argc, char *argv[]) {
   }
   consumer_conf->SetErrorCb(err_cb);
 
-  // Init kafka consumer
-  consumer = KafkaConsumer::Init(consumer_conf.get(), &errstr);
-  if (!consumer) {
-    LOG(ERROR) << "KafkaConsumer Init failed with error[" << errstr << "]";
+  // partitions caught up advance done markers
+  if (consumer_conf->Set("enable.partition.eof", "true", &errstr)
+          != KafkaConfResult::kConfOk) {
+    LOG(ERROR) << "Set configuration name[enable.partition.eof] failed "
+               << "with error[" << errstr << "]";
     exit(EXIT_FAILURE);
   }
 
@@ -253,11 +512,43 @@ int main(int argc, char *argv[]) {
     }
   }
 
+  if (backfill) {
+    int res = RunBackfill(conf, consumer_conf.get());
+    el::Helpers::uninstallPreRollOutCallback();
+    return res;
+  }
+
+  // Init kafka consumer, partitions of all topics share consume workers
+  std::string workers_str = DEFAULT_CONSUME_WORKERS;
+  std::shared_ptr<Section> global_section = conf->GetSection("global");
+  if (global_section) {
+    workers_str = global_section->Get("consume.workers",
+                                      DEFAULT_CONSUME_WORKERS);
+  }
+  int workers = atoi(workers_str.c_str());
+  if (workers <= 0 || workers > 256) {
+    LOG(ERROR) << "Invalid consume.workers[" << workers_str << "]";
+    exit(EXIT_FAILURE);
+  }
+
+  consumer = KafkaConsumer::Init(consumer_conf.get(), workers, &errstr);
+  if (!consumer) {
+    LOG(ERROR) << "KafkaConsumer Init failed with error[" << errstr << "]";
+    exit(EXIT_FAILURE);
+  }
+
+  KafkaBatchLimits limits;
+  if (!ParseBatchLimits(global_section, &limits) ||
+          !consumer->SetBatchLimits(limits)) {
+    LOG(ERROR) << "Invalid consume batch limits";
+    exit(EXIT_FAILURE);
+  }
+
   // Init kafka2hdfs topic confs
   for (auto it = conf->Begin(); it != conf->End(); ++it) {
     const std::string topic = it->first;
     if (topic == "global" || topic == "kafka" || topic == "default"
-            || topic == "hdfs")
+            || topic == "hdfs" || StartsWith(topic, "hdfs."))
       continue;
 
     std::shared_ptr<TopicConf> topic_conf = TopicConf::Init(topic);
@@ -283,26 +574,44 @@ int main(int argc, char *argv[]) {
       exit(EXIT_FAILURE);
     }
 
+    std::shared_ptr<Manifest> manifest;
+    if (topic_conf->manifest()) {
+      manifest = Manifest::Init(topic_conf->manifest_dir());
+      if (!manifest) {
+        LOG(ERROR) << "Manifest Init topic[" << topic << "] failed";
+        exit(EXIT_FAILURE);
+      }
+    }
+
+    std::shared_ptr<DoneMarker> marker;
+    if (topic_conf->done_marker() != DoneMarker::kNone) {
+      marker = DoneMarker::Init(topic_conf, consumer.get());
+      if (!marker) {
+        LOG(ERROR) << "DoneMarker Init topic[" << topic << "] failed";
+        exit(EXIT_FAILURE);
+      }
+    }
+
     std::shared_ptr<KafkaConsumeCb> cb = ConsumeCallback::Init(
-        topic_conf, format, cache);
+        topic_conf, format, cache, manifest, marker);
     if (!cb) {
       LOG(ERROR) << "ConsumeCallback Init failed";
       exit(EXIT_FAILURE);
     }
 
     std::unique_ptr<Upload> upload = Upload::Init(topic_conf,
-        format, cache, handle);
+        format, cache, handle, manifest, marker);
     if (!upload) {
       LOG(ERROR) << "Upload Init failed";
       exit(EXIT_FAILURE);
     }
 
-    if (!consumer->CreateTopicConsumer(
-                topic,
-                topic_conf->kafka_topic_conf().get(),
-                topic_conf->partitions(),
-                topic_conf->offsets(),
-                cb, &errstr)) {
+    if (!AddSinks(conf, topic_conf, upload.get())) {
+      LOG(ERROR) << "AddSinks topic[" << topic << "] failed";
+      exit(EXIT_FAILURE);
+    }
+
+    if (!CreateTopicConsumer(topic, topic_conf, cb, &errstr)) {
       LOG(ERROR) << "CreateTopicConsumer topic[" << topic
                  << "] failed with errstr[" << errstr << "]";
       exit(EXIT_FAILURE);
@@ -329,6 +638,7 @@ int main(int argc, char *argv[]) {
   }
   for (auto it = topic_uploads.begin(); it != topic_uploads.end(); ++it) {
     it->second->Join();
+    it->second->Close();
   }
   el::Helpers::uninstallPreRollOutCallback();
   return 0;
@@ -57,6 +57,23 @@ class LogFormat {
   virtual bool ExtractKeyAndTs(const char* payload, size_t len,
                                std::string* key, time_t* ts) const = 0;
 
+  /**
+   * Extract key only, timestamp is carried by kafka message.
+   * 
+   * Formats without key override it to skip parsing payload.
+   * 
+   * @param payload             kafka message payload
+   * @param len                 payload len
+   * @param key                 key to set
+   * 
+   * @return extract success return true, otherwise false,
+   */
+  virtual bool ExtractKey(const char* payload, size_t len,
+                          std::string* key) const {
+    time_t ts;
+    return ExtractKeyAndTs(payload, len, key, &ts);
+  }
+
   /**
    * Parse key to map
    * 
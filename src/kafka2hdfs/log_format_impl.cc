@@ -146,6 +146,15 @@ bool V6LogFormat::ExtractKeyAndTs(const char* payload, size_t len,
   return true;
 }
 
+bool V6LogFormat::ExtractKey(const char* payload, size_t len,
+    std::string* key) const {
+  if (!key)
+    return false;
+
+  key->clear();
+  return true;
+}
+
 bool V6LogFormat::ParseKey(const std::string& key,
     std::map<char, std::string>* m) const {
   if (!m)
@@ -257,6 +266,15 @@ bool EfLogFormat::ExtractKeyAndTs(const char* payload, size_t len,
   return true;
 }
 
+bool EfLogFormat::ExtractKey(const char* payload, size_t len,
+    std::string* key) const {
+  if (!key)
+    return false;
+
+  key->clear();
+  return true;
+}
+
 bool EfLogFormat::ParseKey(const std::string& key,
     std::map<char, std::string>* m) const {
  if (!m)
@@ -345,6 +363,15 @@ bool ReportLogFormat::ExtractKeyAndTs(const char* payload, size_t len,
   return true;
 }
 
+bool ReportLogFormat::ExtractKey(const char* payload, size_t len,
+    std::string* key) const {
+  if (!key)
+    return false;
+
+  key->clear();
+  return true;
+}
+
 bool ReportLogFormat::ParseKey(const std::string& key,
     std::map<char, std::string>* m) const {
   if (!m)
@@ -681,6 +708,15 @@ bool PubLogFormat::ExtractKeyAndTs(const char* payload, size_t len,
   return true;
 }
 
+bool PubLogFormat::ExtractKey(const char* payload, size_t len,
+    std::string* key) const {
+  if (!key)
+    return false;
+
+  key->clear();
+  return true;
+}
+
 bool PubLogFormat::ParseKey(const std::string& key,
     std::map<char, std::string>* m) const {
   if (!m)
@@ -724,6 +760,15 @@ bool PreBidLogFormat::ExtractKeyAndTs(const char* payload, size_t len,
   return true;
 }
 
+bool PreBidLogFormat::ExtractKey(const char* payload, size_t len,
+    std::string* key) const {
+  if (!key)
+    return false;
+
+  key->clear();
+  return true;
+}
+
 bool PreBidLogFormat::ParseKey(const std::string& key,
     std::map<char, std::string>* m) const {
   if (!m)
@@ -21,6 +21,8 @@ class V6LogFormat : public LogFormat {
   bool ExtractKeyAndTs(const char* payload, size_t len,
                        std::string* key, time_t* ts) const;
 
+  bool ExtractKey(const char* payload, size_t len, std::string* key) const;
+
   bool ParseKey(const std::string& key,
                 std::map<char, std::string>* m) const;
 };
@@ -57,6 +59,8 @@ class EfLogFormat : public LogFormat {
   bool ExtractKeyAndTs(const char* payload, size_t len,
                        std::string* key, time_t* ts) const;
 
+  bool ExtractKey(const char* payload, size_t len, std::string* key) const;
+
   bool ParseKey(const std::string& key,
                 std::map<char, std::string>* m) const;
 };
@@ -93,6 +97,8 @@ class ReportLogFormat : public LogFormat {
   bool ExtractKeyAndTs(const char* payload, size_t len,
                        std::string* key, time_t* ts) const;
 
+  bool ExtractKey(const char* payload, size_t len, std::string* key) const;
+
   bool ParseKey(const std::string& key,
                 std::map<char, std::string>* m) const;
 };
@@ -183,6 +189,8 @@ class PubLogFormat : public LogFormat {
   bool ExtractKeyAndTs(const char* payload, size_t len,
                        std::string* key, time_t* ts) const;
 
+  bool ExtractKey(const char* payload, size_t len, std::string* key) const;
+
   bool ParseKey(const std::string& key,
                 std::map<char, std::string>* m) const;
 };
@@ -201,6 +209,8 @@ class PreBidLogFormat : public LogFormat {
   bool ExtractKeyAndTs(const char* payload, size_t len,
                        std::string* key, time_t* ts) const;
 
+  bool ExtractKey(const char* payload, size_t len, std::string* key) const;
+
   bool ParseKey(const std::string& key,
                 std::map<char, std::string>* m) const;
 };
@@ -0,0 +1,274 @@
+// Copyright (c) 2017 Lanceolata
+
+#include "kafka2hdfs/manifest.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <fstream>
+#include <sstream>
+#include "util/dir_scanner.h"
+#include "util/system_utils.h"
+#include "easylogging++.h"
+
+namespace log2hdfs {
+
+#define MANIFEST_COVERED "covered"
+#define MANIFEST_UPLOADED "uploaded"
+// uploaded manifests kept for 7 days
+#define MANIFEST_RETENTION 604800
+#define MANIFEST_PRUNE_INTERVAL 3600
+
+namespace {
+
+bool WriteFile(const std::string& path, const std::string& content,
+               int flags) {
+  int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC | flags, 0644);
+  if (fd == -1)
+    return false;
+
+  const char* p = content.data();
+  size_t left = content.size();
+  while (left > 0) {
+    ssize_t n = write(fd, p, left);
+    if (n == -1) {
+      if (errno == EINTR)
+        continue;
+      close(fd);
+      return false;
+    }
+    p += n;
+    left -= n;
+  }
+
+  if (fsync(fd) != 0) {
+    close(fd);
+    return false;
+  }
+  return close(fd) == 0;
+}
+
+// fsync a file or dir
+bool SyncPath(const std::string& path) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1)
+    return false;
+  int res = fsync(fd);
+  close(fd);
+  return res == 0;
+}
+
+}   // namespace
+
+std::shared_ptr<Manifest> Manifest::Init(const std::string& dir) {
+  if (dir.empty()) {
+    LOG(ERROR) << "Manifest Init invalid parameters";
+    return nullptr;
+  }
+
+  std::string uploaded = dir + "/" + MANIFEST_UPLOADED;
+  if (!MakeDir(dir) || !MakeDir(uploaded)) {
+    LOG(ERROR) << "Manifest Init MakeDir[" << uploaded << "] failed "
+               << "with errno[" << errno << "]";
+    return nullptr;
+  }
+
+  // lines of "partition\toffset"
+  std::unordered_map<int32_t, int64_t> covered;
+  std::string path = dir + "/" + MANIFEST_COVERED;
+  if (IsFile(path)) {
+    std::ifstream ifs(path);
+    if (!ifs) {
+      LOG(ERROR) << "Manifest Init ifstream path[" << path << "] failed";
+      return nullptr;
+    }
+
+    int32_t partition;
+    long long offset;
+    while (ifs >> partition >> offset) {
+      covered[partition] = offset;
+      LOG(INFO) << "Manifest Init dir[" << dir << "] partition["
+                << partition << "] covered offset[" << offset << "]";
+    }
+  }
+  return std::make_shared<Manifest>(dir, std::move(covered));
+}
+
+void Manifest::Add(const std::string& path, int32_t partition,
+                   int64_t offset) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<Range>& ranges = open_[path];
+  Range* range = NULL;
+  for (auto& r : ranges) {
+    if (r.partition == partition) {
+      range = &r;
+      break;
+    }
+  }
+
+  if (range) {
+    range->last = offset;
+    ++range->messages;
+  } else {
+    Range r = { partition, offset, offset, 1 };
+    ranges.push_back(r);
+  }
+
+  int64_t& written = written_[partition];
+  if (offset > written)
+    written = offset;
+}
+
+bool Manifest::Seal(const std::string& path) {
+  std::string manifest_path = dir_ + "/" + BaseName(path);
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = open_.find(path);
+  if (it == open_.end()) {
+    // sealed before, or staged before restart without manifest
+    return IsFile(manifest_path);
+  }
+
+  std::ostringstream os;
+  for (auto& range : it->second) {
+    os << range.partition << "\t" << range.first << "\t" << range.last
+       << "\t" << range.messages << "\n";
+  }
+  open_.erase(it);
+
+  // staged file durable before its messages are covered
+  if (!SyncPath(path) || !SyncPath(DirName(path))) {
+    LOG(WARNING) << "Manifest Seal fsync path[" << path << "] failed "
+                 << "with errno[" << errno << "]";
+  }
+
+  // append, file sealed at shutdown might be reopened after restart
+  bool res = WriteFile(manifest_path, os.str(), O_APPEND);
+  if (!res) {
+    LOG(WARNING) << "Manifest Seal write path[" << manifest_path
+                 << "] failed with errno[" << errno << "]";
+  }
+
+  // messages of a partition are covered up to the first one still in
+  // open files
+  bool changed = false;
+  for (auto& written : written_) {
+    int64_t offset = written.second;
+    for (auto& file : open_) {
+      for (auto& range : file.second) {
+        if (range.partition == written.first && range.first <= offset)
+          offset = range.first - 1;
+      }
+    }
+
+    auto cit = covered_.find(written.first);
+    if (cit == covered_.end() || cit->second < offset) {
+      covered_[written.first] = offset;
+      changed = true;
+    }
+  }
+
+  if (changed) {
+    if (!SaveCovered()) {
+      LOG(WARNING) << "Manifest Seal SaveCovered dir[" << dir_ << "] failed "
+                   << "with errno[" << errno << "]";
+    }
+  } else if (res && !SyncPath(dir_)) {
+    LOG(WARNING) << "Manifest Seal fsync dir[" << dir_ << "] failed "
+                 << "with errno[" << errno << "]";
+  }
+  return res;
+}
+
+bool Manifest::Uploaded(const std::string& name) const {
+  std::string sealed = SealedPath(name);
+  std::string content, uploaded;
+  if (sealed.empty() || !ReadFile(sealed, &content) || content.empty())
+    return false;
+
+  std::string path = dir_ + "/" + MANIFEST_UPLOADED + "/" + name;
+  return ReadFile(path, &uploaded) && uploaded == content;
+}
+
+void Manifest::MarkUploaded(const std::string& name) {
+  std::string sealed = SealedPath(name);
+  if (sealed.empty())
+    return;
+
+  std::string path = dir_ + "/" + MANIFEST_UPLOADED + "/" + name;
+  if (!Rename(sealed, path)) {
+    LOG(WARNING) << "Manifest MarkUploaded Rename from[" << sealed
+                 << "] to[" << path << "] failed with errno[" << errno
+                 << "]";
+  }
+}
+
+void Manifest::Prune() {
+  time_t now = time(NULL);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (now - pruned_ < MANIFEST_PRUNE_INTERVAL)
+      return;
+    pruned_ = now;
+  }
+
+  std::string dir = dir_ + "/" + MANIFEST_UPLOADED;
+  std::vector<DirEntry> entries;
+  if (!DirScanner::Scan(dir, DirScanner::kStat, &entries)) {
+    LOG(WARNING) << "Manifest Prune Scan[" << dir << "] failed with errno["
+                 << errno << "]";
+    return;
+  }
+
+  size_t removed = 0;
+  for (auto& entry : entries) {
+    if (!entry.IsFile() || !entry.has_stat ||
+            now - entry.st.st_mtime < MANIFEST_RETENTION)
+      continue;
+    if (RmFile(dir + "/" + entry.name))
+      ++removed;
+  }
+
+  if (removed > 0) {
+    LOG(INFO) << "Manifest Prune dir[" << dir << "] removed[" << removed
+              << "]";
+  }
+}
+
+std::string Manifest::SealedPath(const std::string& name) const {
+  std::string path = dir_ + "/" + name;
+  if (IsFile(path))
+    return path;
+
+  // compressed files carry one more suffix
+  auto end = name.rfind('.');
+  if (end == std::string::npos)
+    return "";
+
+  path = dir_ + "/" + name.substr(0, end);
+  return IsFile(path) ? path : "";
+}
+
+bool Manifest::ReadFile(const std::string& path, std::string* content) {
+  std::ifstream ifs(path);
+  if (!ifs)
+    return false;
+
+  std::ostringstream os;
+  os << ifs.rdbuf();
+  content->assign(os.str());
+  return true;
+}
+
+bool Manifest::SaveCovered() {
+  std::ostringstream os;
+  for (auto& covered : covered_)
+    os << covered.first << "\t" << covered.second << "\n";
+
+  std::string path = dir_ + "/" + MANIFEST_COVERED;
+  std::string tmp_path = path + ".tmp";
+  // dir synced after rename, also persists manifests written before
+  return WriteFile(tmp_path, os.str(), O_TRUNC) && Rename(tmp_path, path) &&
+         SyncPath(dir_);
+}
+
+}   // namespace log2hdfs
@@ -0,0 +1,133 @@
+// Copyright (c) 2017 Lanceolata
+
+#ifndef LOG2HDFS_KAFKA2HDFS_MANIFEST_H_
+#define LOG2HDFS_KAFKA2HDFS_MANIFEST_H_
+
+#include <stdint.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace log2hdfs {
+
+/**
+ * Offset manifests of staged files
+ *
+ * Every staged file records the (partition, first offset, last offset)
+ * ranges of messages written to it. When a file is sealed its ranges
+ * are written to a sidecar manifest `<dir>/<name>`, and the covered
+ * offset of every partition, the highest offset such that all messages
+ * up to it are in sealed files, is saved to `<dir>/covered`.
+ *
+ * After a restart messages at or before covered offsets are skipped.
+ * Manifests of uploaded files are moved to `<dir>/uploaded`, a file
+ * with the same ranges as an uploaded one is not uploaded again.
+ */
+class Manifest {
+ public:
+  /**
+   * Static function to create a Manifest shared_ptr.
+   *
+   * @param dir                 manifest dir, created if not exists
+   *
+   * @returns std::shared_ptr<Manifest> if success; nullptr otherwise.
+   */
+  static std::shared_ptr<Manifest> Init(const std::string& dir);
+
+  /**
+   * Constructor
+   *
+   * @param dir                 manifest dir
+   * @param covered             covered offsets loaded from dir
+   */
+  Manifest(const std::string& dir,
+           std::unordered_map<int32_t, int64_t> covered):
+      dir_(dir), skip_(covered), covered_(std::move(covered)),
+      pruned_(0) {}
+
+  Manifest(const Manifest& other) = delete;
+  Manifest& operator=(const Manifest& other) = delete;
+
+  /**
+   * Whether message was staged in a sealed file before restart.
+   *
+   * Lock free, covered offsets of this run are not consulted.
+   */
+  bool Skip(int32_t partition, int64_t offset) const {
+    auto it = skip_.find(partition);
+    return it != skip_.end() && offset <= it->second;
+  }
+
+  /**
+   * Record a message written to staged file.
+   *
+   * @param path                staged file path
+   * @param partition           message partition
+   * @param offset              message offset
+   */
+  void Add(const std::string& path, int32_t partition, int64_t offset);
+
+  /**
+   * Write manifest of a closed staged file and advance covered offsets.
+   * Staged file, manifest and covered offsets are fsynced.
+   *
+   * @param path                staged file path
+   *
+   * @returns True if manifest written or already exists; false otherwise.
+   */
+  bool Seal(const std::string& path);
+
+  /**
+   * Whether file has the same ranges as an uploaded file.
+   *
+   * @param name                name of file to upload, might carry a
+   *                            compress suffix
+   */
+  bool Uploaded(const std::string& name) const;
+
+  /**
+   * Move manifest of file to uploaded.
+   *
+   * @param name                name of uploaded file
+   */
+  void MarkUploaded(const std::string& name);
+
+  /**
+   * Remove uploaded manifests older than retention, at most once an
+   * hour.
+   */
+  void Prune();
+
+ private:
+  struct Range {
+    int32_t partition;
+    int64_t first;
+    int64_t last;
+    uint64_t messages;
+  };
+
+  // manifest of sealed file, name or name without compress suffix
+  std::string SealedPath(const std::string& name) const;
+
+  static bool ReadFile(const std::string& path, std::string* content);
+
+  bool SaveCovered();
+
+  std::string dir_;
+  // covered offsets at startup
+  const std::unordered_map<int32_t, int64_t> skip_;
+  std::mutex mutex_;
+  // staged file path <--> ranges of open files
+  std::unordered_map<std::string, std::vector<Range>> open_;
+  // partition <--> last offset written
+  std::unordered_map<int32_t, int64_t> written_;
+  std::unordered_map<int32_t, int64_t> covered_;
+  time_t pruned_;
+};
+
+}   // namespace log2hdfs
+
+#endif  // LOG2HDFS_KAFKA2HDFS_MANIFEST_H_
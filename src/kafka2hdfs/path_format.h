@@ -3,6 +3,7 @@
 #ifndef LOG2HDFS_KAFKA2HDFS_PATH_FORMAT_H_
 #define LOG2HDFS_KAFKA2HDFS_PATH_FORMAT_H_
 
+#include <sys/stat.h>
 #include <string>
 #include <memory>
 #include "util/optional.h"
@@ -42,11 +43,13 @@ class PathFormat {
    * 
    * @param msg                 kafka message
    * @param name                name to set
+   * @param ts                  event time to set if not NULL
    * 
    * @returns True if build local file name success, false otherwise.
    */
   virtual bool BuildLocalFileName(const KafkaMessage& msg,
-                                  std::string* name) const = 0;
+                                  std::string* name,
+                                  time_t* ts = NULL) const = 0;
 
   /**
    * Whether local file is write finished.
@@ -57,6 +60,17 @@ class PathFormat {
    */
   virtual bool WriteFinished(const std::string& filepath) const = 0;
 
+  /**
+   * Whether local file is write finished, metadata already taken.
+   *
+   * @param filepath            local file path
+   * @param st                  stat of local file
+   *
+   * @returns True if file wirte finished, false otherwise.
+   */
+  virtual bool WriteFinished(const std::string& filepath,
+                             const struct stat& st) const = 0;
+
   /**
    * Build hdfs path from local file name.
    * 
@@ -74,17 +74,34 @@ std::shared_ptr<NormalPathFormat> NormalPathFormat::Init(
 }
 
 bool NormalPathFormat::BuildLocalFileName(
-    const KafkaMessage& msg, std::string* name) const {
+    const KafkaMessage& msg, std::string* name, time_t* event_ts) const {
   if (!name) {
     LOG(WARNING) << "NormalPathFormat BuildLocalFileName invalid parameters";
     return false;
   }
 
   std::string key;
-  time_t ts;
+  time_t ts = 0;
   const char *payload = static_cast<char *>(msg.Payload());
   size_t len = msg.Len();
-  if (!format_->ExtractKeyAndTs(payload, len, &key, &ts)) {
+
+  // fast path, event time extracted by log2kafka as create time, marked
+  // by header since producers stamp send time without extraction
+  if (conf_->timestamp_from_message() &&
+          msg.HasHeader(KafkaMessage::kEventTimeHeader)) {
+    MessageTimestamp mts = msg.Timestamp();
+    if (mts.type == MessageTimestamp::MSG_TIMESTAMP_CREATE_TIME &&
+        mts.timestamp > 0) {
+      ts = mts.timestamp / 1000;
+      if (!format_->ExtractKey(payload, len, &key)) {
+        LOG(WARNING) << "NormalPathFormat BuildLocalFileName ExtractKey"
+                     << " failed";
+        return false;
+      }
+    }
+  }
+
+  if (ts == 0 && !format_->ExtractKeyAndTs(payload, len, &key, &ts)) {
     LOG(WARNING) << "NormalPathFormat BuildLocalFileName ExtractKeyAndTs"
                  << " failed";
     return false;
@@ -110,6 +127,8 @@ bool NormalPathFormat::BuildLocalFileName(
     return false;
   }
   name->assign(local_path);
+  if (event_ts)
+    *event_ts = ts;
   return true;
 }
 
@@ -119,7 +138,18 @@ bool NormalPathFormat::WriteFinished(const std::string& filepath) const {
     return false;
   }
 
-  if (!IsFile(filepath)) {
+  struct stat st;
+  if (stat(filepath.c_str(), &st) != 0) {
+    LOG(WARNING) << "NormalPathFormat WriteFinished stat["
+                 << filepath << "] failed with errno[" << errno << "]";
+    return false;
+  }
+  return WriteFinished(filepath, st);
+}
+
+bool NormalPathFormat::WriteFinished(const std::string& filepath,
+                                     const struct stat& st) const {
+  if (!S_ISREG(st.st_mode)) {
     LOG(WARNING) << "NormalPathFormat WriteFinished IsFile["
                  << filepath << "] failed";
     return false;
@@ -128,13 +158,7 @@ bool NormalPathFormat::WriteFinished(const std::string& filepath) const {
   // 超过最大大小 小于等于0表示不限制
   off_t maxsize = conf_->complete_maxsize();
   if (maxsize > 0) {
-    off_t file_size = FileSize(filepath);
-    if (file_size < 0) {
-      LOG(WARNING) << "NormalPathFormat WriteFinished FileSize["
-                   << filepath << "] failed";
-      return false;
-    }
-
+    off_t file_size = st.st_size;
     if (file_size >= maxsize) {
       LOG(INFO) << "NormalPathFormat WriteFinished filepath[" << filepath
                 << "] filesize[" << file_size << "] large than maxsize["
@@ -145,7 +169,7 @@ bool NormalPathFormat::WriteFinished(const std::string& filepath) const {
 
   // 超过最大未修改时间
   int interval = conf_->complete_interval();
-  time_t file_ts = FileMtime(filepath);
+  time_t file_ts = st.st_mtime;
   if (file_ts < 60) {
     LOG(WARNING) << "NormalPathFormat WriteFinished FileMtime["
                  << filepath << "] failed";
@@ -162,13 +186,7 @@ bool NormalPathFormat::WriteFinished(const std::string& filepath) const {
   // 超过最大保留时长 小于60s表示不限制
   int retention = conf_->retention_seconds();
   if (retention > 60) {
-    time_t file_atime = FileAtime(filepath);
-    if (file_atime < 0) {
-      LOG(WARNING) << "NormalPathFormat WriteFinished FileAtime["
-                   << filepath << "] failed";
-      return false;
-    }
-
+    time_t file_atime = st.st_atime;
     if (time(NULL) - file_atime > retention) {
       LOG(INFO) << "NormalPathFormat WriteFinished filepath[" << filepath
                 << "] file atime[" << file_atime << "] large than retention["
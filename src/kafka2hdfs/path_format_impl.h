@@ -18,10 +18,14 @@ class NormalPathFormat : public PathFormat {
       topic_(topic), format_(std::move(format)),
       conf_(std::move(conf)) {}
 
-  bool BuildLocalFileName(const KafkaMessage& msg, std::string* name) const;
+  bool BuildLocalFileName(const KafkaMessage& msg, std::string* name,
+                          time_t* ts = NULL) const;
 
   bool WriteFinished(const std::string& filepath) const;
 
+  bool WriteFinished(const std::string& filepath,
+                     const struct stat& st) const;
+
   bool BuildHdfsPath(const std::string& name,
                      std::string* path,
                      bool delay = false) const;
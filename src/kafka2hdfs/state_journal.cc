@@ -0,0 +1,266 @@
+// Copyright (c) 2017 Lanceolata
+
+#include "kafka2hdfs/state_journal.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <fstream>
+#include <sstream>
+#include "util/string_utils.h"
+#include "util/system_utils.h"
+#include "easylogging++.h"
+
+namespace log2hdfs {
+
+// Rewrite journal once lines exceed
+#define JOURNAL_COMPACT_LINES 4096
+
+namespace {
+
+const char* kStateNames[] = {
+  "sealed", "compressed", "uploading", "renamed", "uploaded", "indexed",
+  "deleted"
+};
+
+bool WriteAll(int fd, const std::string& content) {
+  const char* p = content.data();
+  size_t left = content.size();
+  while (left > 0) {
+    ssize_t n = write(fd, p, left);
+    if (n == -1) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    p += n;
+    left -= n;
+  }
+  return true;
+}
+
+}   // namespace
+
+std::shared_ptr<StateJournal> StateJournal::Init(const std::string& path) {
+  if (path.empty()) {
+    LOG(ERROR) << "StateJournal Init invalid parameters";
+    return nullptr;
+  }
+
+  bool loaded = IsFile(path);
+  std::shared_ptr<StateJournal> res = std::make_shared<StateJournal>(
+      path, loaded);
+  if (loaded) {
+    std::ifstream ifs(path);
+    if (!ifs) {
+      LOG(ERROR) << "StateJournal Init ifstream path[" << path
+                 << "] failed";
+      return nullptr;
+    }
+
+    // last line might be partial after crash
+    std::string line;
+    Entry entry;
+    while (std::getline(ifs, line)) {
+      if (Parse(line, &entry)) {
+        res->Apply(entry);
+      } else {
+        LOG(WARNING) << "StateJournal Init path[" << path
+                     << "] invalid line[" << line << "]";
+      }
+    }
+  }
+
+  if (!res->Rewrite()) {
+    LOG(ERROR) << "StateJournal Init Rewrite path[" << path << "] failed "
+               << "with errno[" << errno << "]";
+    return nullptr;
+  }
+
+  LOG(INFO) << "StateJournal Init path[" << path << "] loaded[" << loaded
+            << "] pending[" << res->pending_.size() << "]";
+  return res;
+}
+
+StateJournal::~StateJournal() {
+  if (fd_ != -1)
+    close(fd_);
+}
+
+void StateJournal::Sealed(const std::string& from, const std::string& path,
+                          off_t size) {
+  Entry entry = { kSealed, from, path, "", size };
+  Record(entry);
+}
+
+void StateJournal::Compressed(const std::string& source,
+                              const std::string& path, off_t size) {
+  Entry entry = { kCompressed, source, path, "", size };
+  Record(entry);
+}
+
+void StateJournal::Uploading(const std::string& path,
+                             const std::string& temp_path, off_t size) {
+  Entry entry = { kUploading, "", path, temp_path, size };
+  Record(entry);
+}
+
+void StateJournal::Renamed(const std::string& path,
+                           const std::string& hdfs_path, off_t size) {
+  Entry entry = { kRenamed, "", path, hdfs_path, size };
+  Record(entry);
+}
+
+void StateJournal::Uploaded(const std::string& path,
+                            const std::string& hdfs_path, off_t size) {
+  Entry entry = { kUploaded, "", path, hdfs_path, size };
+  Record(entry);
+}
+
+void StateJournal::Indexed(const std::string& path) {
+  Entry entry = { kIndexed, "", path, "", 0 };
+  Record(entry);
+}
+
+void StateJournal::Deleted(const std::string& path) {
+  Entry entry = { kDeleted, "", path, "", 0 };
+  Record(entry);
+}
+
+std::vector<StateJournal::Entry> StateJournal::Pending() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<Entry> res;
+  res.reserve(pending_.size());
+  for (auto& pending : pending_)
+    res.push_back(pending.second);
+  return res;
+}
+
+bool StateJournal::Parse(const std::string& line, Entry* entry) {
+  std::vector<std::string> fields = SplitString(line, "\t",
+      kKeepWhitespace, kSplitAll);
+  if (fields.size() != 5 || fields[2].empty())
+    return false;
+
+  int state = -1;
+  for (int i = kSealed; i <= kDeleted; ++i) {
+    if (fields[0] == kStateNames[i]) {
+      state = i;
+      break;
+    }
+  }
+  if (state == -1)
+    return false;
+
+  entry->state = static_cast<State>(state);
+  entry->source = fields[1];
+  entry->path = fields[2];
+  entry->hdfs_path = fields[3];
+  entry->size = atoll(fields[4].c_str());
+  return true;
+}
+
+std::string StateJournal::Format(const Entry& entry) {
+  std::ostringstream os;
+  os << kStateNames[entry.state] << "\t" << entry.source << "\t"
+     << entry.path << "\t" << entry.hdfs_path << "\t"
+     << static_cast<long long>(entry.size) << "\n";
+  return os.str();
+}
+
+void StateJournal::Apply(const Entry& entry) {
+  switch (entry.state) {
+    case kSealed:
+      pending_[entry.path] = entry;
+      break;
+    case kCompressed: {
+      // upload failed, back to compressed with source kept
+      auto it = pending_.find(entry.path);
+      if (entry.source.empty() && it != pending_.end()) {
+        it->second.state = entry.state;
+        it->second.hdfs_path.clear();
+        it->second.size = entry.size;
+      } else {
+        pending_[entry.path] = entry;
+      }
+      break;
+    }
+    case kUploading:
+    case kRenamed:
+    case kUploaded:
+    case kIndexed: {
+      auto it = pending_.find(entry.path);
+      if (it == pending_.end()) {
+        pending_[entry.path] = entry;
+      } else {
+        it->second.state = entry.state;
+        if (!entry.hdfs_path.empty())
+          it->second.hdfs_path = entry.hdfs_path;
+      }
+      break;
+    }
+    case kDeleted:
+      pending_.erase(entry.path);
+      break;
+  }
+}
+
+void StateJournal::Record(const Entry& entry) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Apply(entry);
+  if (broken_) {
+    // entry is written by rewrite of pending files
+    if (Rewrite()) {
+      LOG(INFO) << "StateJournal Record path[" << path_ << "] rewritten";
+      broken_ = false;
+    }
+    return;
+  }
+
+  if (fd_ == -1 || !WriteAll(fd_, Format(entry))) {
+    LOG(WARNING) << "StateJournal Record path[" << path_ << "] entry["
+                 << entry.path << "] failed with errno[" << errno << "]";
+    // next startup scans dirs instead of trusting incomplete journal
+    broken_ = true;
+    if (unlink(path_.c_str()) != 0 && errno != ENOENT) {
+      LOG(ERROR) << "StateJournal Record unlink path[" << path_
+                 << "] failed with errno[" << errno << "]";
+    }
+    return;
+  }
+
+  if (++lines_ >= JOURNAL_COMPACT_LINES && lines_ > pending_.size() * 4) {
+    if (!Rewrite()) {
+      LOG(WARNING) << "StateJournal Record Rewrite path[" << path_
+                   << "] failed with errno[" << errno << "]";
+    }
+  }
+}
+
+bool StateJournal::Rewrite() {
+  std::string content;
+  for (auto& pending : pending_)
+    content.append(Format(pending.second));
+
+  std::string tmp_path = path_ + ".tmp";
+  int fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                0644);
+  if (fd == -1)
+    return false;
+
+  bool res = WriteAll(fd, content);
+  if (close(fd) != 0 || !res || !Rename(tmp_path, path_))
+    return false;
+
+  fd = open(path_.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+  if (fd == -1)
+    return false;
+
+  if (fd_ != -1)
+    close(fd_);
+  fd_ = fd;
+  lines_ = pending_.size();
+  return true;
+}
+
+}   // namespace log2hdfs
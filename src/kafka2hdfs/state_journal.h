@@ -0,0 +1,161 @@
+// Copyright (c) 2017 Lanceolata
+
+#ifndef LOG2HDFS_KAFKA2HDFS_STATE_JOURNAL_H_
+#define LOG2HDFS_KAFKA2HDFS_STATE_JOURNAL_H_
+
+#include <sys/types.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+
+namespace log2hdfs {
+
+/**
+ * Stage transitions of staged files
+ *
+ * Every transition of a file through compress dir, upload dir and hdfs
+ * is appended to one journal file per topic, lines of
+ * "state\tsource\tpath\thdfs_path\tsize". Files not yet deleted are
+ * kept in memory, on startup each resumes at the step it stopped at.
+ *
+ * Transitions are recorded before the file is moved, a file missing
+ * on startup means the move did not happen. Journal is rewritten with
+ * pending files only on startup and once it grows large.
+ *
+ * A failed append removes the journal, so the next startup scans dirs
+ * instead of trusting an incomplete journal, until the journal is
+ * rewritten from memory.
+ */
+class StateJournal {
+ public:
+  /**
+   * Stage of file
+   */
+  enum State {
+    kSealed,        // in compress dir, to compress
+    kCompressed,    // in upload dir, to upload
+    kUploading,     // put to hdfs temp path, to rename
+    kRenamed,       // renamed to hdfs path, to record uploaded
+    kUploaded,      // in hdfs, to index or delete
+    kIndexed,       // in hdfs and indexed, to delete
+    kDeleted        // local file deleted or out of pipeline
+  };
+
+  /**
+   * Pending file
+   */
+  struct Entry {
+    State state;
+    std::string source;         // file compressed from
+    std::string path;           // local file
+    std::string hdfs_path;      // temp path if uploading
+    off_t size;                 // size of local file
+  };
+
+  /**
+   * Static function to create a StateJournal shared_ptr.
+   *
+   * @param path                journal path, loaded if exists
+   *
+   * @returns std::shared_ptr<StateJournal> if success; nullptr otherwise.
+   */
+  static std::shared_ptr<StateJournal> Init(const std::string& path);
+
+  /**
+   * Constructor
+   */
+  StateJournal(const std::string& path, bool loaded):
+      path_(path), loaded_(loaded), fd_(-1), broken_(false), lines_(0) {}
+
+  ~StateJournal();
+
+  StateJournal(const StateJournal& other) = delete;
+  StateJournal& operator=(const StateJournal& other) = delete;
+
+  /**
+   * @returns True if journal existed on startup, pending files are
+   *          complete; false if dirs need scan.
+   */
+  bool Loaded() const {
+    return loaded_;
+  }
+
+  /**
+   * File moved from consume dir to compress dir.
+   */
+  void Sealed(const std::string& from, const std::string& path,
+              off_t size);
+
+  /**
+   * File compressed or moved from compress dir to upload dir, or upload
+   * of file failed.
+   *
+   * A source might produce several files, it stays pending until
+   * Deleted(source) is recorded after the last one. Empty source keeps
+   * the source recorded before.
+   */
+  void Compressed(const std::string& source, const std::string& path,
+                  off_t size);
+
+  /**
+   * File about to put to hdfs temp_path.
+   */
+  void Uploading(const std::string& path, const std::string& temp_path,
+                 off_t size);
+
+  /**
+   * Temp file of file renamed to hdfs_path.
+   */
+  void Renamed(const std::string& path, const std::string& hdfs_path,
+               off_t size);
+
+  /**
+   * File uploaded to hdfs_path.
+   */
+  void Uploaded(const std::string& path, const std::string& hdfs_path,
+                off_t size);
+
+  /**
+   * Uploaded file indexed.
+   */
+  void Indexed(const std::string& path);
+
+  /**
+   * Local file deleted or left pipeline.
+   */
+  void Deleted(const std::string& path);
+
+  /**
+   * @returns Pending files in path order.
+   */
+  std::vector<Entry> Pending() const;
+
+ private:
+  static bool Parse(const std::string& line, Entry* entry);
+
+  static std::string Format(const Entry& entry);
+
+  // update pending files
+  void Apply(const Entry& entry);
+
+  void Record(const Entry& entry);
+
+  // rewrite journal with pending files and reopen
+  bool Rewrite();
+
+  std::string path_;
+  bool loaded_;
+  mutable std::mutex mutex_;
+  int fd_;
+  // an append failed, journal removed until rewritten
+  bool broken_;
+  size_t lines_;
+  // local path <--> pending file
+  std::map<std::string, Entry> pending_;
+};
+
+}   // namespace log2hdfs
+
+#endif  // LOG2HDFS_KAFKA2HDFS_STATE_JOURNAL_H_
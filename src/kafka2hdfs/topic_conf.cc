@@ -76,6 +76,12 @@ TopicConfContents::TopicConfContents():
     consume_type_(ConsumeCallback::Type::kV6),
     upload_type_(Upload::Type::kText),
     parallel_(1),
+    timestamp_from_message_(false),
+    group_mode_(false),
+    consume_group_(),
+    manifest_(false),
+    done_marker_(DoneMarker::Type::kNone),
+    done_delay_(300),
     compress_lzo_(),
     compress_orc_(),
     compress_mv_(),
@@ -94,6 +100,12 @@ TopicConfContents::TopicConfContents(const TopicConfContents& other):
     consume_type_(other.consume_type_),
     upload_type_(other.upload_type_),
     parallel_(other.parallel_),
+    timestamp_from_message_(other.timestamp_from_message_),
+    group_mode_(other.group_mode_),
+    consume_group_(other.consume_group_),
+    manifest_(other.manifest_),
+    done_marker_(other.done_marker_),
+    done_delay_(other.done_delay_),
     compress_lzo_(other.compress_lzo_),
     compress_orc_(other.compress_orc_),
     compress_mv_(other.compress_mv_),
@@ -200,6 +212,83 @@ bool TopicConfContents::Update(std::shared_ptr<Section> section) {
   }
   LOG(INFO) << "TopicConfContents Update parallel[" << parallel_ << "]";
 
+  option = section->Get("timestamp.source");
+  if (option.valid()) {
+    if (option.value() == "message") {
+      timestamp_from_message_ = true;
+    } else if (option.value() == "payload") {
+      timestamp_from_message_ = false;
+    } else {
+      LOG(WARNING) << "TopicConfContents Update invalid timestamp_source["
+                   << option.value() << "]";
+      return false;
+    }
+  }
+  LOG(INFO) << "TopicConfContents Update timestamp_from_message["
+            << timestamp_from_message_ << "]";
+
+  option = section->Get("consume.mode");
+  if (option.valid()) {
+    if (option.value() == "group") {
+      group_mode_ = true;
+    } else if (option.value() == "simple") {
+      group_mode_ = false;
+    } else {
+      LOG(WARNING) << "TopicConfContents Update invalid consume_mode["
+                   << option.value() << "]";
+      return false;
+    }
+  }
+  LOG(INFO) << "TopicConfContents Update group_mode[" << group_mode_ << "]";
+
+  option = section->Get("consume.group");
+  if (option.valid())
+    consume_group_ = option.value();
+  LOG(INFO) << "TopicConfContents Update consume_group["
+            << consume_group_ << "]";
+
+  option = section->Get("manifest");
+  if (option.valid()) {
+    if (option.value() == "true") {
+      manifest_ = true;
+    } else if (option.value() == "false") {
+      manifest_ = false;
+    } else {
+      LOG(WARNING) << "TopicConfContents Update invalid manifest["
+                   << option.value() << "]";
+      return false;
+    }
+  }
+  LOG(INFO) << "TopicConfContents Update manifest[" << manifest_ << "]";
+
+  option = section->Get("done.marker");
+  if (option.valid()) {
+    Optional<DoneMarker::Type> done_marker =
+        DoneMarker::ParseType(option.value());
+    if (done_marker.valid()) {
+      done_marker_ = done_marker.value();
+    } else {
+      LOG(WARNING) << "TopicConfContents Update invalid done_marker["
+                   << option.value() << "]";
+      return false;
+    }
+  }
+  LOG(INFO) << "TopicConfContents Update done_marker["
+            << done_marker_ << "]";
+
+  option = section->Get("done.delay");
+  if (option.valid()) {
+    int done_delay = atoi(option.value().c_str());
+    if (done_delay >= 0) {
+      done_delay_ = done_delay;
+    } else {
+      LOG(WARNING) << "TopicConfContents Update invalid done_delay["
+                   << option.value() << "]";
+      return false;
+    }
+  }
+  LOG(INFO) << "TopicConfContents Update done_delay[" << done_delay_ << "]";
+
   
   std::string errstr;
   for (auto it = section->Begin(); it != section->End(); ++it) {
@@ -363,33 +452,33 @@ std::shared_ptr<TopicConf> TopicConf::Init(const std::string& topic) {
   return std::make_shared<TopicConf>(topic);
 }
 
-bool TopicConf::InitConf(std::shared_ptr<Section> section) {
-  LOG(INFO) << "TopicConf InitConf topic[" << topic_ << "]";
-  if (!section) {
-    LOG(WARNING) << "TopicConf InitConf invalid parameters";
-    return false;
-  }
+TopicConf::TopicConf(const TopicConf& topic, const std::string& sink):
+    topic_(topic.topic_), sink_(sink), prefix_("sink." + sink + "."),
+    partitions_(topic.partitions_), offsets_(topic.offsets_),
+    backfill_start_time_(-1), backfill_end_time_(-1),
+    contents_(topic.contents_) {}
 
+bool TopicConf::InitPartitions(std::shared_ptr<Section> section) {
   std::string partitions = section->Get("partitions", "");
   if (partitions.empty()) {
-    LOG(WARNING) << "TopicConf InitConf invalid partitions";
+    LOG(WARNING) << "TopicConf InitPartitions invalid partitions";
     return false;
   }
 
   if (!ParsePartitions(partitions, &partitions_)) {
-    LOG(WARNING) << "TopicConf InitConf ParsePartitions[" << partitions
+    LOG(WARNING) << "TopicConf InitPartitions ParsePartitions[" << partitions
                  << "] failed";
     return false;
   }
 
   std::string offsets = section->Get("offsets", "");
   if (offsets.empty()) {
-    LOG(WARNING) << "TopicConf InitConf invalid offsets";
+    LOG(WARNING) << "TopicConf InitPartitions invalid offsets";
     return false;
   }
 
   if (!ParseOffsets(offsets, partitions_.size(), &offsets_)) {
-    LOG(WARNING) << "TopicConf InitConf ParseOffsets[" << offsets
+    LOG(WARNING) << "TopicConf InitPartitions ParseOffsets[" << offsets
                  << "] failed";
     return false;
   }
@@ -398,64 +487,257 @@ bool TopicConf::InitConf(std::shared_ptr<Section> section) {
   for (size_t i = 0; i < partitions_.size(); ++i) {
     stream << partitions_[i] << ":" << offsets_[i] << ",";
   }
-  LOG(INFO) << "TopicConf InitConf partitions[" << stream.str()
+  LOG(INFO) << "TopicConf InitPartitions partitions[" << stream.str()
             << "] success";
+  return true;
+}
 
-  std::string hdfs_path = section->Get("hdfs.path", "");
+bool TopicConf::InitBackfillRange(std::shared_ptr<Section> section) {
+  std::string partitions = section->Get("partitions", "");
+  if (!ParsePartitions(partitions, &partitions_)) {
+    LOG(WARNING) << "TopicConf InitBackfillRange ParsePartitions["
+                 << partitions << "] failed";
+    return false;
+  }
+
+  std::string start_time = section->Get("backfill.start.time", "");
+  if (!start_time.empty()) {
+    backfill_start_time_ = atol(start_time.c_str()) * 1000;
+    if (backfill_start_time_ <= 0) {
+      LOG(WARNING) << "TopicConf InitBackfillRange invalid "
+                   << "backfill.start.time[" << start_time << "]";
+      return false;
+    }
+  } else {
+    std::string start = section->Get("backfill.start", "");
+    if (!ParseOffsets(start, partitions_.size(), &backfill_start_)) {
+      LOG(WARNING) << "TopicConf InitBackfillRange invalid "
+                   << "backfill.start[" << start << "]";
+      return false;
+    }
+  }
+
+  // without end, consume until high watermark of start
+  std::string end_time = section->Get("backfill.end.time", "");
+  std::string end = section->Get("backfill.end", "");
+  if (!end_time.empty()) {
+    backfill_end_time_ = atol(end_time.c_str()) * 1000;
+    if (backfill_end_time_ <= 0 ||
+            backfill_end_time_ <= backfill_start_time_) {
+      LOG(WARNING) << "TopicConf InitBackfillRange invalid "
+                   << "backfill.end.time[" << end_time << "]";
+      return false;
+    }
+  } else if (!end.empty()) {
+    if (!ParseOffsets(end, partitions_.size(), &backfill_end_)) {
+      LOG(WARNING) << "TopicConf InitBackfillRange invalid "
+                   << "backfill.end[" << end << "]";
+      return false;
+    }
+  }
+
+  LOG(INFO) << "TopicConf InitBackfillRange partitions[" << partitions
+            << "] start[" << section->Get("backfill.start", "")
+            << "] start_time[" << backfill_start_time_ << "] end[" << end
+            << "] end_time[" << backfill_end_time_ << "] success";
+  return true;
+}
+
+bool TopicConf::InitPaths(std::shared_ptr<Section> section) {
+  std::string hdfs_path = section->Get(prefix_ + "hdfs.path", "");
   if (hdfs_path.empty()) {
-    LOG(WARNING) << "TopicConf InitConf hdfs_path invalid";
+    LOG(WARNING) << "TopicConf InitPaths hdfs_path invalid";
     return false;
   }
   hdfs_path_ = hdfs_path;
-  LOG(INFO) << "TopicConf InitConf hdfs_path[" << hdfs_path << "]";
+  LOG(INFO) << "TopicConf InitPaths hdfs_path[" << hdfs_path << "]";
 
-  std::string hdfs_path_delay = section->Get("hdfs.path.delay", "");
+  std::string hdfs_path_delay = section->Get(prefix_ + "hdfs.path.delay",
+                                             "");
   hdfs_path_delay_ = hdfs_path_delay;
-  LOG(INFO) << "TopicConf InitConf hdfs_path_delay["
+  LOG(INFO) << "TopicConf InitPaths hdfs_path_delay["
               << hdfs_path_delay_ << "]";
 
-  if (!contents_.Update(std::move(section))) {
-    return false;
-  }
-
   // create dirs
   if (!MakeDir(contents_.root_dir_)) {
-    LOG(WARNING) << "TopicConf InitConf MakeDir[" << contents_.root_dir_
+    LOG(WARNING) << "TopicConf InitPaths MakeDir[" << contents_.root_dir_
                  << "] failed with errno[" << errno << "]";
     return false;
   }
 
   std::string topic_dir = contents_.root_dir_ + "/" + topic_;
   if (!MakeDir(topic_dir)) {
-    LOG(WARNING) << "TopicConf InitConf MakeDir[" << topic_dir
+    LOG(WARNING) << "TopicConf InitPaths MakeDir[" << topic_dir
                  << "] failed with errno[" << errno << "]";
     return false;
   }
+
+  // sinks staged under topic dir, same filesystem for hard links
+  if (!sink_.empty()) {
+    std::string sinks_dir = topic_dir + "/sinks";
+    topic_dir = sinks_dir + "/" + sink_;
+    if (!MakeDir(sinks_dir) || !MakeDir(topic_dir)) {
+      LOG(WARNING) << "TopicConf InitPaths MakeDir[" << topic_dir
+                   << "] failed with errno[" << errno << "]";
+      return false;
+    }
+  }
   consume_dir_ = topic_dir + "/" + "consume";
   compress_dir_ = topic_dir + "/" + "compress";
   upload_dir_ = topic_dir + "/" + "upload";
+  manifest_dir_ = topic_dir + "/" + "manifest";
+  journal_path_ = topic_dir + "/" + "journal";
+  done_path_ = topic_dir + "/" + "done";
+  return true;
+}
+
+bool TopicConf::InitConf(std::shared_ptr<Section> section) {
+  LOG(INFO) << "TopicConf InitConf topic[" << topic_ << "]";
+  if (!section) {
+    LOG(WARNING) << "TopicConf InitConf invalid parameters";
+    return false;
+  }
+
+  if (!contents_.Update(section)) {
+    return false;
+  }
+
+  // partitions are assigned by the consumer group in group mode
+  if (!contents_.group_mode_ && !InitPartitions(section)) {
+    return false;
+  }
+
+  if (!InitPaths(section)) {
+    return false;
+  }
+
+  return InitSinks(section);
+}
+
+bool TopicConf::InitSinks(std::shared_ptr<Section> section) {
+  std::vector<std::string> names = SplitString(section->Get("sinks", ""),
+      ",", kTrimWhitespace, kSplitNonempty);
+  for (auto& name : names) {
+    for (auto& sink : sinks_) {
+      if (sink->sink_ == name) {
+        LOG(WARNING) << "TopicConf InitSinks duplicate sink[" << name
+                     << "]";
+        return false;
+      }
+    }
+
+    std::shared_ptr<TopicConf> sink(new TopicConf(*this, name));
+    if (!sink->InitSinkConf(section)) {
+      LOG(WARNING) << "TopicConf InitSinks sink[" << name << "] failed";
+      return false;
+    }
+    sinks_.push_back(std::move(sink));
+  }
+  return true;
+}
+
+bool TopicConf::InitSinkConf(std::shared_ptr<Section> section) {
+  LOG(INFO) << "TopicConf InitSinkConf topic[" << topic_ << "] sink["
+            << sink_ << "]";
+  if (sink_.find('/') != std::string::npos) {
+    LOG(WARNING) << "TopicConf InitSinkConf invalid sink[" << sink_ << "]";
+    return false;
+  }
+
+  Optional<std::string> option = section->Get(prefix_ + "upload.type");
+  if (option.valid()) {
+    Optional<Upload::Type> upload_type = Upload::ParseType(option.value());
+    if (!upload_type.valid()) {
+      LOG(WARNING) << "TopicConf InitSinkConf invalid upload_type["
+                   << option.value() << "]";
+      return false;
+    }
+    contents_.upload_type_ = upload_type.value();
+  }
+
+  // compress.mv dir is shared with topic
+  if (contents_.upload_type_ == Upload::Type::kCompress) {
+    LOG(WARNING) << "TopicConf InitSinkConf upload_type compress "
+                 << "not supported";
+    return false;
+  }
+  LOG(INFO) << "TopicConf InitSinkConf upload_type["
+            << contents_.upload_type_ << "]";
+
+  // offsets and watermarks belong to topic
+  contents_.manifest_ = false;
+  contents_.done_marker_ = DoneMarker::Type::kNone;
+  return InitPaths(section);
+}
+
+bool TopicConf::InitBackfillConf(std::shared_ptr<Section> section,
+                                 const std::string& root_dir) {
+  LOG(INFO) << "TopicConf InitBackfillConf topic[" << topic_ << "]";
+  if (!section || root_dir.empty()) {
+    LOG(WARNING) << "TopicConf InitBackfillConf invalid parameters";
+    return false;
+  }
+
+  if (!contents_.Update(section)) {
+    return false;
+  }
+
+  if (!InitBackfillRange(section)) {
+    return false;
+  }
+
+  // staging root keeps backfill files away from live consumer
+  contents_.root_dir_ = root_dir;
+  if (!InitPaths(section)) {
+    return false;
+  }
+
+  // offset files and committed offsets of live consumer untouched
+  std::string offset_dir = root_dir + "/" + topic_ + "/offsets";
+  if (!MakeDir(offset_dir)) {
+    LOG(WARNING) << "TopicConf InitBackfillConf MakeDir[" << offset_dir
+                 << "] failed with errno[" << errno << "]";
+    return false;
+  }
+
+  std::string errstr;
+  KafkaTopicConf* conf = contents_.kafka_topic_conf_.get();
+  if (conf->Set("offset.store.path", offset_dir, &errstr) != kConfOk ||
+          conf->Set("auto.commit.enable", "false", &errstr) != kConfOk) {
+    LOG(WARNING) << "TopicConf InitBackfillConf set kafka conf failed "
+                 << "with errstr[" << errstr << "]";
+    return false;
+  }
   return true;
 }
 
 bool TopicConf::UpdateRuntime(std::shared_ptr<Section> section) {
-  LOG(INFO) << "TopicConf UpdateRuntime topic[" << topic_ << "]";
+  LOG(INFO) << "TopicConf UpdateRuntime topic[" << topic_ << "] sink["
+            << sink_ << "]";
   if (!section) {
     LOG(WARNING) << "TopicConf UpdateRuntime invalid parameters";
     return false;
   }
-  std::string hdfs_path = section->Get("hdfs.path", "");
+  std::string hdfs_path = section->Get(prefix_ + "hdfs.path", "");
   if (hdfs_path.empty()) {
     LOG(WARNING) << "TopicConf UpdateRuntime hdfs_path invalid";
     return false;
   }
 
-  std::string hdfs_path_delay = section->Get("hdfs.path.delay", ""); 
+  std::string hdfs_path_delay = section->Get(prefix_ + "hdfs.path.delay",
+                                             "");
 
-  if (!contents_.UpdateRuntime(std::move(section))) {
+  if (!contents_.UpdateRuntime(section)) {
     LOG(WARNING) << "TopicConf UpdateRuntime contents_ failed";
     return false;
   }
 
+  // sinks added or removed after restart
+  for (auto& sink : sinks_) {
+    if (!sink->UpdateRuntime(section))
+      return false;
+  }
+
   std::lock_guard<std::mutex> lock(mutex_);
   if (hdfs_path_ != hdfs_path) {
     hdfs_path_ = hdfs_path;
@@ -10,6 +10,7 @@
 #include <atomic>
 #include "kafka/kafka_conf.h"
 #include "kafka2hdfs/consume_callback.h"
+#include "kafka2hdfs/done_marker.h"
 #include "kafka2hdfs/log_format.h"
 #include "kafka2hdfs/path_format.h"
 #include "kafka2hdfs/upload.h"
@@ -84,6 +85,15 @@ class TopicConfContents {
   ConsumeCallback::Type consume_type_;
   Upload::Type upload_type_;
   size_t parallel_;
+  // read event time from kafka message timestamp before payload
+  bool timestamp_from_message_;
+  // balanced consumer group instead of configured partitions
+  bool group_mode_;
+  std::string consume_group_;
+  // offset manifests of staged files, idempotent restarts
+  bool manifest_;
+  DoneMarker::Type done_marker_;
+  int done_delay_;
 
   // flow variable thread safe
   std::string compress_lzo_;
@@ -122,13 +132,28 @@ class TopicConf {
    * Constructor
    */
   explicit TopicConf(const std::string& topic):
-      topic_(topic), contents_(DEFAULT_CONTENTS_) {}
+      topic_(topic), backfill_start_time_(-1), backfill_end_time_(-1),
+      contents_(DEFAULT_CONTENTS_) {}
 
   /**
    * Init topic conf.
    */
   bool InitConf(std::shared_ptr<Section> section);
 
+  /**
+   * Init topic conf for backfill.
+   *
+   * Partitions and range are read from backfill keys, files are staged
+   * under root_dir and offsets are never stored.
+   *
+   * @param section             configure section
+   * @param root_dir            staging root dir
+   *
+   * @returns True if init success, false otherwise.
+   */
+  bool InitBackfillConf(std::shared_ptr<Section> section,
+                        const std::string& root_dir);
+
   /**
    * Update topic conf runtime.
    * 
@@ -140,6 +165,21 @@ class TopicConf {
     return topic_;
   }
 
+  /**
+   * @returns Sink name, empty if conf of topic.
+   */
+  const std::string& sink() const {
+    return sink_;
+  }
+
+  /**
+   * @returns Confs of sinks, files staged by topic are uploaded by
+   *          every sink.
+   */
+  const std::vector<std::shared_ptr<TopicConf>>& sinks() const {
+    return sinks_;
+  }
+
   const std::string& consume_dir() const {
     return consume_dir_;
   }
@@ -152,6 +192,18 @@ class TopicConf {
     return upload_dir_;
   }
 
+  const std::string& manifest_dir() const {
+    return manifest_dir_;
+  }
+
+  const std::string& journal_path() const {
+    return journal_path_;
+  }
+
+  const std::string& done_path() const {
+    return done_path_;
+  }
+
   const std::vector<int32_t>& partitions() const {
     return partitions_;
   }
@@ -160,6 +212,35 @@ class TopicConf {
     return offsets_;
   }
 
+  /**
+   * @returns Backfill start offsets, empty if start by time.
+   */
+  const std::vector<int64_t>& backfill_start() const {
+    return backfill_start_;
+  }
+
+  /**
+   * @returns Backfill end offsets(exclusive), empty if end by time or
+   *          at high watermark.
+   */
+  const std::vector<int64_t>& backfill_end() const {
+    return backfill_end_;
+  }
+
+  /**
+   * @returns Backfill start timestamp(ms), -1 if start by offsets.
+   */
+  int64_t backfill_start_time() const {
+    return backfill_start_time_;
+  }
+
+  /**
+   * @returns Backfill end timestamp(ms, exclusive), -1 if unset.
+   */
+  int64_t backfill_end_time() const {
+    return backfill_end_time_;
+  }
+
   std::string hdfs_path() const {
     std::lock_guard<std::mutex> lock(mutex_);
     return hdfs_path_;
@@ -194,6 +275,30 @@ class TopicConf {
     return contents_.parallel_;
   }
 
+  bool timestamp_from_message() const {
+    return contents_.timestamp_from_message_;
+  }
+
+  bool group_mode() const {
+    return contents_.group_mode_;
+  }
+
+  const std::string& consume_group() const {
+    return contents_.consume_group_;
+  }
+
+  bool manifest() const {
+    return contents_.manifest_;
+  }
+
+  DoneMarker::Type done_marker() const {
+    return contents_.done_marker_;
+  }
+
+  int done_delay() const {
+    return contents_.done_delay_;
+  }
+
   std::string compress_lzo() const {
     return contents_.GetCompressLzo();
   }
@@ -231,17 +336,41 @@ class TopicConf {
   }
 
  private:
+  bool InitPartitions(std::shared_ptr<Section> section);
+
+  bool InitBackfillRange(std::shared_ptr<Section> section);
+
+  bool InitPaths(std::shared_ptr<Section> section);
+
+  bool InitSinks(std::shared_ptr<Section> section);
+
+  bool InitSinkConf(std::shared_ptr<Section> section);
+
+  // conf of sink, contents copied from topic
+  TopicConf(const TopicConf& topic, const std::string& sink);
+
   static TopicConfContents DEFAULT_CONTENTS_;
 
   std::string topic_;
+  std::string sink_;
+  // prefix of sink keys in topic section
+  std::string prefix_;
   std::vector<int32_t> partitions_;
   std::vector<int64_t> offsets_;
+  std::vector<int64_t> backfill_start_;
+  std::vector<int64_t> backfill_end_;
+  int64_t backfill_start_time_;
+  int64_t backfill_end_time_;
   std::string consume_dir_;
   std::string compress_dir_;
   std::string upload_dir_;
+  std::string manifest_dir_;
+  std::string journal_path_;
+  std::string done_path_;
   std::string hdfs_path_;
   std::string hdfs_path_delay_;
   TopicConfContents contents_;
+  std::vector<std::shared_ptr<TopicConf>> sinks_;
   mutable std::mutex mutex_;
 };
 
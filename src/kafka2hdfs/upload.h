@@ -10,7 +10,9 @@
 namespace log2hdfs {
 
 class FpCache;
+class DoneMarker;
 class HdfsHandle;
+class Manifest;
 class PathFormat;
 class TopicConf;
 
@@ -38,12 +40,18 @@ class Upload {
 
   /**
    * Static function to create a Upload unique_ptr.
+   *
+   * With manifest, closed files are sealed and a file with the same
+   * ranges as an uploaded one is dropped. With marker, done markers
+   * are written once buckets uploaded.
    */
   static std::unique_ptr<Upload> Init(
       std::shared_ptr<TopicConf> conf,
       std::shared_ptr<PathFormat> format,
       std::shared_ptr<FpCache> fp_cache,
-      std::shared_ptr<HdfsHandle> handle);
+      std::shared_ptr<HdfsHandle> handle,
+      std::shared_ptr<Manifest> manifest = nullptr,
+      std::shared_ptr<DoneMarker> marker = nullptr);
 
   virtual ~Upload() {}
 
@@ -61,6 +69,30 @@ class Upload {
    * Upload thread join.
    */
   virtual void Join() = 0;
+
+  /**
+   * Stop upload thread, then upload all files and wait.
+   *
+   * Files in consume dir must be sealed by caller, used by backfill.
+   *
+   * @returns True if all files uploaded; false otherwise.
+   */
+  virtual bool Flush() = 0;
+
+  /**
+   * Close all open files of topic, called after consume stopped.
+   *
+   * Files are uploaded after restart.
+   */
+  virtual void Close() = 0;
+
+  /**
+   * Add upload of sink, started, stopped and joined with this upload.
+   *
+   * Sealed files are hard linked to consume dir of every sink, each
+   * sink uploads its links with its own journal.
+   */
+  virtual void AddSink(std::unique_ptr<Upload> sink) = 0;
 };
 
 }   // namespace log2hdfs
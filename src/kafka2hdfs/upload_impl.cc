@@ -2,9 +2,15 @@
 
 #include "kafka2hdfs/upload_impl.h"
 #include <unistd.h>
+#include <stdio.h>
+#include <random>
+#include <set>
+#include "kafka2hdfs/done_marker.h"
 #include "kafka2hdfs/hdfs_handle.h"
+#include "kafka2hdfs/manifest.h"
 #include "kafka2hdfs/path_format.h"
 #include "kafka2hdfs/topic_conf.h"
+#include "util/dir_scanner.h"
 #include "util/fp_cache.h"
 #include "util/system_utils.h"
 #include "util/string_utils.h"
@@ -12,16 +18,18 @@
 
 namespace log2hdfs {
 
-namespace {
+// Flush retry rounds for failed uploads
+#define FLUSH_MAX_ROUNDS 5
+// Hdfs dir of uploading files, under dir of hdfs path
+#define UPLOAD_TEMP_DIR "_tmp"
 
-int scandir_filter(const struct dirent *dep) {
-  if (strncmp(dep->d_name, ".", 1) == 0)
-    return 0;
-  return 1;
-}
+namespace {
 
-int scandir_compar(const struct dirent **a, const struct dirent **b) {
-  return strcmp((*a)->d_name, (*b)->d_name);
+std::string RandomId() {
+  std::random_device rd;
+  char buf[33];
+  snprintf(buf, sizeof(buf), "%08x%08x%08x%08x", rd(), rd(), rd(), rd());
+  return buf;
 }
 
 time_t GetZeroTs(time_t ts) {
@@ -33,19 +41,20 @@ time_t GetZeroTs(time_t ts) {
   return mktime(&tm);
 }
 
-void ScandirAndPushQueue(const std::string& dir, Queue<std::string>* que) {
-  std::vector<std::string> names;
-  if (!ScanDir(dir, scandir_filter, scandir_compar, &names)) {
-    LOG(WARNING) << "ScandirAndPushQueue ScanDir[" << dir << "] failed "
+void ScandirAndPushQueue(const std::string& dir, Queue<UploadTask>* que) {
+  std::vector<DirEntry> entries;
+  if (!DirScanner::Scan(dir, DirScanner::kSkipHidden | DirScanner::kSort,
+                        &entries)) {
+    LOG(WARNING) << "ScandirAndPushQueue Scan[" << dir << "] failed "
                  << "with errno[" << errno << "]";
   } else {
-    for (auto& name : names) {
-      std::string path = dir + "/" + name;
-      if (!IsFile(path))
+    for (auto& entry : entries) {
+      if (!entry.IsFile())
         continue;
 
+      std::string path = dir + "/" + entry.name;
       LOG(INFO) << "ScandirAndPushQueue Push file[" << path << "] success";
-      que->Push(path);
+      que->Push(UploadTask(path));
     }
   }
 }
@@ -101,30 +110,55 @@ std::unique_ptr<Upload> Upload::Init(
     std::shared_ptr<TopicConf> conf,
     std::shared_ptr<PathFormat> format,
     std::shared_ptr<FpCache> fp_cache,
-    std::shared_ptr<HdfsHandle> handle) {
+    std::shared_ptr<HdfsHandle> handle,
+    std::shared_ptr<Manifest> manifest,
+    std::shared_ptr<DoneMarker> marker) {
+  std::unique_ptr<UploadImpl> res;
+  std::string journal_path = conf->journal_path();
   Upload::Type type = conf->upload_type();
   switch (type) {
     case kText:
-      return TextUploadImpl::Init(std::move(conf), std::move(format),
-                 std::move(fp_cache), std::move(handle));
+      res = TextUploadImpl::Init(std::move(conf), std::move(format),
+                std::move(fp_cache), std::move(handle));
+      break;
     case kLzo:
-      return LzoUploadImpl::Init(std::move(conf), std::move(format),
-                 std::move(fp_cache), std::move(handle));
+      res = LzoUploadImpl::Init(std::move(conf), std::move(format),
+                std::move(fp_cache), std::move(handle));
+      break;
     case kOrc:
-      return OrcUploadImpl::Init(std::move(conf), std::move(format),
-                 std::move(fp_cache), std::move(handle));
+      res = OrcUploadImpl::Init(std::move(conf), std::move(format),
+                std::move(fp_cache), std::move(handle));
+      break;
     case kCompress:
-      return CompressUploadImpl::Init(std::move(conf), std::move(format),
-                 std::move(fp_cache), std::move(handle));
+      res = CompressUploadImpl::Init(std::move(conf), std::move(format),
+                std::move(fp_cache), std::move(handle));
+      break;
     case kAppendCvt:
-      return AppendCvtUploadImpl::Init(std::move(conf), std::move(format),
-                 std::move(fp_cache), std::move(handle));
+      res = AppendCvtUploadImpl::Init(std::move(conf), std::move(format),
+                std::move(fp_cache), std::move(handle));
+      break;
     case kTextNoUpload:
-      return TextNoUploadImpl::Init(std::move(conf), std::move(format),
-                 std::move(fp_cache), std::move(handle));
+      res = TextNoUploadImpl::Init(std::move(conf), std::move(format),
+                std::move(fp_cache), std::move(handle));
+      break;
     default:
       return nullptr;
   }
+
+  if (!res)
+    return nullptr;
+
+  std::shared_ptr<StateJournal> journal = StateJournal::Init(journal_path);
+  if (!journal) {
+    LOG(ERROR) << "Upload Init StateJournal Init path[" << journal_path
+               << "] failed";
+    return nullptr;
+  }
+
+  res->SetManifest(std::move(manifest));
+  res->SetJournal(std::move(journal));
+  res->SetDoneMarker(std::move(marker));
+  return std::move(res);
 }
 
 // ------------------------------------------------------------------
@@ -135,48 +169,60 @@ void UploadImpl::StartInternal() {
 
   Remedy();
 
-  std::vector<std::string> names;
+  std::vector<DirEntry> entries;
   while (!stop_.load()) {
     sleep(conf_->upload_interval());
-    names.clear();
 
-    if (!ScanDir(consume_dir_, scandir_filter, scandir_compar, &names)) {
-      LOG(WARNING) << "UploadImpl StartInternal ScanDir[" << consume_dir_
+    // taken before scan, files staged earlier are listed
+    time_t watermark = marker_ ? marker_->Watermark() : 0;
+    if (!DirScanner::Scan(consume_dir_,
+            DirScanner::kSkipHidden | DirScanner::kSort | DirScanner::kStat,
+            &entries)) {
+      LOG(WARNING) << "UploadImpl StartInternal Scan[" << consume_dir_
                    << "] failed with errno[" << errno << "]";
       continue;
     }
 
-    for (auto& name : names) {
-      std::string path = consume_dir_ + "/" + name;
-      if (!IsFile(path))
+    for (auto& entry : entries) {
+      if (!entry.IsFile() || !entry.has_stat)
         continue;
-    
-      if (format_->WriteFinished(path)) {
-        // Get fp cache key
-        auto end = name.rfind(".");
-        if (end == std::string::npos) {
-          LOG(WARNING) << "UploadImpl StartInternal invalid path["
-                       << path << "]";
-          continue;
-        }
 
-        // Remove from fp cache
-        FpCache::RemoveResult res = fp_cache_->Remove(
-            name.substr(0, end), path);
-        if (res == FpCache::kRemoveFailed) {
-          LOG(ERROR) << "UploadImpl StartInternal fp_cache Remove["
-                     << path << "] failed";
-          continue;
-        } else if (res == FpCache::kInvalidKey) {
-          LOG(WARNING) << "UploadImpl StartInternal fp_cache Remove["
-                       << path << "] invalid key";
-        } else {
-          LOG(INFO) << "UploadImpl StartInternal fp_cache Remove["
-                    << path << "] success";
+      const std::string& name = entry.name;
+      std::string path = consume_dir_ + "/" + name;
+      if (sink_ || format_->WriteFinished(path, entry.st)) {
+        if (!sink_) {
+          // Get fp cache key
+          auto end = name.rfind(".");
+          if (end == std::string::npos) {
+            LOG(WARNING) << "UploadImpl StartInternal invalid path["
+                         << path << "]";
+            continue;
+          }
+
+          // Remove from fp cache
+          FpCache::RemoveResult res = fp_cache_->Remove(
+              name.substr(0, end), path);
+          if (res == FpCache::kRemoveFailed) {
+            LOG(ERROR) << "UploadImpl StartInternal fp_cache Remove["
+                       << path << "] failed";
+            continue;
+          } else if (res == FpCache::kInvalidKey) {
+            LOG(WARNING) << "UploadImpl StartInternal fp_cache Remove["
+                         << path << "] invalid key";
+          } else {
+            LOG(INFO) << "UploadImpl StartInternal fp_cache Remove["
+                      << path << "] success";
+          }
         }
 
+        if (manifest_)
+          manifest_->Seal(path);
+        LinkSinks(path);
+
         // Rename to compress dir
         std::string new_path = compress_dir_ + "/" + name;
+        if (journal_)
+          journal_->Sealed(path, new_path, entry.st.st_size);
         if (!Rename(path, new_path)) {
           LOG(WARNING) << "UploadImpl StartInternal Rename from[" << path
                        << "] to [" << new_path << "] failed with errno["
@@ -185,47 +231,261 @@ void UploadImpl::StartInternal() {
         }
 
         // push new path to compress queue
-        compress_queue_.Push(new_path);
+        compress_queue_.Push(UploadTask(new_path));
       }
     
     }
 
     Compress();
     Upload();
+
+    if (manifest_)
+      manifest_->Prune();
+
+    if (marker_)
+      MarkDone(watermark, entries);
   }
 
   LOG(INFO) << "UploadImpl topic[" << topic_ << "] thread existing";
 }
 
+bool UploadImpl::Flush() {
+  // Join stops scan thread only, tasks of its last round must finish
+  // before Remedy queues their files again
+  Join();
+  WaitIdle();
+
+  // files sealed by caller, need not wait WriteFinished
+  std::vector<DirEntry> entries;
+  if (!DirScanner::Scan(consume_dir_,
+          DirScanner::kSkipHidden | DirScanner::kSort, &entries)) {
+    LOG(WARNING) << "UploadImpl Flush Scan[" << consume_dir_
+                 << "] failed with errno[" << errno << "]";
+    return false;
+  }
+
+  for (auto& entry : entries) {
+    if (!entry.IsFile())
+      continue;
+
+    std::string path = consume_dir_ + "/" + entry.name;
+    if (manifest_)
+      manifest_->Seal(path);
+    LinkSinks(path);
+
+    std::string new_path = compress_dir_ + "/" + entry.name;
+    if (journal_)
+      journal_->Sealed(path, new_path, FileSize(path));
+    if (!Rename(path, new_path)) {
+      LOG(WARNING) << "UploadImpl Flush Rename from[" << path << "] to ["
+                   << new_path << "] failed with errno[" << errno << "]";
+    }
+  }
+  Remedy();
+
+  for (int i = 0; i < FLUSH_MAX_ROUNDS; ++i) {
+    Compress();
+    WaitIdle();
+    Upload();
+    WaitIdle();
+    if (compress_queue_.Empty() && upload_queue_.Empty()) {
+      LOG(INFO) << "UploadImpl Flush topic[" << topic_ << "] success";
+      return true;
+    }
+
+    // failed uploads pushed back to upload queue
+    sleep(conf_->upload_interval());
+  }
+
+  LOG(WARNING) << "UploadImpl Flush topic[" << topic_ << "] failed after "
+               << FLUSH_MAX_ROUNDS << " rounds";
+  return false;
+}
+
+void UploadImpl::Close() {
+  // consume stopped, files closed once erased from cache
+  std::vector<std::string> paths = fp_cache_->CloseAll();
+  for (auto& path : paths) {
+    if (manifest_)
+      manifest_->Seal(path);
+  }
+  LOG(INFO) << "UploadImpl Close topic[" << topic_ << "] closed files["
+            << paths.size() << "]";
+}
+
+void UploadImpl::LinkSinks(const std::string& path) {
+  std::string name = BaseName(path);
+  for (auto& sink : conf_->sinks()) {
+    // linked before crash if exists
+    std::string sink_path = sink->consume_dir() + "/" + name;
+    if (!Link(path, sink_path) && errno != EEXIST) {
+      LOG(ERROR) << "UploadImpl LinkSinks Link from[" << path << "] to ["
+                 << sink_path << "] failed with errno[" << errno << "]";
+    }
+  }
+}
+
 void UploadImpl::Remedy() {
+  if (journal_ && journal_->Loaded()) {
+    std::vector<StateJournal::Entry> entries = journal_->Pending();
+    // sources left are not completely compressed
+    std::set<std::string> sources;
+    for (auto& entry : entries) {
+      if (entry.state == StateJournal::kSealed && IsFile(entry.path))
+        sources.insert(entry.path);
+    }
+
+    for (auto& entry : entries) {
+      if (entry.state == StateJournal::kCompressed &&
+              sources.find(entry.source) != sources.end()) {
+        LOG(WARNING) << "UploadImpl Remedy drop path[" << entry.path
+                     << "] of incomplete source[" << entry.source << "]";
+        if (IsFile(entry.path) && !RmFile(entry.path)) {
+          LOG(WARNING) << "UploadImpl Remedy RmFile[" << entry.path
+                       << "] failed with errno[" << errno << "]";
+        }
+        journal_->Deleted(entry.path);
+        continue;
+      }
+      Resume(entry);
+    }
+    LOG(INFO) << "UploadImpl Remedy topic[" << topic_ << "] resumed["
+              << entries.size() << "] from journal";
+    return;
+  }
+
+  // no journal yet, files found are recorded for next startup
   ScandirAndPushQueue(compress_dir_, &compress_queue_);
   ScandirAndPushQueue(upload_dir_, &upload_queue_);
+  if (journal_) {
+    UploadTask task;
+    std::vector<UploadTask> tasks;
+    while (compress_queue_.TryPop(&task)) {
+      journal_->Sealed("", task.path, FileSize(task.path));
+      tasks.push_back(std::move(task));
+    }
+    for (auto& t : tasks)
+      compress_queue_.Push(std::move(t));
+
+    tasks.clear();
+    while (upload_queue_.TryPop(&task)) {
+      journal_->Compressed("", task.path, FileSize(task.path));
+      tasks.push_back(std::move(task));
+    }
+    for (auto& t : tasks)
+      upload_queue_.Push(std::move(t));
+  }
+}
+
+void UploadImpl::MarkDone(time_t watermark,
+                          const std::vector<DirEntry>& entries) {
+  // files moved out of consume dir are pending in journal
+  std::vector<std::string> pending;
+  for (auto& entry : entries)
+    pending.push_back(entry.name);
+  if (journal_) {
+    for (auto& entry : journal_->Pending())
+      pending.push_back(BaseName(entry.path));
+  }
+  marker_->Mark(watermark, pending, *handle_);
+}
+
+void UploadImpl::Resume(const StateJournal::Entry& entry) {
+  const std::string& path = entry.path;
+  switch (entry.state) {
+    case StateJournal::kSealed:
+      if (!IsFile(path)) {
+        // rename to compress dir not happened, or source moved to
+        // upload dir as last output
+        LOG(WARNING) << "UploadImpl Resume sealed path[" << path
+                     << "] not exists";
+        journal_->Deleted(path);
+      } else {
+        compress_queue_.Push(UploadTask(path));
+      }
+      break;
+    case StateJournal::kCompressed:
+      if (IsFile(path) && FileSize(path) == entry.size) {
+        upload_queue_.Push(UploadTask(path));
+      } else if (!entry.source.empty() && IsFile(entry.source)) {
+        // compressed file incomplete, compress again
+        LOG(WARNING) << "UploadImpl Resume compressed path[" << path
+                     << "] size mismatch, compress source["
+                     << entry.source << "] again";
+        journal_->Sealed("", entry.source, FileSize(entry.source));
+        compress_queue_.Push(UploadTask(entry.source));
+      } else if (IsFile(path)) {
+        LOG(WARNING) << "UploadImpl Resume compressed path[" << path
+                     << "] size mismatch without source";
+        upload_queue_.Push(UploadTask(path));
+      } else {
+        LOG(WARNING) << "UploadImpl Resume compressed path[" << path
+                     << "] not exists";
+        journal_->Deleted(path);
+      }
+      break;
+    case StateJournal::kUploading:
+      // put or rename interrupted, temp file is stale. A missing temp
+      // does not prove the rename, hdfs path might be written by
+      // another file, upload again.
+      if (handle_->Exists(entry.hdfs_path) &&
+              !handle_->Delete(entry.hdfs_path)) {
+        LOG(WARNING) << "UploadImpl Resume Delete stale temp["
+                     << entry.hdfs_path << "] failed";
+      }
+
+      if (IsFile(path)) {
+        upload_queue_.Push(UploadTask(path));
+      } else {
+        journal_->Deleted(path);
+      }
+      break;
+    case StateJournal::kRenamed: {
+      std::string name = BaseName(path);
+      LOG(INFO) << "UploadImpl Resume path[" << path << "] renamed to["
+                << entry.hdfs_path << "] before restart";
+      journal_->Uploaded(path, entry.hdfs_path, entry.size);
+      if (manifest_)
+        manifest_->MarkUploaded(name);
+      if (marker_)
+        marker_->Uploaded(name, entry.hdfs_path);
+      FinishUpload(path, entry.hdfs_path, NeedIndex());
+      break;
+    }
+    case StateJournal::kUploaded:
+      FinishUpload(path, entry.hdfs_path, NeedIndex());
+      break;
+    case StateJournal::kIndexed:
+      FinishUpload(path, entry.hdfs_path, false);
+      break;
+    default:
+      break;
+  }
 }
 
-void UploadImpl::UploadFile(const std::string& path, bool append,
+void UploadImpl::UploadFile(const UploadTask& task, bool append,
                             bool index, bool delay) {
-  if (path.empty()) {
+  const std::string& file_path = task.path;
+  if (file_path.empty()) {
     LOG(WARNING) << "UploadImpl UploadPath topic[" << topic_
                  << "] empty path";
     return;
   }
 
-  size_t found = path.find(":");
-  int times = 0;
-  std::string file_path;
-  if (found != std::string::npos) {
-    times = atoi(path.substr(found + 1).c_str());
-    file_path = path.substr(0, found);
-  } else {
-    file_path = path;
-  }
-
+  int times = task.attempt;
   if (!IsFile(file_path)) {
     LOG(WARNING) << "UploadImpl UploadPath invalid path[" << file_path << "]";
     return;
   }
 
   std::string name = BaseName(file_path);
+  if (manifest_ && manifest_->Uploaded(name)) {
+    LOG(INFO) << "UploadImpl UploadPath[" << file_path << "] ranges "
+              << "already uploaded, dropped";
+    FinishUpload(file_path, "", false);
+    return;
+  }
+
   std::string hdfs_path;
   if (!format_->BuildHdfsPath(name, &hdfs_path, delay)) {
     LOG(WARNING) << "UploadImpl UploadPath BuildHdfsPath[" << file_path
@@ -233,56 +493,100 @@ void UploadImpl::UploadFile(const std::string& path, bool append,
     return;
   }
 
-  if (times > 0) {
-    auto end = hdfs_path.rfind('.');
-    if (end == std::string::npos) {
-      hdfs_path += "." + std::to_string(times);
-    } else {
-      std::string temp_path = hdfs_path.substr(0, end) +
-          std::to_string(times) + hdfs_path.substr(end);
-      hdfs_path = std::move(temp_path);
-    }
-  }
-
+  off_t size = FileSize(file_path);
   bool res;
   if (handle_->Exists(hdfs_path)) {
     if (append) {
+      // hdfs append can not be renamed into place
       res = handle_->Append(file_path, hdfs_path);
     } else {
+      // renames completed before restart are resumed from journal
       LOG(WARNING) << "UploadImpl UploadFile file_path[" << file_path
                    << "] hdfs path[" << hdfs_path << "] already exists";
       return;
     }
   } else {
-    std::string dir = DirName(hdfs_path);
-    if (!handle_->CreateDirectory(dir)) {
-      LOG(WARNING) << "UploadImpl UploadPath CreateDirectory[" << dir
-                   << "] failed";
-      return;
-    } else {
-      res = handle_->Put(file_path, hdfs_path);
-    }
+    res = PutTemp(file_path, hdfs_path, size);
   }
 
   if (!res) {
     LOG(WARNING) << "UploadImpl UploadPath[" << file_path << "] to["
-                 << hdfs_path << "] failed retry";
-    ++times;
-    upload_queue_.Push(file_path + ":" + std::to_string(times));
+                 << hdfs_path << "] failed retry attempt[" << times + 1
+                 << "]";
+    upload_queue_.Push(UploadTask(file_path, times + 1));
   } else {
-    if (!RmFile(file_path)) {
-      LOG(WARNING) << "UploadImpl UploadPath RmFile[" << file_path
+    if (journal_)
+      journal_->Uploaded(file_path, hdfs_path, size);
+    if (manifest_)
+      manifest_->MarkUploaded(name);
+    if (marker_)
+      marker_->Uploaded(name, hdfs_path);
+
+    FinishUpload(file_path, hdfs_path, index);
+
+    LOG(INFO) << "UploadImpl UploadPath[" << file_path << "] to["
+              << hdfs_path << "] success queue delay["
+              << (NowMicros() - task.enqueue_us) / 1000 << "ms]";
+  }
+}
+
+bool UploadImpl::PutTemp(const std::string& path,
+                         const std::string& hdfs_path, off_t size) {
+  std::string temp_dir = DirName(hdfs_path) + "/" + UPLOAD_TEMP_DIR;
+  if (!handle_->CreateDirectory(temp_dir)) {
+    LOG(WARNING) << "UploadImpl PutTemp CreateDirectory[" << temp_dir
+                 << "] failed";
+    return false;
+  }
+
+  std::string temp_path = temp_dir + "/" + BaseName(hdfs_path) + "." +
+      RandomId();
+  if (journal_)
+    journal_->Uploading(path, temp_path, size);
+
+  // back to compressed before temp deleted, a missing temp of an
+  // uploading file is never taken as renamed
+  if (!handle_->Put(path, temp_path)) {
+    if (journal_)
+      journal_->Compressed("", path, size);
+    handle_->Delete(temp_path);
+    return false;
+  }
+
+  if (!handle_->Rename(temp_path, hdfs_path)) {
+    LOG(WARNING) << "UploadImpl PutTemp Rename from[" << temp_path
+                 << "] to[" << hdfs_path << "] failed";
+    if (journal_)
+      journal_->Compressed("", path, size);
+    handle_->Delete(temp_path);
+    return false;
+  }
+
+  if (journal_)
+    journal_->Renamed(path, hdfs_path, size);
+  return true;
+}
+
+void UploadImpl::FinishUpload(const std::string& path,
+                              const std::string& hdfs_path, bool index) {
+  if (index) {
+    sleep(3);
+    if (!handle_->LZOIndex(hdfs_path)) {
+      LOG(WARNING) << "UploadImpl FinishUpload LZOIndex[" << hdfs_path
                    << "] failed";
+    } else if (journal_) {
+      journal_->Indexed(path);
     }
-    
-    if (index) {
-      sleep(3);
-      handle_->LZOIndex(hdfs_path);
-    }
+  }
 
-    LOG(INFO) << "UploadImpl UploadPath[" << file_path << "] to["
-              << hdfs_path << "] success";
+  if (IsFile(path) && !RmFile(path)) {
+    LOG(WARNING) << "UploadImpl FinishUpload RmFile[" << path
+                 << "] failed";
+    return;
   }
+
+  if (journal_)
+    journal_->Deleted(path);
 }
 
 // ------------------------------------------------------------------
@@ -309,8 +613,9 @@ std::unique_ptr<TextUploadImpl> TextUploadImpl::Init(
 }
 
 void TextUploadImpl::Compress() {
-  std::string path;
-  while (compress_queue_.TryPop(&path)) {
+  UploadTask task;
+  while (compress_queue_.TryPop(&task)) {
+    const std::string& path = task.path;
     std::string name = BaseName(path);
     if (name.empty()) {
       LOG(WARNING) << "TextUploadImpl Compress empty path";
@@ -319,6 +624,8 @@ void TextUploadImpl::Compress() {
 
     // Rename to upload dir
     std::string new_path = upload_dir_ + "/" + name;
+    if (journal_)
+      journal_->Compressed(path, new_path, FileSize(path));
     if (!Rename(path, new_path)) {
       LOG(WARNING) << "TextUploadImpl Compress Rename from["
                    << path << "] to [" << new_path << "] failed "
@@ -326,16 +633,18 @@ void TextUploadImpl::Compress() {
       continue;
     }
 
-    upload_queue_.Push(new_path);
+    if (journal_)
+      journal_->Deleted(path);
+    upload_queue_.Push(UploadTask(new_path));
   }
 }
 
 void TextUploadImpl::Upload() {
-  std::string path;
-  while (upload_queue_.TryPop(&path)) {
-    pool_.Enqueue([this](const std::string p) {
-                    this->UploadFile(p, true, false);
-                  }, path);
+  UploadTask task;
+  while (upload_queue_.TryPop(&task)) {
+    pool_.Enqueue([this](const UploadTask t) {
+                    this->UploadFile(t, true, false);
+                  }, task);
   }
 }
 
@@ -369,8 +678,9 @@ std::unique_ptr<LzoUploadImpl> LzoUploadImpl::Init(
 }
 
 void LzoUploadImpl::Compress() {
-  std::string path;
-  while (compress_queue_.TryPop(&path)) {
+  UploadTask task;
+  while (compress_queue_.TryPop(&task)) {
+    const std::string& path = task.path;
     std::string name = BaseName(path);
     if (name.empty()) {
       LOG(WARNING) << "LzoUploadImpl Compress empty path";
@@ -410,6 +720,8 @@ void LzoUploadImpl::CompressFile(const std::string& path) {
   }
 
   std::string new_path = upload_dir_ + "/" + BaseName(old_path);
+  if (journal_)
+    journal_->Compressed(path, new_path, FileSize(old_path));
   if (!Rename(old_path, new_path)) {
     LOG(ERROR) << "LzoUploadImpl CompressFile Rename from[" << old_path
                << "] to[" << new_path << "] failed with errno[" << errno
@@ -417,15 +729,17 @@ void LzoUploadImpl::CompressFile(const std::string& path) {
     return;
   }
 
-  upload_queue_.Push(new_path);
+  if (journal_)
+    journal_->Deleted(path);
+  upload_queue_.Push(UploadTask(new_path));
 }
 
 void LzoUploadImpl::Upload() {
-  std::string path;
-  while (upload_queue_.TryPop(&path)) {
-    pool_.Enqueue([this](const std::string p) {
-                    this->UploadFile(p, false, true);
-                  }, path);
+  UploadTask task;
+  while (upload_queue_.TryPop(&task)) {
+    pool_.Enqueue([this](const UploadTask t) {
+                    this->UploadFile(t, false, true);
+                  }, task);
   }
 }
 
@@ -459,8 +773,9 @@ std::unique_ptr<OrcUploadImpl> OrcUploadImpl::Init(
 }
 
 void OrcUploadImpl::Compress() {
-  std::string path;
-  while (compress_queue_.TryPop(&path)) {
+  UploadTask task;
+  while (compress_queue_.TryPop(&task)) {
+    const std::string& path = task.path;
     std::string name = BaseName(path);
     if (name.empty()) {
       LOG(WARNING) << "OrcUploadImpl Compress empty path";
@@ -500,6 +815,8 @@ void OrcUploadImpl::CompressFile(const std::string& path) {
   }
 
   std::string new_path = upload_dir_ + "/" + BaseName(old_path);
+  if (journal_)
+    journal_->Compressed(path, new_path, FileSize(old_path));
   if (!Rename(old_path, new_path)) {
     LOG(ERROR) << "OrcUploadImpl CompressFile Rename from[" << old_path
                << "] to[" << new_path << "] failed with errno[" << errno
@@ -507,15 +824,17 @@ void OrcUploadImpl::CompressFile(const std::string& path) {
     return;
   }
 
-  upload_queue_.Push(new_path);
+  if (journal_)
+    journal_->Deleted(path);
+  upload_queue_.Push(UploadTask(new_path));
 }
 
 void OrcUploadImpl::Upload() {
-  std::string path;
-  while (upload_queue_.TryPop(&path)) {
-    pool_.Enqueue([this](const std::string p) {
-                    this->UploadFile(p, false, false);
-                  }, path);
+  UploadTask task;
+  while (upload_queue_.TryPop(&task)) {
+    pool_.Enqueue([this](const UploadTask t) {
+                    this->UploadFile(t, false, false);
+                  }, task);
   }
 }
 
@@ -551,8 +870,9 @@ std::unique_ptr<CompressUploadImpl> CompressUploadImpl::Init(
 void CompressUploadImpl::Compress() {
   std::string mv_path = conf_->compress_mv();
 
-  std::string path;
-  while (compress_queue_.TryPop(&path)) {
+  UploadTask task;
+  while (compress_queue_.TryPop(&task)) {
+    const std::string& path = task.path;
     std::string name = BaseName(path);
     if (name.empty()) {
       LOG(WARNING) << "CompressUploadImpl Compress empty path";
@@ -569,37 +889,47 @@ void CompressUploadImpl::Compress() {
                    << errno << "]";
       continue;
     }
+
+    // compressed by external command into compress dir
+    if (journal_)
+      journal_->Deleted(path);
   }
 
-  std::vector<std::string> names;
-  if (!ScanDir(compress_dir_, scandir_filter, scandir_compar, &names)) {
-    LOG(ERROR) << "CompressUploadImpl StartInternal ScanDir compres_dir["
+  std::vector<DirEntry> entries;
+  if (!DirScanner::Scan(compress_dir_,
+          DirScanner::kSkipHidden | DirScanner::kSort, &entries)) {
+    LOG(ERROR) << "CompressUploadImpl StartInternal Scan compres_dir["
                << compress_dir_ << "] failed with errno[" << errno << "]";
     return;
   }
 
-  for (auto& name : names) {
+  for (auto& entry : entries) {
+    const std::string& name = entry.name;
     if (!EndsWith(name, ".orc"))
       continue;
 
     std::string old_path = compress_dir_ + "/" + name;
     std::string new_path = upload_dir_ + "/" + name;
+    if (journal_)
+      journal_->Compressed(old_path, new_path, FileSize(old_path));
     if (!Rename(old_path, new_path)) {
       LOG(WARNING) << "CompressUploadImpl Compress Rename from[" << old_path
                    << "] to[" << new_path << "] failed with errno["
                    << errno << "]";
       continue;
     }
-    upload_queue_.Push(new_path);
+    if (journal_)
+      journal_->Deleted(old_path);
+    upload_queue_.Push(UploadTask(new_path));
   }
 }
 
 void CompressUploadImpl::Upload() {
-  std::string path;
-  while (upload_queue_.TryPop(&path)) {
-    pool_.Enqueue([this](const std::string p) {
-                    this->UploadFile(p, false, false);
-                  }, path);
+  UploadTask task;
+  while (upload_queue_.TryPop(&task)) {
+    pool_.Enqueue([this](const UploadTask t) {
+                    this->UploadFile(t, false, false);
+                  }, task);
   }
 }
 
@@ -670,8 +1000,9 @@ void AppendCvtUploadImpl::Compress() {
     LOG(INFO) << "AppendCvtUploadImpl Compress sleep 200s end";
   }
 
-  std::string path;
-  while (compress_queue_.TryPop(&path)) {
+  UploadTask task;
+  while (compress_queue_.TryPop(&task)) {
+    const std::string& path = task.path;
     std::string name = BaseName(path);
     if (name.empty()) {
       LOG(WARNING) << "AppendCvtUploadImpl Compress empty path";
@@ -684,6 +1015,8 @@ void AppendCvtUploadImpl::Compress() {
                     }, path);
     } else {
       std::string new_path = upload_dir_ + "/" + name;
+      if (journal_)
+        journal_->Compressed(path, new_path, FileSize(path));
       if (!Rename(path, new_path)) {
         LOG(WARNING) << "AppendCvtUploadImpl Compress Rename from["
                      << path << "] to [" << new_path << "] failed "
@@ -691,7 +1024,9 @@ void AppendCvtUploadImpl::Compress() {
         continue;
       }
 
-      upload_queue_.Push(new_path);
+      if (journal_)
+        journal_->Deleted(path);
+      upload_queue_.Push(UploadTask(new_path));
     }
   }
 }
@@ -721,6 +1056,8 @@ void AppendCvtUploadImpl::CompressFile(const std::string& path) {
   }
 
   std::string new_path = upload_dir_ + "/" + BaseName(old_path);
+  if (journal_)
+    journal_->Compressed(path, new_path, FileSize(old_path));
   if (!Rename(old_path, new_path)) {
     LOG(ERROR) << "AppendCvtUploadImpl CompressFile Rename from[" << old_path
                << "] to[" << new_path << "] failed with errno[" << errno
@@ -728,27 +1065,33 @@ void AppendCvtUploadImpl::CompressFile(const std::string& path) {
   }
 
   std::string new_path2 = upload_dir_ + "/" + BaseName(path);
+  if (journal_)
+    journal_->Compressed(path, new_path2, FileSize(path));
   if (!Rename(path, new_path2)) {
     LOG(ERROR) << "AppendCvtUploadImpl CompressFile Rename from[" << path
                << "] to[" << new_path2 << "] failed with errno[" << errno
                << "]";
+    return;
   }
 
-  upload_queue_.Push(new_path);
-  upload_queue_.Push(new_path2);
+  // both outputs recorded, source left pipeline
+  if (journal_)
+    journal_->Deleted(path);
+  upload_queue_.Push(UploadTask(new_path));
+  upload_queue_.Push(UploadTask(new_path2));
 }
 
 void AppendCvtUploadImpl::Upload() {
-  std::string path;
-  while (upload_queue_.TryPop(&path)) {
-    if (EndsWith(path, ".append")) {
-      pool_.Enqueue([this](const std::string p) {
-                      this->UploadFile(p, true, false, true);
-                    }, path);
+  UploadTask task;
+  while (upload_queue_.TryPop(&task)) {
+    if (EndsWith(task.path, ".append")) {
+      pool_.Enqueue([this](const UploadTask t) {
+                      this->UploadFile(t, true, false, true);
+                    }, task);
     } else {
-      pool_.Enqueue([this](const std::string p) {
-                      this->UploadFile(p, true, false);
-                    }, path);
+      pool_.Enqueue([this](const UploadTask t) {
+                      this->UploadFile(t, true, false);
+                    }, task);
     }
   }
 }
@@ -777,8 +1120,9 @@ std::unique_ptr<TextNoUploadImpl> TextNoUploadImpl::Init(
 }
 
 void TextNoUploadImpl::Compress() {
-  std::string path;
-  while (compress_queue_.TryPop(&path)) {
+  UploadTask task;
+  while (compress_queue_.TryPop(&task)) {
+    const std::string& path = task.path;
     std::string name = BaseName(path);
     if (name.empty()) {
       LOG(WARNING) << "TextNoUploadImpl Compress empty path";
@@ -792,12 +1136,18 @@ void TextNoUploadImpl::Compress() {
                    << errno << "]";
       continue;
     }
+
+    // never uploaded, keeps manifest dir bounded
+    if (manifest_)
+      manifest_->MarkUploaded(name);
+    if (journal_)
+      journal_->Deleted(path);
   }
 }
 
 void TextNoUploadImpl::Upload() {
-  std::string path;
-  while (upload_queue_.TryPop(&path)) {}
+  UploadTask task;
+  while (upload_queue_.TryPop(&task)) {}
 }
 
 }   // namespace log2hdfs
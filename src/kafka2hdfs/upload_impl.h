@@ -7,12 +7,33 @@
 #include <thread>
 #include <mutex>
 #include <atomic>
+#include <vector>
+#include "kafka2hdfs/state_journal.h"
 #include "kafka2hdfs/topic_conf.h"
+#include "util/dir_scanner.h"
 #include "util/queue.h"
 #include "util/thread_pool.h"
+#include "util/system_utils.h"
 
 namespace log2hdfs {
 
+// ------------------------------------------------------------------
+// UploadTask
+
+/**
+ * File to compress or upload.
+ */
+struct UploadTask {
+  UploadTask(): attempt(0), enqueue_us(0) {}
+
+  explicit UploadTask(std::string p, int a = 0):
+      path(std::move(p)), attempt(a), enqueue_us(NowMicros()) {}
+
+  std::string path;
+  int attempt;
+  int64_t enqueue_us;
+};
+
 // ------------------------------------------------------------------
 // UploadImpl
 
@@ -28,6 +49,7 @@ class UploadImpl : public Upload {
     consume_dir_ = conf_->consume_dir();
     compress_dir_ = conf_->compress_dir();
     upload_dir_ = conf_->upload_dir();
+    sink_ = !conf_->sink().empty();
   }
 
   ~UploadImpl() {
@@ -41,10 +63,14 @@ class UploadImpl : public Upload {
       std::thread t(&UploadImpl::StartInternal, this);
       thread_ = std::move(t);
     }
+    for (auto& sink : sinks_)
+      sink->Start();
   }
 
   void Stop() {
     stop_.store(true);
+    for (auto& sink : sinks_)
+      sink->Stop();
   }
 
   void Join() {
@@ -52,33 +78,87 @@ class UploadImpl : public Upload {
     std::lock_guard<std::mutex> lock(mutex_);
     if (thread_.joinable())
       thread_.join();
+    for (auto& sink : sinks_)
+      sink->Join();
+  }
+
+  bool Flush();
+
+  void Close();
+
+  void SetManifest(std::shared_ptr<Manifest> manifest) {
+    manifest_ = std::move(manifest);
   }
 
+  void SetJournal(std::shared_ptr<StateJournal> journal) {
+    journal_ = std::move(journal);
+  }
+
+  void SetDoneMarker(std::shared_ptr<DoneMarker> marker) {
+    marker_ = std::move(marker);
+  }
+
+  void AddSink(std::unique_ptr<log2hdfs::Upload> sink) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    sinks_.push_back(std::move(sink));
+  }
+
+  // hard link sealed file to consume dir of every sink
+  void LinkSinks(const std::string& path);
+
   virtual void StartInternal();
 
   virtual void Remedy();
 
+  // write done markers, entries are files in consume dir
+  void MarkDone(time_t watermark, const std::vector<DirEntry>& entries);
+
+  // resume pending file of journal
+  virtual void Resume(const StateJournal::Entry& entry);
+
+  // uploaded files need lzo index
+  virtual bool NeedIndex() const {
+    return false;
+  }
+
+  // wait for compress and upload tasks
+  virtual void WaitIdle() {}
+
   virtual void Compress() = 0;
 
   virtual void Upload() = 0;
 
-  virtual void UploadFile(const std::string& path, bool append,
+  virtual void UploadFile(const UploadTask& task, bool append,
                           bool index, bool delay = false);
 
+  // put to temp path under dir of hdfs_path, then rename into place
+  bool PutTemp(const std::string& path, const std::string& hdfs_path,
+               off_t size);
+
+  // index uploaded file if need, then delete local file
+  void FinishUpload(const std::string& path, const std::string& hdfs_path,
+                    bool index);
+
  protected:
   std::shared_ptr<TopicConf> conf_;
   std::shared_ptr<PathFormat> format_;
   std::shared_ptr<FpCache> fp_cache_;
   std::shared_ptr<HdfsHandle> handle_;
+  std::shared_ptr<Manifest> manifest_;
+  std::shared_ptr<StateJournal> journal_;
+  std::shared_ptr<DoneMarker> marker_;
   std::string topic_;
   std::string consume_dir_;
   std::string compress_dir_;
   std::string upload_dir_;
+  // files in consume dir linked by topic upload, sealed already
+  bool sink_;
+  std::vector<std::unique_ptr<log2hdfs::Upload>> sinks_;
   mutable std::mutex mutex_;
   std::thread thread_;
   std::atomic<bool> stop_;
-  Queue<std::string> compress_queue_;
-  Queue<std::string> upload_queue_;
+  Queue<UploadTask> compress_queue_;
+  Queue<UploadTask> upload_queue_;
 };
 
 // ------------------------------------------------------------------
@@ -104,6 +184,10 @@ class TextUploadImpl : public UploadImpl {
 
   void Upload();
 
+  void WaitIdle() {
+    pool_.WaitIdle();
+  }
+
  protected:
   ThreadPool pool_;
 };
@@ -133,6 +217,14 @@ class LzoUploadImpl : public UploadImpl {
 
   void Upload();
 
+  bool NeedIndex() const {
+    return true;
+  }
+
+  void WaitIdle() {
+    pool_.WaitIdle();
+  }
+
  protected:
   ThreadPool pool_;
 };
@@ -162,6 +254,10 @@ class OrcUploadImpl : public UploadImpl {
 
   void Upload();
 
+  void WaitIdle() {
+    pool_.WaitIdle();
+  }
+
  protected:
   ThreadPool pool_;
 };
@@ -189,6 +285,10 @@ class CompressUploadImpl : public UploadImpl {
 
   void Upload();
 
+  void WaitIdle() {
+    pool_.WaitIdle();
+  }
+
  protected:
   ThreadPool pool_;
 };
@@ -220,6 +320,10 @@ class AppendCvtUploadImpl : public UploadImpl {
 
   void Upload();
 
+  void WaitIdle() {
+    pool_.WaitIdle();
+  }
+
  protected:
   ThreadPool pool_;
 };
@@ -0,0 +1,133 @@
+// Copyright (c) 2017 Lanceolata
+
+#include "log2kafka/bulk_ingest.h"
+#include <stdlib.h>
+#include <vector>
+#include "log2kafka/offset_table.h"
+#include "util/configparser.h"
+#include "util/dir_scanner.h"
+#include "util/system_utils.h"
+#include "easylogging++.h"
+
+namespace log2hdfs {
+
+/*
+ * Default configuration
+ */
+#define DEFAULT_BULK_SCAN_THREADS "8"
+
+std::unique_ptr<BulkIngest> BulkIngest::Init(
+    std::shared_ptr<Section> section,
+    const std::string& topic,
+    const std::string& root,
+    std::shared_ptr<Queue<FileRecord>> queue,
+    std::shared_ptr<OffsetTable> table) {
+  if (!section || topic.empty() || root.empty() || !queue || !table) {
+    LOG(ERROR) << "BulkIngest Init invalid parameters";
+    return nullptr;
+  }
+
+  std::string dir = NormalDirPath(root);
+  if (dir.empty() || !IsDir(dir)) {
+    LOG(ERROR) << "BulkIngest Init invalid root[" << root << "]";
+    return nullptr;
+  }
+
+  std::string threads_str = section->Get("bulk.scan.threads",
+                                         DEFAULT_BULK_SCAN_THREADS);
+  int threads = atoi(threads_str.c_str());
+  if (threads <= 0 || threads > 256) {
+    LOG(ERROR) << "BulkIngest Init invalid scan threads[" << threads_str
+               << "]";
+    return nullptr;
+  }
+
+  LOG(INFO) << "BulkIngest Init topic[" << topic << "] root[" << dir
+            << "] scan threads[" << threads << "]";
+  return std::unique_ptr<BulkIngest>(new BulkIngest(
+             topic, dir, threads, std::move(queue),
+             std::move(table)));
+}
+
+void BulkIngest::Start() {
+  std::lock_guard<std::mutex> lock(thread_mutex_);
+  if (thread_.joinable())
+    return;
+
+  stop_.store(false);
+  thread_ = std::thread(&BulkIngest::StartInternal, this);
+}
+
+void BulkIngest::Stop() {
+  stop_.store(true);
+}
+
+void BulkIngest::Join() {
+  std::lock_guard<std::mutex> lock(thread_mutex_);
+  if (thread_.joinable())
+    thread_.join();
+}
+
+void BulkIngest::StartInternal() {
+  LOG(INFO) << "BulkIngest enumerate thread created";
+
+  int topic_id = TopicIds::Intern(topic_);
+  std::vector<std::string> dirs(1, root_);
+  size_t levels = 0;
+  while (!dirs.empty() && !stop_.load()) {
+    std::vector<std::vector<DirEntry>> scanned;
+    size_t ok = DirScanner::ScanAll(dirs,
+        DirScanner::kSkipHidden | DirScanner::kSort | DirScanner::kStat,
+        threads_, &scanned);
+    if (ok < dirs.size()) {
+      LOG(WARNING) << "BulkIngest StartInternal ScanAll level[" << levels
+                   << "] failed dirs[" << dirs.size() - ok << "]";
+    }
+
+    // files of a level are pushed at once, sub dirs scanned next level
+    std::vector<std::string> next;
+    std::vector<FileRecord> records;
+    for (size_t i = 0; i < dirs.size(); ++i) {
+      for (auto& entry : scanned[i]) {
+        std::string inner = dirs[i] + "/" + entry.name;
+        if (entry.IsDir()) {
+          next.push_back(std::move(inner));
+          continue;
+        }
+        if (!entry.IsFile() || !entry.has_stat)
+          continue;
+
+        table_->UpdatePath(entry.st.st_dev, entry.st.st_ino, inner);
+        off_t offset = 0;
+        OffsetTable::FileStatus status = table_->Classify(inner, entry.st,
+                                                          &offset);
+        if (status == OffsetTable::kFileDone) {
+          done_.fetch_add(1);
+          continue;
+        } else if (status != OffsetTable::kFilePartial) {
+          offset = 0;
+        }
+
+        bytes_.fetch_add(entry.st.st_size - offset);
+        records.emplace_back(topic_id, std::move(inner), offset);
+      }
+    }
+
+    if (!records.empty()) {
+      // counted before pushed, never behind acked files
+      submitted_.fetch_add(records.size());
+      queue_->PushN(records.data(), records.size());
+    }
+    LOG(INFO) << "BulkIngest StartInternal level[" << levels << "] dirs["
+              << dirs.size() << "] files[" << records.size() << "]";
+    dirs.swap(next);
+    ++levels;
+  }
+
+  if (dirs.empty())
+    enumerated_.store(true);
+  LOG(INFO) << "BulkIngest enumerate thread existing submitted["
+            << Submitted() << "] done[" << Done() << "]";
+}
+
+}   // namespace log2hdfs
@@ -0,0 +1,131 @@
+// Copyright (c) 2017 Lanceolata
+
+#ifndef LOG2HDFS_LOG2KAFKA_BULK_INGEST_H_
+#define LOG2HDFS_LOG2KAFKA_BULK_INGEST_H_
+
+#include <stdint.h>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include "log2kafka/file_record.h"
+#include "util/queue.h"
+
+namespace log2hdfs {
+
+class OffsetTable;
+class Section;
+
+/**
+ * One shot ingest of a directory tree.
+ *
+ * Enumerate thread walks the tree level by level, dirs of one level are
+ * scanned in parallel. Every regular file not yet done in OffsetTable
+ * is pushed to the produce queue, partial files resume from their
+ * offset, so an interrupted ingest can be run again.
+ */
+class BulkIngest {
+ public:
+  /**
+   * Static function to create a BulkIngest unique_ptr.
+   *
+   * @param section             Ini configuration section
+   * @param topic               topic name
+   * @param root                root dir of the tree
+   * @param queue               produce queue
+   * @param table               offset table
+   *
+   * @returns std::unique_ptr<BulkIngest> if init success,
+   *          nullptr otherwise.
+   */
+  static std::unique_ptr<BulkIngest> Init(
+      std::shared_ptr<Section> section,
+      const std::string& topic,
+      const std::string& root,
+      std::shared_ptr<Queue<FileRecord>> queue,
+      std::shared_ptr<OffsetTable> table);
+
+  /**
+   * Constructor
+   */
+  BulkIngest(const std::string& topic,
+             const std::string& root,
+             size_t threads,
+             std::shared_ptr<Queue<FileRecord>> queue,
+             std::shared_ptr<OffsetTable> table):
+      topic_(topic), root_(root), threads_(threads),
+      queue_(std::move(queue)), table_(std::move(table)), submitted_(0),
+      done_(0), bytes_(0), enumerated_(false), stop_(false) {}
+
+  ~BulkIngest() {
+    Stop();
+    Join();
+  }
+
+  BulkIngest(const BulkIngest& other) = delete;
+  BulkIngest& operator=(const BulkIngest& other) = delete;
+
+  /**
+   * Start enumerate thread.
+   */
+  void Start();
+
+  /**
+   * Stop enumerate thread, files pushed are still produced.
+   */
+  void Stop();
+
+  /**
+   * Join enumerate thread.
+   */
+  void Join();
+
+  /**
+   * @returns True if the whole tree enumerated.
+   */
+  bool Enumerated() const {
+    return enumerated_.load();
+  }
+
+  /**
+   * @returns files pushed to produce queue.
+   */
+  uint64_t Submitted() const {
+    return submitted_.load();
+  }
+
+  /**
+   * @returns files skipped as already done.
+   */
+  uint64_t Done() const {
+    return done_.load();
+  }
+
+  /**
+   * @returns bytes left to produce of files pushed.
+   */
+  uint64_t Bytes() const {
+    return bytes_.load();
+  }
+
+ private:
+  void StartInternal();
+
+  std::string topic_;
+  std::string root_;
+  size_t threads_;
+  std::shared_ptr<Queue<FileRecord>> queue_;
+  std::shared_ptr<OffsetTable> table_;
+  std::atomic<uint64_t> submitted_;
+  std::atomic<uint64_t> done_;
+  std::atomic<uint64_t> bytes_;
+  std::atomic<bool> enumerated_;
+  std::atomic<bool> stop_;
+  std::mutex thread_mutex_;
+  std::thread thread_;
+};
+
+}   // namespace log2hdfs
+
+#endif  // LOG2HDFS_LOG2KAFKA_BULK_INGEST_H_
@@ -0,0 +1,353 @@
+// Copyright (c) 2017 Lanceolata
+
+#include "log2kafka/delivery_tracker.h"
+#include "log2kafka/offset_table.h"
+#include "easylogging++.h"
+
+namespace log2hdfs {
+
+class DeliveryTracker::DirChain {
+ public:
+  DirChain(const std::string& dir, OffsetTable* table,
+           DeliveryTracker* tracker):
+      dir_(dir), table_(table), tracker_(tracker), tail_(false), dev_(0),
+      ino_(0), produced_(0), closed_(false) {}
+
+  DirChain(const std::string& dir, OffsetTable* table,
+           DeliveryTracker* tracker, dev_t dev, ino_t ino):
+      dir_(dir), table_(table), tracker_(tracker), tail_(true), dev_(dev),
+      ino_(ino), produced_(0), closed_(false) {}
+
+  std::string dir_;
+  OffsetTable* table_;
+  DeliveryTracker* tracker_;
+  std::mutex mutex_;
+  // files in produce order, reads in produce order for tails
+  std::deque<FileProgress*> files_;
+  // tail of inode
+  bool tail_;
+  dev_t dev_;
+  ino_t ino_;
+  // offset of last finished read
+  off_t produced_;
+  // rotated tail removed, chain can be released
+  bool closed_;
+};
+
+class DeliveryTracker::FileProgress {
+ public:
+  FileProgress(DirChain* chain, const std::string& file, off_t offset,
+               const OffsetTable::FileIdentity* id):
+      chain_(chain), file_(file), path_(chain->dir_ + "/" + file),
+      watermark_(offset), committed_(offset),
+      id_committed_(-2), end_(-1), finished_(false), final_(false),
+      has_id_(id != NULL) {
+    if (id)
+      id_ = *id;
+  }
+
+  DirChain* chain_;
+  std::string file_;
+  std::string path_;
+  // deque keeps slot addresses valid on push_back and pop_front
+  std::deque<Slot> slots_;
+  off_t watermark_;
+  // dir offset committed
+  off_t committed_;
+  // file identity and its offset committed
+  OffsetTable::FileIdentity id_;
+  off_t id_committed_;
+  // offset read to, watermark once all lines acked, -1 if unknown
+  off_t end_;
+  bool finished_;
+  bool final_;
+  bool has_id_;
+};
+
+namespace {
+
+inline std::string TailKey(dev_t dev, ino_t ino) {
+  return std::to_string(dev) + "\t" + std::to_string(ino);
+}
+
+}   // namespace
+
+std::shared_ptr<DeliveryTracker> DeliveryTracker::Init(
+    std::shared_ptr<OffsetTable> table) {
+  if (!table) {
+    LOG(ERROR) << "DeliveryTracker Init invalid parameters";
+    return nullptr;
+  }
+  return std::make_shared<DeliveryTracker>(std::move(table));
+}
+
+DeliveryTracker::~DeliveryTracker() {
+  // files still in flight are leaked on purpose, their slots might
+  // still be referenced by librdkafka.
+  for (auto& it : chains_) {
+    if (it.second->files_.empty())
+      delete it.second;
+  }
+  for (auto& it : tails_) {
+    if (it.second->files_.empty())
+      delete it.second;
+  }
+}
+
+DeliveryTracker::FileProgress* DeliveryTracker::Begin(
+    const std::string& dir, const std::string& file, off_t offset,
+    const OffsetTable::FileIdentity* id) {
+  DirChain* chain;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = chains_.find(dir);
+    if (it == chains_.end()) {
+      chain = new DirChain(dir, table_.get(), this);
+      chains_[dir] = chain;
+    } else {
+      chain = it->second;
+    }
+  }
+
+  FileProgress* progress = new FileProgress(chain, file, offset, id);
+  std::lock_guard<std::mutex> lock(chain->mutex_);
+  chain->files_.push_back(progress);
+  return progress;
+}
+
+DeliveryTracker::FileProgress* DeliveryTracker::BeginTail(
+    const std::string& dir, const std::string& file, dev_t dev, ino_t ino,
+    off_t offset) {
+  std::string key = TailKey(dev, ino);
+  DirChain* chain = NULL;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = tails_.begin(); it != tails_.end();) {
+      DirChain* tail = it->second;
+      if (it->first == key) {
+        chain = tail;
+        ++it;
+        continue;
+      }
+
+      // rotated tail all acked, lock waits for the last ack to return
+      bool closed;
+      {
+        std::lock_guard<std::mutex> chain_lock(tail->mutex_);
+        closed = tail->closed_ && tail->files_.empty();
+      }
+      if (closed) {
+        delete tail;
+        it = tails_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+
+    if (!chain) {
+      chain = new DirChain(dir, table_.get(), this, dev, ino);
+      tails_[key] = chain;
+    }
+  }
+
+  FileProgress* progress = new FileProgress(chain, file, offset, NULL);
+  std::lock_guard<std::mutex> lock(chain->mutex_);
+  // rotated file appended again
+  chain->closed_ = false;
+  chain->files_.push_back(progress);
+  return progress;
+}
+
+bool DeliveryTracker::TailOffset(dev_t dev, ino_t ino, off_t* offset) {
+  DirChain* chain;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = tails_.find(TailKey(dev, ino));
+    if (it == tails_.end())
+      return false;
+    chain = it->second;
+  }
+
+  std::lock_guard<std::mutex> lock(chain->mutex_);
+  if (chain->files_.empty())
+    return false;
+  *offset = chain->produced_;
+  return true;
+}
+
+DeliveryTracker::Slot* DeliveryTracker::Add(FileProgress* progress,
+                                            off_t end_offset,
+                                            Chunk* chunk) {
+  if (chunk)
+    chunk->refs.fetch_add(1, std::memory_order_relaxed);
+
+  std::lock_guard<std::mutex> lock(progress->chain_->mutex_);
+  Slot slot = { progress, end_offset, chunk, false };
+  progress->slots_.push_back(slot);
+  return &progress->slots_.back();
+}
+
+void DeliveryTracker::Finish(FileProgress* progress) {
+  DirChain* chain = progress->chain_;
+  std::lock_guard<std::mutex> lock(chain->mutex_);
+  progress->finished_ = true;
+  if (progress->slots_.empty())
+    chain->tracker_->files_acked_.fetch_add(1);
+  CommitFile(progress);
+  Commit(chain);
+}
+
+void DeliveryTracker::FinishTail(FileProgress* progress, off_t end,
+                                 bool final) {
+  DirChain* chain = progress->chain_;
+  std::lock_guard<std::mutex> lock(chain->mutex_);
+  progress->finished_ = true;
+  progress->final_ = final;
+  progress->end_ = end;
+  chain->produced_ = end;
+  if (progress->slots_.empty()) {
+    Settle(progress);
+    if (final)
+      chain->tracker_->files_acked_.fetch_add(1);
+  }
+  Commit(chain);
+}
+
+void DeliveryTracker::Ack(void* opaque) {
+  if (!opaque)
+    return;
+
+  Slot* slot = static_cast<Slot*>(opaque);
+  FileProgress* progress = slot->owner;
+  DirChain* chain = progress->chain_;
+  // payload not used after acked, slot popped below
+  Unref(slot->chunk);
+
+  DeliveryTracker* tracker = chain->tracker_;
+  std::lock_guard<std::mutex> lock(chain->mutex_);
+  slot->acked = true;
+  off_t watermark = progress->watermark_;
+  while (!progress->slots_.empty() && progress->slots_.front().acked) {
+    progress->watermark_ = progress->slots_.front().end_offset;
+    progress->slots_.pop_front();
+  }
+  // the last slot of a finished file
+  if (progress->finished_ && progress->slots_.empty()) {
+    Settle(progress);
+    if (!chain->tail_ || progress->final_)
+      tracker->files_acked_.fetch_add(1);
+  }
+  tracker->messages_acked_.fetch_add(1);
+  tracker->bytes_acked_.fetch_add(progress->watermark_ - watermark);
+  CommitFile(progress);
+  Commit(chain);
+}
+
+void DeliveryTracker::Unref(Chunk* chunk) {
+  if (chunk && chunk->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    delete chunk;
+}
+
+DeliveryTracker::Stats DeliveryTracker::GetStats() const {
+  Stats stats;
+  stats.files = files_acked_.load();
+  stats.messages = messages_acked_.load();
+  stats.bytes = bytes_acked_.load();
+  return stats;
+}
+
+void DeliveryTracker::CommitFile(FileProgress* progress) {
+  // every file commits its own offset by identity, not only the oldest
+  // one of its dir
+  if (!progress->has_id_)
+    return;
+
+  off_t offset = progress->watermark_;
+  if (progress->finished_ && progress->slots_.empty())
+    offset = -1;
+  if (offset == progress->id_committed_)
+    return;
+
+  OffsetTable* table = progress->chain_->table_;
+  if (table->UpdateFile(progress->path_, progress->id_, offset)) {
+    progress->id_committed_ = offset;
+  } else {
+    LOG(WARNING) << "DeliveryTracker CommitFile table UpdateFile path["
+                 << progress->path_ << "] offset[" << offset << "] failed";
+  }
+}
+
+void DeliveryTracker::Settle(FileProgress* progress) {
+  // empty lines after the last produced one
+  if (progress->end_ > progress->watermark_)
+    progress->watermark_ = progress->end_;
+}
+
+void DeliveryTracker::CommitTail(DirChain* chain) {
+  // reads of a tail in order, offset advances over acked lines only
+  while (!chain->files_.empty()) {
+    FileProgress* front = chain->files_.front();
+    if (front->watermark_ != front->committed_) {
+      if (chain->table_->UpdateTail(chain->dev_, chain->ino_, front->path_,
+                                    front->watermark_)) {
+        front->committed_ = front->watermark_;
+      } else {
+        LOG(WARNING) << "DeliveryTracker CommitTail table UpdateTail path["
+                     << front->path_ << "] offset[" << front->watermark_
+                     << "] failed";
+      }
+    }
+
+    if (!front->finished_ || !front->slots_.empty())
+      break;
+
+    if (front->final_) {
+      chain->table_->RemoveTail(chain->dev_, chain->ino_);
+      if (!chain->table_->Update(chain->dir_, front->file_, -1)) {
+        LOG(WARNING) << "DeliveryTracker CommitTail table Update dir["
+                     << chain->dir_ << "] file[" << front->file_
+                     << "] offset[-1] failed";
+      }
+      chain->closed_ = true;
+    }
+    chain->files_.pop_front();
+    delete front;
+  }
+}
+
+void DeliveryTracker::Commit(DirChain* chain) {
+  if (chain->tail_) {
+    CommitTail(chain);
+    return;
+  }
+
+  // Only the oldest unfinished file of a dir is committed, a restart
+  // resumes from it and re-produces newer files by ctime.
+  while (!chain->files_.empty()) {
+    FileProgress* front = chain->files_.front();
+    if (front->finished_ && front->slots_.empty()) {
+      if (!chain->table_->Update(chain->dir_, front->file_, -1)) {
+        LOG(WARNING) << "DeliveryTracker Commit table Update dir["
+                     << chain->dir_ << "] file[" << front->file_
+                     << "] offset[-1] failed";
+      }
+      chain->files_.pop_front();
+      delete front;
+      continue;
+    }
+
+    if (front->watermark_ != front->committed_) {
+      if (chain->table_->Update(chain->dir_, front->file_,
+                                front->watermark_)) {
+        front->committed_ = front->watermark_;
+      } else {
+        LOG(WARNING) << "DeliveryTracker Commit table Update dir["
+                     << chain->dir_ << "] file[" << front->file_
+                     << "] offset[" << front->watermark_ << "] failed";
+      }
+    }
+    break;
+  }
+}
+
+}   // namespace log2hdfs
@@ -0,0 +1,207 @@
+// Copyright (c) 2017 Lanceolata
+
+#ifndef LOG2HDFS_LOG2KAFKA_DELIVERY_TRACKER_H_
+#define LOG2HDFS_LOG2KAFKA_DELIVERY_TRACKER_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <deque>
+#include <unordered_map>
+#include "log2kafka/offset_table.h"
+
+namespace log2hdfs {
+
+/**
+ * Track delivery reports and checkpoint acknowledged offsets.
+ *
+ * Every produced line gets a slot holding the byte offset after the
+ * line, the slot is passed to librdkafka as msg_opaque. Delivery reports
+ * mark slots acked, the offset of a file only advances over a
+ * contiguous prefix of acked slots. Lines produced without copy hold a
+ * reference to their read chunk, released when acked. Files of one dir
+ * are committed to OffsetTable in produce order, a file is marked done
+ * (-1) only after all its lines are acked. The acked offset of every
+ * file is also recorded by file identity.
+ *
+ * Tailed files are tracked by inode, every read of a tail is a file
+ * progress of the inode. Tail offsets only advance over acked lines,
+ * a rotated tail is removed and marked done after all lines acked.
+ */
+class DeliveryTracker {
+ public:
+  class DirChain;
+  class FileProgress;
+
+  /**
+   * Acknowledged totals.
+   */
+  struct Stats {
+    Stats(): files(0), messages(0), bytes(0) {}
+
+    // files with all lines acked
+    uint64_t files;
+    uint64_t messages;
+    // bytes of acked lines, newline included
+    uint64_t bytes;
+  };
+
+  /**
+   * Read buffer shared by the lines produced from it without copy,
+   * freed when the reader and all lines released it.
+   */
+  struct Chunk {
+    explicit Chunk(size_t size): data(new char[size]), refs(1) {}
+
+    std::unique_ptr<char[]> data;
+    std::atomic<int> refs;
+  };
+
+  /**
+   * Message slot, passed as msg_opaque.
+   */
+  struct Slot {
+    FileProgress* owner;
+    off_t end_offset;
+    // chunk holding the payload, NULL if payload copied
+    Chunk* chunk;
+    bool acked;
+  };
+
+  /**
+   * Static function to create a DeliveryTracker shared_ptr.
+   *
+   * @param table               offset table
+   *
+   * @returns std::shared_ptr<DeliveryTracker> if init success,
+   *          nullptr otherwise.
+   */
+  static std::shared_ptr<DeliveryTracker> Init(
+      std::shared_ptr<OffsetTable> table);
+
+  /**
+   * Constructor
+   */
+  explicit DeliveryTracker(std::shared_ptr<OffsetTable> table):
+      table_(std::move(table)), files_acked_(0), messages_acked_(0),
+      bytes_acked_(0) {}
+
+  ~DeliveryTracker();
+
+  DeliveryTracker(const DeliveryTracker& other) = delete;
+  DeliveryTracker& operator=(const DeliveryTracker& other) = delete;
+
+  /**
+   * Begin producing a file.
+   *
+   * @param dir                 dir path
+   * @param file                file name
+   * @param offset              start offset
+   * @param id                  file identity, offsets by identity are
+   *                            not committed if NULL
+   *
+   * @returns file progress to pass to Add() and Finish().
+   */
+  FileProgress* Begin(const std::string& dir, const std::string& file,
+                      off_t offset, const OffsetTable::FileIdentity* id);
+
+  /**
+   * Begin producing a read of a tailed file.
+   *
+   * @param dir                 dir path
+   * @param file                file name
+   * @param dev                 device of file
+   * @param ino                 inode of file
+   * @param offset              start offset of read
+   *
+   * @returns file progress to pass to Add() and FinishTail().
+   */
+  FileProgress* BeginTail(const std::string& dir, const std::string& file,
+                          dev_t dev, ino_t ino, off_t offset);
+
+  /**
+   * Offset after the lines of a tailed file produced so far.
+   *
+   * @param dev                 device of file
+   * @param ino                 inode of file
+   * @param offset              offset to set
+   *
+   * @returns True if lines of tail still in flight; false otherwise,
+   *          acked offset is in OffsetTable.
+   */
+  bool TailOffset(dev_t dev, ino_t ino, off_t* offset);
+
+  /**
+   * Add a line to file progress.
+   *
+   * @param progress            file progress
+   * @param end_offset          offset after the line
+   * @param chunk               chunk holding the line, referenced until
+   *                            the slot acked, NULL if line copied
+   *
+   * @returns slot to pass as msg_opaque.
+   */
+  Slot* Add(FileProgress* progress, off_t end_offset,
+            Chunk* chunk = NULL);
+
+  /**
+   * All lines of file added.
+   *
+   * @param progress            file progress, invalid after call
+   */
+  void Finish(FileProgress* progress);
+
+  /**
+   * All lines of a tail read added.
+   *
+   * @param progress            file progress, invalid after call
+   * @param end                 offset read to, lines after it held back
+   * @param final               file rotated, tail removed and file
+   *                            marked done after all lines acked
+   */
+  void FinishTail(FileProgress* progress, off_t end, bool final);
+
+  /**
+   * Acknowledge a slot, called from delivery report callback or when
+   * a message was archived instead of produced.
+   *
+   * @param opaque              slot returned by Add(), NULL is ignored
+   */
+  static void Ack(void* opaque);
+
+  /**
+   * Release a chunk reference, chunk deleted by the last one.
+   */
+  static void Unref(Chunk* chunk);
+
+  /**
+   * @returns acknowledged totals since created.
+   */
+  Stats GetStats() const;
+
+ private:
+  static void CommitFile(FileProgress* progress);
+
+  static void Commit(DirChain* chain);
+
+  static void CommitTail(DirChain* chain);
+
+  // all lines of a finished file acked
+  static void Settle(FileProgress* progress);
+
+  std::shared_ptr<OffsetTable> table_;
+  std::atomic<uint64_t> files_acked_;
+  std::atomic<uint64_t> messages_acked_;
+  std::atomic<uint64_t> bytes_acked_;
+  std::mutex mutex_;
+  std::unordered_map<std::string, DirChain*> chains_;
+  // "dev\tino" <--> reads of tailed file
+  std::unordered_map<std::string, DirChain*> tails_;
+};
+
+}   // namespace log2hdfs
+
+#endif  // LOG2HDFS_LOG2KAFKA_DELIVERY_TRACKER_H_
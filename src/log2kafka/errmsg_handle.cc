@@ -1,10 +1,10 @@
 // Copyright (c) 2017 Lanceolata
 
 #include "log2kafka/errmsg_handle.h"
+#include <fcntl.h>
 #include <unistd.h>
 #include <vector>
 #include "util/configparser.h"
-#include "util/fp_cache.h"
 #include "util/system_utils.h"
 #include "easylogging++.h"
 
@@ -16,11 +16,21 @@ namespace log2hdfs {
 #define DEFAULT_HANDLE_DIR "remedy"
 #define DEFAULT_HANDLE_INTERVAL "1800"
 #define DEFAULT_HANDLE_REMEDY ""
+#define DEFAULT_HANDLE_SEGMENT_BYTES "67108864"
+#define DEFAULT_HANDLE_REPLAY_RATE "5000"
+
+// spooled messages, overflow is kept in memory
+#define SPOOL_QUEUE_CAPACITY 65536
+// messages popped per spool loop
+#define SPOOL_POP_NUM 1024
+// segment buffer flushed with one write
+#define SPOOL_BUFFER_SIZE 1048576
+// max time spooled messages stay in buffer
+#define SPOOL_WAIT_MS 1000
 
 std::shared_ptr<ErrmsgHandle> ErrmsgHandle::Init(
-    std::shared_ptr<Section> section,
-    std::shared_ptr<Queue<std::string>> queue) {
-  if (!section || !queue) {
+    std::shared_ptr<Section> section) {
+  if (!section) {
     LOG(ERROR) << "ErrmsgHandle Init invalid parameters";
     return nullptr;
   }
@@ -55,84 +65,176 @@ std::shared_ptr<ErrmsgHandle> ErrmsgHandle::Init(
     remedy = true;
   }
 
-  std::shared_ptr<FpCache> cache = FpCache::Init();
-  if (!cache) {
-    LOG(ERROR) << "ErrmsgHandle Init FpCache failed";
+  std::string segment_str = section->Get("handle.segment.bytes",
+                                         DEFAULT_HANDLE_SEGMENT_BYTES);
+  off_t segment_bytes = atol(segment_str.c_str());
+  if (segment_bytes < SPOOL_BUFFER_SIZE) {
+    LOG(ERROR) << "ErrmsgHandle Init invalid segment.bytes["
+               << segment_bytes << "]";
+    return nullptr;
+  }
+
+  std::string rate_str = section->Get("handle.replay.rate",
+                                      DEFAULT_HANDLE_REPLAY_RATE);
+  int replay_rate = atoi(rate_str.c_str());
+  if (replay_rate <= 0) {
+    LOG(ERROR) << "ErrmsgHandle Init invalid replay.rate["
+               << replay_rate << "]";
     return nullptr;
   }
 
   LOG(INFO) << "ErrmsgHandle Init parameters dir[" << dir
             << "] interval[" << interval << "] remedy[" << remedy
-            << "]";
+            << "] segment.bytes[" << segment_bytes << "] replay.rate["
+            << replay_rate << "]";
   return std::make_shared<ErrmsgHandle>(dir, interval, remedy,
-             std::move(cache), std::move(queue));
+             segment_bytes, replay_rate);
 }
 
-void ErrmsgHandle::ArchiveMsg(const std::string& topic,
-                              const std::string& msg) {
-  if (topic.empty() || msg.empty()) {
+ErrmsgHandle::ErrmsgHandle(const std::string& dir,
+                           int interval,
+                           bool remedy,
+                           off_t segment_bytes,
+                           int replay_rate):
+    dir_(dir), interval_(interval), remedy_(remedy),
+    segment_bytes_(segment_bytes), replay_rate_(replay_rate),
+    spool_(SPOOL_QUEUE_CAPACITY), replay_queue_(Queue<FileRecord>::Init()),
+    seq_(0), stop_(true) {}
+
+void ErrmsgHandle::ArchiveMsg(const std::string& topic, const char* payload,
+                              size_t len) {
+  if (topic.empty() || !payload || len == 0) {
     LOG(WARNING) << "ErrmsgHandle ArchiveMsg invalid parameters";
     return;
   }
 
-  std::shared_ptr<FILE> fptr = cache_->Get(topic);
-  if (!fptr) {
-    std::string path = dir_ + "/" + topic + "." +
-        std::to_string(time(NULL));
-    fptr = cache_->Get(topic, path);
-    if (!fptr) {
-      LOG(ERROR) << "ErrmsgHandle ArchiveMsg cache_ get topic["
-                 << topic << "] failed msg[" << msg << "]";
-      return;
-    }
-  }
+  SpoolMsg msg;
+  msg.topic_id = TopicIds::Intern(topic);
+  msg.payload.assign(payload, len);
+  spool_.Push(std::move(msg));
+}
 
-  std::string temp = msg + "\n";
-  size_t n = fwrite(temp.c_str(), 1, temp.length(), fptr.get());
-  if (n != temp.length()) {
-    LOG(ERROR) << "ErrmsgHandle ArchiveMsg fwrite topic[" << topic
-               << "] msg[" << msg << "] might failed written[" << n
-               << "] expected[" << temp.length() << "]";
+void ErrmsgHandle::Stop() {
+  stop_.store(true);
+  std::lock_guard<std::mutex> guard(thread_mutex_);
+  if (thread_.joinable()) {
+    // wake up spool thread
+    spool_.Push(SpoolMsg());
+    thread_.join();
   }
 }
 
 void ErrmsgHandle::StartInternal() {
   LOG(INFO) << "ErrmsgHandle thread created";
 
+  std::vector<SpoolMsg> msgs(SPOOL_POP_NUM);
+  time_t last_check = time(NULL);
   while (true) {
-    sleep(interval_);
+    size_t n = spool_.TryPopN(msgs.data(), SPOOL_POP_NUM);
+    for (size_t i = 0; i < n; ++i)
+      Append(&msgs[i]);
 
-    std::vector<std::string> paths = cache_->CloseAll();
+    if (n == 0) {
+      if (stop_.load())
+        break;
 
-    // Wait for all cache fp close
-    sleep(5);
+      // idle, flush buffers before waiting
+      for (auto& it : segments_)
+        Flush(&it.second);
 
-    for (auto& path : paths) {
-      LOG(INFO) << "ErrmsgHandle StartInternal handle path[" << path << "]";
+      if (spool_.WaitPop(&msgs[0], SPOOL_WAIT_MS))
+        Append(&msgs[0]);
+    }
 
-      if (!remedy_)
-        continue;
+    time_t now = time(NULL);
+    if (now != last_check) {
+      SealAll(true);
+      last_check = now;
+    }
+  }
 
-      // Get file name
-      std::string file = BaseName(path);
-      if (file.empty()) {
-        LOG(WARNING) << "ErrmsgHandle StartInternal BaseName[" << path
-                     << "] failed";
-        continue;
-      }
+  SealAll(false);
+  LOG(INFO) << "ErrmsgHandle thread existing";
+}
 
-      // Extract topic from file name
-      auto end = file.find(".");
-      if (end == std::string::npos) {
-        LOG(WARNING) << "ErrmsgHandle StartInternal invalid path[" << path
-                     << "]";
-        continue;
-      }
+void ErrmsgHandle::Append(SpoolMsg* msg) {
+  if (msg->topic_id < 0 || msg->payload.empty())
+    return;
 
-      std::string topic = file.substr(0, end);
-      queue_->Push(topic + ":" + path + ":0");
+  Segment& segment = segments_[msg->topic_id];
+  if (segment.fd == -1) {
+    const std::string& topic = TopicIds::Name(msg->topic_id);
+    segment.created = time(NULL);
+    segment.path = dir_ + "/" + topic + "." +
+        std::to_string(segment.created) + "." + std::to_string(seq_++);
+    segment.fd = open(segment.path.c_str(),
+                      O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (segment.fd == -1) {
+      LOG(ERROR) << "ErrmsgHandle Append open path[" << segment.path
+                 << "] failed with errno[" << errno << "] msg["
+                 << msg->payload << "]";
+      segments_.erase(msg->topic_id);
+      return;
     }
+    segment.size = 0;
   }
+
+  segment.buf.append(msg->payload);
+  segment.buf.append("\n");
+  msg->payload.clear();
+
+  if (segment.buf.size() >= SPOOL_BUFFER_SIZE)
+    Flush(&segment);
+
+  if (segment.size + static_cast<off_t>(segment.buf.size()) >=
+      segment_bytes_)
+    Seal(msg->topic_id, &segment);
+}
+
+bool ErrmsgHandle::Flush(Segment* segment) {
+  const char* p = segment->buf.data();
+  size_t left = segment->buf.size();
+  while (left > 0) {
+    ssize_t n = write(segment->fd, p, left);
+    if (n == -1) {
+      if (errno == EINTR)
+        continue;
+      LOG(ERROR) << "ErrmsgHandle Flush path[" << segment->path
+                 << "] failed with errno[" << errno << "] lost["
+                 << left << "] bytes";
+      segment->buf.clear();
+      return false;
+    }
+    p += n;
+    left -= n;
+    segment->size += n;
+  }
+  segment->buf.clear();
+  return true;
+}
+
+void ErrmsgHandle::Seal(int topic_id, Segment* segment) {
+  Flush(segment);
+  close(segment->fd);
+  segment->fd = -1;
+
+  LOG(INFO) << "ErrmsgHandle Seal path[" << segment->path << "] size["
+            << segment->size << "]";
+  if (remedy_)
+    replay_queue_->Push(FileRecord(topic_id, segment->path, 0));
+  segments_.erase(topic_id);
+}
+
+void ErrmsgHandle::SealAll(bool expired_only) {
+  time_t now = time(NULL);
+  std::vector<int> topic_ids;
+  for (auto& it : segments_) {
+    if (!expired_only || now - it.second.created >= interval_)
+      topic_ids.push_back(it.first);
+  }
+
+  for (auto topic_id : topic_ids)
+    Seal(topic_id, &segments_[topic_id]);
 }
 
 }   // namespace log2hdfs
@@ -3,85 +3,165 @@
 #ifndef LOG2HDFS_LOG2KAFKA_ERRMSG_HANDLE_H_
 #define LOG2HDFS_LOG2KAFKA_ERRMSG_HANDLE_H_
 
+#include <time.h>
 #include <string>
 #include <memory>
 #include <mutex>
 #include <thread>
+#include <atomic>
+#include <unordered_map>
 
+#include "log2kafka/file_record.h"
 #include "util/queue.h"
 
 namespace log2hdfs {
 
-class FpCache;
 class Section;
 
 /**
  * Handle produce failed messages.
+ *
+ * Failed messages are handed to a spool thread through a queue, callers
+ * (delivery report callback and produce workers) never touch the disk.
+ * The spool thread appends messages of a topic to a segment file with
+ * large buffered writes. Segments are sealed every interval or when
+ * they reach segment size, sealed segments are pushed to replay queue
+ * if remedy is enabled. Replay queue is produced by a rate limited lane
+ * of Produce, see Produce.
  */
 class ErrmsgHandle {
  public:
   /**
    * Static function to create a ErrmsgHandle shared_ptr
-   * 
+   *
    * @param section             Ini configuration section
-   * @param queue               produce queue
-   * 
+   *
    * @returns std::shared_ptr<ErrmsgHandle> if init success,
    *          nullptr otherwise.
    */
   static std::shared_ptr<ErrmsgHandle> Init(
-      std::shared_ptr<Section> section,
-      std::shared_ptr<Queue<std::string>> queue);
+      std::shared_ptr<Section> section);
 
   /**
    * Constructor
-   * 
+   *
    * @param dir                 archive local dir
-   * @param interval            remedy local file interval
+   * @param interval            segment seal interval(s)
    * @param remedy              whether produce err msgs
-   * @param cache               file pointer cache 
-   * @param queue               produce queue
+   * @param segment_bytes       segment seal size
+   * @param replay_rate         max replayed messages per second
    */
   ErrmsgHandle(const std::string& dir,
                int interval,
                bool remedy,
-               std::shared_ptr<FpCache> cache,
-               std::shared_ptr<Queue<std::string>> queue):
-      dir_(dir), interval_(interval), remedy_(remedy),
-      cache_(std::move(cache)), queue_(std::move(queue)) {}
+               off_t segment_bytes,
+               int replay_rate);
+
+  ~ErrmsgHandle() {
+    Stop();
+  }
 
   ErrmsgHandle(const ErrmsgHandle& other) = delete;
   ErrmsgHandle& operator=(const ErrmsgHandle& other) = delete;
 
   /**
-   * Write produce failed msg to file.
-   * 
+   * Spool produce failed msg.
+   *
    * @param topic               topic to produce
    * @param msg                 produced failed msg
    */
-  void ArchiveMsg(const std::string& topic, const std::string& msg);
+  void ArchiveMsg(const std::string& topic, const std::string& msg) {
+    ArchiveMsg(topic, msg.data(), msg.size());
+  }
+
+  /**
+   * Spool produce failed msg.
+   *
+   * @param topic               topic to produce
+   * @param payload             produced failed msg
+   * @param len                 msg length
+   */
+  void ArchiveMsg(const std::string& topic, const char* payload,
+                  size_t len);
+
+  /**
+   * @returns queue of sealed segments to replay.
+   */
+  std::shared_ptr<Queue<FileRecord>> replay_queue() const {
+    return replay_queue_;
+  }
+
+  /**
+   * @returns max replayed messages per second.
+   */
+  int replay_rate() const {
+    return replay_rate_;
+  }
 
   /**
-   * Create thread
+   * Start spool thread
    */
   void Start() {
-    std::call_once(flag_, &ErrmsgHandle::CreateThread, this);
+    std::lock_guard<std::mutex> guard(thread_mutex_);
+    if (!thread_.joinable()) {
+      stop_.store(false);
+      std::thread t(&ErrmsgHandle::StartInternal, this);
+      thread_ = std::move(t);
+    }
   }
 
+  /**
+   * Stop spool thread, spooled messages are flushed.
+   */
+  void Stop();
+
  private:
-  void CreateThread() {
-    std::thread t(&ErrmsgHandle::StartInternal, this);
-    t.detach();
-  }
+  /**
+   * Spooled message
+   */
+  struct SpoolMsg {
+    SpoolMsg(): topic_id(-1) {}
+
+    int topic_id;
+    std::string payload;
+  };
+
+  /**
+   * Open segment of a topic
+   */
+  struct Segment {
+    Segment(): fd(-1), size(0), created(0) {}
+
+    int fd;
+    std::string path;
+    off_t size;
+    time_t created;
+    std::string buf;
+  };
 
   void StartInternal();
 
+  void Append(SpoolMsg* msg);
+
+  bool Flush(Segment* segment);
+
+  void Seal(int topic_id, Segment* segment);
+
+  void SealAll(bool expired_only);
+
   std::string dir_;
   int interval_;
   bool remedy_;
-  std::shared_ptr<FpCache> cache_;
-  std::shared_ptr<Queue<std::string>> queue_;
-  std::once_flag flag_;
+  off_t segment_bytes_;
+  int replay_rate_;
+  Queue<SpoolMsg> spool_;
+  std::shared_ptr<Queue<FileRecord>> replay_queue_;
+  // topic id <--> open segment, only used by spool thread
+  std::unordered_map<int, Segment> segments_;
+  uint64_t seq_;
+  std::atomic<bool> stop_;
+  std::mutex thread_mutex_;
+  std::thread thread_;
 };
 
 }   // namespace log2hdfs
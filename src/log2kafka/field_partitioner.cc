@@ -0,0 +1,85 @@
+// Copyright (c) 2017 Lanceolata
+
+#include "log2kafka/field_partitioner.h"
+#include "log2kafka/topic_opaque.h"
+#include "util/string_utils.h"
+#include "easylogging++.h"
+
+namespace log2hdfs {
+
+namespace {
+
+uint32_t Fnv1a(const void* data, size_t len) {
+  const unsigned char* p = static_cast<const unsigned char*>(data);
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < len; ++i) {
+    hash ^= p[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+}   // namespace
+
+std::unique_ptr<FieldPartitioner> FieldPartitioner::Init(char delimiter,
+                                                         int index,
+                                                         int length) {
+  if (index < 0 || length < 0) {
+    LOG(ERROR) << "FieldPartitioner Init invalid parameters index["
+               << index << "] length[" << length << "]";
+    return nullptr;
+  }
+  return std::unique_ptr<FieldPartitioner>(
+             new FieldPartitioner(delimiter, index, length));
+}
+
+bool FieldPartitioner::ExtractKey(const char* line, size_t len,
+                                  const char** key, size_t* keylen) const {
+  const char *begin, *end;
+  if (!ExtractField(line, len, delimiter_, index_, &begin, &end))
+    return false;
+
+  if (length_ > 0 && end - begin > length_)
+    end = begin + length_;
+
+  if (begin == end)
+    return false;
+
+  *key = begin;
+  *keylen = end - begin;
+  return true;
+}
+
+int32_t FieldPartitioner::Partition(const rd_kafka_topic_t* rkt,
+                                    const void* key, size_t keylen,
+                                    int32_t partition_cnt,
+                                    void* rkt_opaque, void* msg_opaque) {
+  // rotates messages of a key over its partitions
+  static thread_local uint32_t seq = 0;
+  ++seq;
+
+  if (partition_cnt <= 0)
+    return RD_KAFKA_PARTITION_UA;
+
+  uint32_t base = 0;
+  int32_t spread = partition_cnt;
+  if (key && keylen > 0) {
+    base = Fnv1a(key, keylen) % partition_cnt;
+    TopicOpaque* opaque = static_cast<TopicOpaque*>(rkt_opaque);
+    spread = opaque ? opaque->partition_spread.load() : 1;
+    if (spread < 1)
+      spread = 1;
+    if (spread > partition_cnt)
+      spread = partition_cnt;
+  }
+
+  // skip unavailable partitions of the subset
+  for (int32_t i = 0; i < spread; ++i) {
+    int32_t partition = (base + (seq + i) % spread) % partition_cnt;
+    if (rd_kafka_topic_partition_available(rkt, partition))
+      return partition;
+  }
+  return (base + seq % spread) % partition_cnt;
+}
+
+}   // namespace log2hdfs
@@ -0,0 +1,81 @@
+// Copyright (c) 2017 Lanceolata
+
+#ifndef LOG2HDFS_LOG2KAFKA_FIELD_PARTITIONER_H_
+#define LOG2HDFS_LOG2KAFKA_FIELD_PARTITIONER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include "librdkafka/rdkafka.h"
+#ifdef __cplusplus
+}
+#endif
+
+namespace log2hdfs {
+
+/**
+ * Partition lines by a delimited field.
+ *
+ * The field (device type, action type, time bucket...) is produced as
+ * message key. Partition() hashes the key to a subset of partition
+ * spread consecutive partitions, so lines of a key land in few
+ * partitions and every kafka2hdfs partition thread writes few files.
+ * Lines without the field are spread over all partitions.
+ */
+class FieldPartitioner {
+ public:
+  /**
+   * Static function to create a FieldPartitioner unique_ptr
+   *
+   * @param delimiter           field delimiter
+   * @param index               field index from 0
+   * @param length              chars of field used as key, 0 whole field
+   *
+   * @returns std::unique_ptr<FieldPartitioner> if init success,
+   *          nullptr otherwise.
+   */
+  static std::unique_ptr<FieldPartitioner> Init(char delimiter, int index,
+                                                int length);
+
+  /**
+   * Constructor
+   */
+  FieldPartitioner(char delimiter, int index, int length):
+      delimiter_(delimiter), index_(index), length_(length) {}
+
+  /**
+   * Extract partition key of line.
+   *
+   * @param line                line without '\n'
+   * @param len                 line length
+   * @param key                 key to set, points into line
+   * @param keylen              key length to set
+   *
+   * @returns True if field found, false otherwise.
+   */
+  bool ExtractKey(const char* line, size_t len, const char** key,
+                  size_t* keylen) const;
+
+  /**
+   * librdkafka partitioner callback.
+   *
+   * rkt_opaque is TopicOpaque of the topic.
+   */
+  static int32_t Partition(const rd_kafka_topic_t* rkt,
+                           const void* key, size_t keylen,
+                           int32_t partition_cnt,
+                           void* rkt_opaque, void* msg_opaque);
+
+ private:
+  char delimiter_;
+  int index_;
+  int length_;
+};
+
+}   // namespace log2hdfs
+
+#endif  // LOG2HDFS_LOG2KAFKA_FIELD_PARTITIONER_H_
@@ -0,0 +1,54 @@
+// Copyright (c) 2017 Lanceolata
+
+#include "log2kafka/file_record.h"
+#include <mutex>
+#include <deque>
+#include <unordered_map>
+#include "util/system_utils.h"
+
+namespace log2hdfs {
+
+namespace {
+
+std::mutex ids_mutex;
+// deque keeps references valid on push_back
+std::deque<std::string> id_names;
+std::unordered_map<std::string, int> name_ids;
+const std::string empty_name;
+
+}   // namespace
+
+int TopicIds::Intern(const std::string& topic) {
+  if (topic.empty())
+    return -1;
+
+  std::lock_guard<std::mutex> lock(ids_mutex);
+  auto it = name_ids.find(topic);
+  if (it != name_ids.end())
+    return it->second;
+
+  int id = static_cast<int>(id_names.size());
+  id_names.push_back(topic);
+  name_ids[topic] = id;
+  return id;
+}
+
+const std::string& TopicIds::Name(int id) {
+  std::lock_guard<std::mutex> lock(ids_mutex);
+  if (id < 0 || static_cast<size_t>(id) >= id_names.size())
+    return empty_name;
+  return id_names[id];
+}
+
+FileRecord::FileRecord(const std::string& topic, std::string path,
+                       off_t offset, bool growing):
+    topic_id(TopicIds::Intern(topic)), path(std::move(path)),
+    offset(offset), attempt(0), enqueue_us(NowMicros()),
+    growing(growing) {}
+
+FileRecord::FileRecord(int topic_id, std::string path, off_t offset,
+                       bool growing):
+    topic_id(topic_id), path(std::move(path)), offset(offset), attempt(0),
+    enqueue_us(NowMicros()), growing(growing) {}
+
+}   // namespace log2hdfs
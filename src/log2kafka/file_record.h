@@ -0,0 +1,95 @@
+// Copyright (c) 2017 Lanceolata
+
+#ifndef LOG2HDFS_LOG2KAFKA_FILE_RECORD_H_
+#define LOG2HDFS_LOG2KAFKA_FILE_RECORD_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <string>
+
+namespace log2hdfs {
+
+/**
+ * Interned topic names.
+ *
+ * Topics get a small integer id the first time they are seen, ids are
+ * never reused so a FileRecord stays valid after its topic is removed.
+ */
+class TopicIds {
+ public:
+  /**
+   * Get id of topic, add topic if not seen before.
+   *
+   * @param topic               topic name
+   *
+   * @returns topic id if topic not empty; -1 otherwise.
+   */
+  static int Intern(const std::string& topic);
+
+  /**
+   * Get topic name of id.
+   *
+   * @param id                  topic id
+   *
+   * @returns topic name if id valid; empty string otherwise.
+   */
+  static const std::string& Name(int id);
+};
+
+/**
+ * File to produce, passed from inotify and errmsg handle to produce.
+ */
+struct FileRecord {
+  /**
+   * Constructor of an empty record, used to wake up produce thread.
+   */
+  FileRecord():
+      topic_id(-1), offset(0), attempt(0), enqueue_us(0), growing(false) {}
+
+  /**
+   * Constructor
+   *
+   * @param topic               topic name
+   * @param path                file path
+   * @param offset              start offset, -1 for already produced
+   * @param growing             file is still appended (tail mode)
+   */
+  FileRecord(const std::string& topic, std::string path, off_t offset,
+             bool growing = false);
+
+  /**
+   * Constructor
+   *
+   * @param topic_id            topic id returned by TopicIds::Intern()
+   * @param path                file path
+   * @param offset              start offset, -1 for already produced
+   * @param growing             file is still appended (tail mode)
+   */
+  FileRecord(int topic_id, std::string path, off_t offset,
+             bool growing = false);
+
+  /**
+   * @returns true if record is empty.
+   */
+  bool empty() const {
+    return topic_id < 0 || path.empty();
+  }
+
+  /**
+   * @returns topic name
+   */
+  const std::string& topic() const {
+    return TopicIds::Name(topic_id);
+  }
+
+  int topic_id;
+  std::string path;
+  off_t offset;
+  int attempt;
+  int64_t enqueue_us;
+  bool growing;
+};
+
+}   // namespace log2hdfs
+
+#endif  // LOG2HDFS_LOG2KAFKA_FILE_RECORD_H_
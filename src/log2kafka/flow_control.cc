@@ -0,0 +1,66 @@
+// Copyright (c) 2017 Lanceolata
+
+#include "log2kafka/flow_control.h"
+#include <chrono>
+#include "easylogging++.h"
+
+namespace log2hdfs {
+
+std::shared_ptr<FlowControl> FlowControl::Init(int max_msgs,
+                                               int64_t max_bytes) {
+  if (max_msgs <= 0 || max_bytes <= 0) {
+    LOG(ERROR) << "FlowControl Init invalid parameters max_msgs["
+               << max_msgs << "] max_bytes[" << max_bytes << "]";
+    return nullptr;
+  }
+  return std::make_shared<FlowControl>(max_msgs, max_bytes);
+}
+
+void FlowControl::SetBudget(int max_msgs, int64_t max_bytes) {
+  if (max_msgs <= 0 || max_bytes <= 0)
+    return;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (max_msgs == max_msgs_ && max_bytes == max_bytes_)
+    return;
+  max_msgs_ = max_msgs;
+  max_bytes_ = max_bytes;
+  cond_.notify_all();
+}
+
+void FlowControl::Acquire(size_t msgs, size_t bytes) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  cond_.wait(lock, [this, msgs, bytes]() {
+    return inflight_msgs_ == 0 ||
+           (inflight_msgs_ + static_cast<int64_t>(msgs) <= max_msgs_ &&
+            inflight_bytes_ + static_cast<int64_t>(bytes) <= max_bytes_);
+  });
+  inflight_msgs_ += msgs;
+  inflight_bytes_ += bytes;
+}
+
+void FlowControl::Release(size_t msgs, size_t bytes) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  inflight_msgs_ -= msgs;
+  inflight_bytes_ -= bytes;
+  if (inflight_msgs_ < 0 || inflight_bytes_ < 0) {
+    LOG(WARNING) << "FlowControl Release more than acquired msgs["
+                 << inflight_msgs_ << "] bytes[" << inflight_bytes_
+                 << "] clamped to 0";
+    inflight_msgs_ = 0;
+    inflight_bytes_ = 0;
+  }
+  ++released_;
+  cond_.notify_all();
+}
+
+bool FlowControl::WaitRelease(int timeout_ms) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  uint64_t released = released_;
+  return cond_.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+                        [this, released]() {
+                          return released_ != released;
+                        });
+}
+
+}   // namespace log2hdfs
@@ -0,0 +1,100 @@
+// Copyright (c) 2017 Lanceolata
+
+#ifndef LOG2HDFS_LOG2KAFKA_FLOW_CONTROL_H_
+#define LOG2HDFS_LOG2KAFKA_FLOW_CONTROL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+
+namespace log2hdfs {
+
+/**
+ * In-flight credit of a topic.
+ *
+ * Produce workers acquire credit for a batch before handing it to
+ * librdkafka, delivery reports release it. Workers over budget block on
+ * a condition variable until deliveries come back instead of polling
+ * the producer out queue.
+ *
+ * Delivery report callback releases credit through TopicOpaque.
+ */
+class FlowControl {
+ public:
+  /**
+   * Static function to create a FlowControl shared_ptr
+   *
+   * @param max_msgs            max in-flight messages
+   * @param max_bytes           max in-flight bytes
+   *
+   * @returns std::shared_ptr<FlowControl> if init success,
+   *          nullptr otherwise.
+   */
+  static std::shared_ptr<FlowControl> Init(int max_msgs, int64_t max_bytes);
+
+  /**
+   * Constructor
+   */
+  FlowControl(int max_msgs, int64_t max_bytes):
+      max_msgs_(max_msgs), max_bytes_(max_bytes),
+      inflight_msgs_(0), inflight_bytes_(0), released_(0) {}
+
+  FlowControl(const FlowControl& other) = delete;
+  FlowControl& operator=(const FlowControl& other) = delete;
+
+  /**
+   * Update budget, waiters are woken up.
+   */
+  void SetBudget(int max_msgs, int64_t max_bytes);
+
+  /**
+   * Block until msgs and bytes fit in the budget.
+   *
+   * A batch is always admitted when nothing is in flight, so a batch
+   * larger than the budget can not block forever.
+   *
+   * @param msgs                messages number
+   * @param bytes               messages bytes
+   */
+  void Acquire(size_t msgs, size_t bytes);
+
+  /**
+   * Release credit of delivered or dropped messages.
+   */
+  void Release(size_t msgs, size_t bytes);
+
+  /**
+   * Wait for any release.
+   *
+   * @param timeout_ms          max wait time
+   *
+   * @returns True if credit released, false if timeout.
+   */
+  bool WaitRelease(int timeout_ms);
+
+  int64_t inflight_msgs() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return inflight_msgs_;
+  }
+
+  int64_t inflight_bytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return inflight_bytes_;
+  }
+
+ private:
+  mutable std::mutex mutex_;
+  std::condition_variable cond_;
+  int64_t max_msgs_;
+  int64_t max_bytes_;
+  int64_t inflight_msgs_;
+  int64_t inflight_bytes_;
+  // release sequence, wakes up WaitRelease
+  uint64_t released_;
+};
+
+}   // namespace log2hdfs
+
+#endif  // LOG2HDFS_LOG2KAFKA_FLOW_CONTROL_H_
@@ -7,6 +7,7 @@
 #include <sys/inotify.h>
 #include "log2kafka/offset_table.h"
 #include "log2kafka/topic_conf.h"
+#include "util/dir_scanner.h"
 #include "util/system_utils.h"
 #include "util/string_utils.h"
 #include "easylogging++.h"
@@ -46,9 +47,11 @@ int inotify_fd() {
   return inot_fd;
 }
 
-inline int AddWatch(int fd, const std::string& path) {
-  return inotify_add_watch(fd, path.c_str(),
-             IN_MOVED_TO | IN_CREATE | IN_DONT_FOLLOW);
+inline int AddWatch(int fd, const std::string& path, bool tail) {
+  uint32_t mask = IN_MOVED_TO | IN_CREATE | IN_DONT_FOLLOW;
+  if (tail)
+    mask |= IN_MODIFY;
+  return inotify_add_watch(fd, path.c_str(), mask);
 }
 
 inline bool RemoveWatch(int fd, int wd) {
@@ -57,20 +60,18 @@ inline bool RemoveWatch(int fd, int wd) {
   return true;
 }
 
-int scandir_filter(const struct dirent *dep) {
-  if (strncmp(dep->d_name, ".", 1) == 0)
-    return 0;
-  return 1;
-}
+#define RESCAN_THREADS 8
 
-int scandir_compar(const struct dirent **a, const struct dirent **b) {
-  return strcmp((*a)->d_name, (*b)->d_name);
+inline bool Later(const struct timespec& a, const struct timespec& b) {
+  if (a.tv_sec != b.tv_sec)
+    return a.tv_sec > b.tv_sec;
+  return a.tv_nsec > b.tv_nsec;
 }
 
 }   // namespace
 
 std::unique_ptr<Inotify> Inotify::Init(
-    std::shared_ptr<Queue<std::string>> queue,
+    std::shared_ptr<Queue<FileRecord>> queue,
     std::shared_ptr<OffsetTable> table) {
   if (!queue || !table) {
     LOG(ERROR) << "Inotify Init invalid parameters";
@@ -89,7 +90,13 @@ std::unique_ptr<Inotify> Inotify::Init(
 
 bool Inotify::AddWatchTopic(std::shared_ptr<TopicConf> conf) {
   const std::string& topic = conf->topic();
-  LOG(INFO) << "Inotify AddWatchTopic topic[" << topic << "]";
+  LOG(INFO) << "Inotify AddWatchTopic topic[" << topic << "] tail["
+            << conf->tail() << "]";
+  if (conf->tail()) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    tail_topics_.insert(topic);
+  }
+
   for (auto& path : conf->dirs()) {
     if (!AddWatchPath(topic, path, conf->remedy())) {
       LOG(WARNING) << "Inotify AddWatchTopic AddWatchPath topic["
@@ -108,11 +115,13 @@ bool Inotify::RemoveWatchTopic(const std::string& topic) {
   }
 
   std::lock_guard<std::mutex> lock(mutex_);
-  for (auto it = wd_topic_.begin(); it != wd_topic_.end(); ++it) {
-    if (it->second != topic)
+  tail_topics_.erase(topic);
+  int topic_id = TopicIds::Intern(topic);
+  for (auto it = watches_.begin(); it != watches_.end(); ++it) {
+    if (it->second.topic_id != topic_id)
       continue;
 
-    std::string path = wd_path_[it->first];
+    const std::string& path = it->second.path;
     if (RemoveWatch(inot_fd_, it->first)) {
       LOG(INFO) << "Inotify RemoveWatchTopic RemoveWatch wd[" << it->first
                 << "] topic[" << topic << "] path[" << path << "] success";
@@ -164,7 +173,8 @@ bool Inotify::AddWatchPath(const std::string& topic,
 
   // step 2: Add watch
   std::unique_lock<std::mutex> lock(mutex_);
-  int wd = AddWatch(inot_fd_, normalpath);
+  bool tail = tail_topics_.find(topic) != tail_topics_.end();
+  int wd = AddWatch(inot_fd_, normalpath, tail);
   if (wd == -1) {
     LOG(ERROR) << "Inotify AddWatchPath AddWatch topic[" << topic
                << "] path[" << normalpath << "] failed with errno["
@@ -182,17 +192,20 @@ bool Inotify::AddWatchPath(const std::string& topic,
     return false;
   }
 
-  // step 4: Check wd_topic_ avoid repeat watched
-  auto it = wd_topic_.find(wd);
-  if (it != wd_topic_.end()) {
+  // step 4: Check watches_ avoid repeat watched
+  auto it = watches_.find(wd);
+  if (it != watches_.end()) {
     LOG(WARNING) << "Inotify AddWatchPath topic[" << topic << "] path["
                  << normalpath << "] already watched";
     return false;
   }
 
-  // step 5: Update wd_topic_ and wd_path_
-  wd_topic_[wd] = topic;
-  wd_path_[wd] = normalpath;
+  // step 5: Update watches_
+  WatchEntry& entry = watches_[wd];
+  entry.topic_id = TopicIds::Intern(topic);
+  entry.path = normalpath;
+  entry.tail = tail;
+  entry.added = ts;
   lock.unlock();
 
   LOG(INFO) << "Inotify AddWatchPath topic[" << topic << "] path["
@@ -206,6 +219,12 @@ bool Inotify::AddWatchPath(const std::string& topic,
 void Inotify::Remedy(const std::string& topic, const std::string& dir,
                      time_t remedy, const struct timespec& end,
                      const std::string& remedy_file, off_t remedy_offset) {
+  // files in tail mode might still be appended
+  std::unique_lock<std::mutex> lock(mutex_);
+  bool tail = tail_topics_.find(topic) != tail_topics_.end();
+  lock.unlock();
+
+  // start of ctime window for files without identity record
   Optional<struct timespec> start;
   if (!remedy_file.empty() && remedy_offset >= -1) {
     struct timespec start_ts;
@@ -217,67 +236,89 @@ void Inotify::Remedy(const std::string& topic, const std::string& dir,
                    << "remedy path[" << remedy_path << "] failed with errno["
                    << errno << "]";
     }
-
-    LOG(INFO) << "Inotify Remedy push topic[" << topic << "] path["
-              << remedy_path << "] offset[" << remedy_offset << "]";
-    queue_->Push(topic + ":" + remedy_path + ":" +
-                 std::to_string(remedy_offset));
   }
 
-  std::vector<std::string> names;
-  if (!ScanDir(dir, scandir_filter, scandir_compar, &names)) {
-    LOG(WARNING) << "Inotify Remedy topic[" << topic << "] ScanDir["
+  std::vector<DirEntry> entries;
+  if (!DirScanner::Scan(dir,
+          DirScanner::kSkipHidden | DirScanner::kSort | DirScanner::kStat,
+          &entries)) {
+    LOG(WARNING) << "Inotify Remedy topic[" << topic << "] Scan["
                  << dir << "failed with errno[" << errno << "]";
     return;
   }
 
-  for (auto& name : names) {
-    std::string inner = dir + "/" + name;
-    if (IsDir(inner)) {
+  int topic_id = TopicIds::Intern(topic);
+  std::vector<FileRecord> records;
+  for (auto& entry : entries) {
+    std::string inner = dir + "/" + entry.name;
+    if (entry.IsDir()) {
       // sub dictionary
       AddWatchPath(topic, inner, remedy);
-    } else if (IsFile(inner)) {
-      // sub file
-      if (remedy == 0)
-        continue;
+      continue;
+    } else if (!entry.IsFile()) {
+      LOG(WARNING) << "Inotify Remedy unknown file[" << inner << "]";
+      continue;
+    } else if (!entry.has_stat) {
+      LOG(WARNING) << "Inotify Remedy topic[" << topic << "] stat["
+                   << inner << "] failed";
+      continue;
+    }
 
-      struct timespec ctime;
-      if (!FileCtim(inner, &ctime)) {
-        LOG(WARNING) << "Inotify Remedy topic[" << topic << "] FileCtim["
-                     << inner << "failed with errno[" << errno << "]";
-        continue;
-      }
+    // step 1: files produced before are resumed by identity
+    table_->UpdatePath(entry.st.st_dev, entry.st.st_ino, inner);
+    off_t offset = 0;
+    OffsetTable::FileStatus status = table_->Classify(inner, entry.st,
+                                                      &offset);
+    if (status == OffsetTable::kFileDone) {
+      continue;
+    } else if (status == OffsetTable::kFilePartial) {
+      LOG(INFO) << "Inotify Remedy push topic[" << topic << "] path["
+                << inner << "] offset[" << offset << "]";
+      records.emplace_back(topic_id, std::move(inner), offset, tail);
+      continue;
+    }
 
-      if (remedy > 0) {
-        if (ctime.tv_sec < time(NULL) - remedy)
-          continue;
-      }
+    // step 2: unknown files, last file of dir resumes from dir offset
+    if (entry.name == remedy_file && remedy_offset >= -1) {
+      LOG(INFO) << "Inotify Remedy push topic[" << topic << "] path["
+                << inner << "] offset[" << remedy_offset << "]";
+      records.emplace_back(topic_id, std::move(inner), remedy_offset, tail);
+      continue;
+    }
+
+    // step 3: other unknown files by ctime window
+    if (remedy == 0)
+      continue;
 
-      // ctime must less than end
-      if (ctime.tv_sec > end.tv_sec) {
+    const struct timespec& ctime = entry.st.st_ctim;
+    if (remedy > 0) {
+      if (ctime.tv_sec < time(NULL) - remedy)
         continue;
-      } else if (ctime.tv_sec == end.tv_sec) {
-        if (ctime.tv_nsec >= end.tv_nsec)
-          continue;
-      }
+    }
 
-      // ctime must more than start
-      if (start.valid()) {
-        if (ctime.tv_sec < start.value().tv_sec) {
+    // ctime must less than end
+    if (ctime.tv_sec > end.tv_sec) {
+      continue;
+    } else if (ctime.tv_sec == end.tv_sec) {
+      if (ctime.tv_nsec >= end.tv_nsec)
+        continue;
+    }
+
+    // ctime must more than start
+    if (start.valid()) {
+      if (ctime.tv_sec < start.value().tv_sec) {
+        continue;
+      } else if (ctime.tv_sec == start.value().tv_sec) {
+        if (ctime.tv_nsec <= start.value().tv_nsec)
           continue;
-        } else if (ctime.tv_sec == start.value().tv_sec) {
-          if (ctime.tv_nsec <= start.value().tv_nsec)
-            continue;
-        }
       }
-
-      LOG(INFO) << "Inotify Remedy push topic[" << topic << "] path["
-                << inner << "]";
-      queue_->Push(topic + ":" + inner + ":0");
-    } else {
-      LOG(WARNING) << "Inotify Remedy unknown file[" << inner << "]";
     }
+
+    LOG(INFO) << "Inotify Remedy push topic[" << topic << "] path["
+              << inner << "]";
+    records.emplace_back(topic_id, std::move(inner), 0, tail);
   }
+  queue_->PushN(records.data(), records.size());
 }
 
 void Inotify::StartInternal() {
@@ -313,18 +354,19 @@ void Inotify::StartInternal() {
   LOG(ERROR) << "Inotify thread existing";
 }
 
-#define INOT_BUF_LEN 8192
-
 int Inotify::ReadInotify() {
-  char buf[INOT_BUF_LEN]
-      __attribute__((aligned(__alignof__(struct inotify_event))));
-
+  char* buf = &buf_[0];
   struct inotify_event *evp;
   int num = 0;
+  bool overflow = false;
 
-  std::unique_lock<std::mutex> lock(mutex_, std::defer_lock);
+  std::vector<FileRecord> records;
+  // topic id and path of new created dirs
+  std::vector<std::pair<int, std::string>> dirs;
+  std::vector<std::string> removed;
+  std::vector<std::string> moved;
   while (true) {
-    ssize_t n = read(inot_fd_, buf, sizeof(buf));
+    ssize_t n = read(inot_fd_, buf, buf_.size());
     if (n == -1) {
       if (errno != EAGAIN) {
         LOG(ERROR) << "Inotify ReadInotify fd failed with errno["
@@ -335,73 +377,165 @@ int Inotify::ReadInotify() {
     } else if (n == 0) {
       LOG(INFO) << "Inotify ReadInotify no inotify events read";
       break;
-    } else if (n == INOT_BUF_LEN) {
-      LOG(WARNING) << "Inotify ReadInotify buf might overflow";
     }
 
-    std::string topic, path;
+    // coalesce IN_MODIFY of the same file in one read
+    std::unordered_set<std::string> modified;
+    std::unique_lock<std::mutex> lock(mutex_);
     for (char *p = buf; p < buf + n;
             p += sizeof(struct inotify_event) + evp->len) {
       ++num;
       evp = (struct inotify_event *)p;
       int wd = evp->wd;
 
-      lock.lock();
-      auto it1 = wd_topic_.find(wd);
-      if (it1 == wd_topic_.end()) {
-        LOG(WARNING) << "Inotify ReadInotify unknown wd topic[" << wd << "]";
-        lock.unlock();
+      if ((evp->mask & IN_Q_OVERFLOW) != 0) {
+        // events dropped by kernel, rescan after batch
+        overflow = true;
         continue;
       }
-      topic = it1->second;
 
-      auto it2 = wd_path_.find(wd);
-      if (it2 == wd_path_.end()) {
-        LOG(WARNING) << "Inotify ReadInotify unknown wd path[" << wd
-                     << "] topic[" << topic << "]";
-        lock.unlock();
+      auto it = watches_.find(wd);
+      if (it == watches_.end()) {
+        LOG(WARNING) << "Inotify ReadInotify unknown wd[" << wd << "]";
         continue;
       }
-
-      path = it2->second;
-      lock.unlock();
+      const WatchEntry& entry = it->second;
 
       if ((evp->mask & IN_ISDIR) != 0) {
         // handle new created dir
         if ((evp->mask & IN_CREATE) != 0) {
-          path.append("/");
-          path.append(evp->name);
-          AddWatchPath(topic, path, -1);
+          dirs.emplace_back(entry.topic_id, entry.path + "/" + evp->name);
         } else {
           LOG(WARNING) << "Inotify ReadInotify wd[" << wd << "] topic["
-                       << topic << "] path[" << path << "] unknown mask["
-                       << evp->mask << "]";
+                       << TopicIds::Name(entry.topic_id) << "] path["
+                       << entry.path << "] unknown mask[" << evp->mask
+                       << "]";
         }
       } else if ((evp->mask & IN_MOVED_TO) != 0) {
         // handle new moved file
-        path.append("/");
-        path.append(evp->name);
-        queue_->Push(topic + ":" + path + ":0");
+        records.emplace_back(entry.topic_id, entry.path + "/" + evp->name,
+                             0);
+        moved.push_back(records.back().path);
+      } else if ((evp->mask & IN_MODIFY) != 0) {
+        // handle appended file in tail mode
+        std::string path = entry.path + "/" + evp->name;
+        if (modified.insert(path).second)
+          records.emplace_back(entry.topic_id, std::move(path), 0, true);
+      } else if ((evp->mask & IN_CREATE) != 0) {
+        // new file, handled on IN_MOVED_TO or IN_MODIFY
+        continue;
       } else if ((evp->mask & IN_IGNORED) != 0) {
         // Watch was removed explicitly (inotify_rm_watch(2)) or
         // automatically(file was deleted, or filesystem was unmounted).
         LOG(INFO) << "Inotify ReadInotify erase wd[" << wd << "] topic["
-                  << topic << "] path[" << path << "]";
-
-        lock.lock();
-        wd_topic_.erase(wd);
-        wd_path_.erase(wd);
-        lock.unlock();
-
-        table_->Remove(path);
+                  << TopicIds::Name(entry.topic_id) << "] path["
+                  << entry.path << "]";
+        removed.push_back(entry.path);
+        watches_.erase(it);
       } else {
-        LOG(WARNING) << "Inotify ReadInotify wd[" << wd << "] topic[" << topic
-                     << "] path[" << path << "] unknown mask[" << evp->mask
+        LOG(WARNING) << "Inotify ReadInotify wd[" << wd << "] topic["
+                     << TopicIds::Name(entry.topic_id) << "] path["
+                     << entry.path << "] unknown mask[" << evp->mask
                      << "]";
       }
     }
+    lock.unlock();
+
+    // records of renamed files follow the inode
+    struct stat st;
+    for (auto& path : moved) {
+      if (stat(path.c_str(), &st) == 0)
+        table_->UpdatePath(st.st_dev, st.st_ino, path);
+    }
+    moved.clear();
+
+    queue_->PushN(records.data(), records.size());
+    records.clear();
+
+    for (auto& path : removed)
+      table_->Remove(path);
+    removed.clear();
+
+    for (auto& dir : dirs)
+      AddWatchPath(TopicIds::Name(dir.first), dir.second, -1);
+    dirs.clear();
   }
+
+  if (overflow)
+    Rescan();
   return num;
 }
 
+void Inotify::Rescan() {
+  std::vector<WatchEntry> entries;
+  std::unordered_set<std::string> watched;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& it : watches_) {
+      entries.push_back(it.second);
+      watched.insert(it.second.path);
+    }
+  }
+
+  LOG(WARNING) << "Inotify Rescan event queue overflow, rescan watches["
+               << entries.size() << "]";
+
+  std::vector<std::string> paths;
+  for (auto& entry : entries)
+    paths.push_back(entry.path);
+
+  std::vector<std::vector<DirEntry>> scanned;
+  DirScanner::ScanAll(paths, DirScanner::kSkipHidden | DirScanner::kStat,
+                      RESCAN_THREADS, &scanned);
+
+  // Files not done by identity and newer than the watermark file of a
+  // dir are pushed again, files already queued before overflow might be
+  // produced twice.
+  std::vector<FileRecord> records;
+  for (size_t i = 0; i < entries.size(); ++i) {
+    const WatchEntry& entry = entries[i];
+    std::string file;
+    off_t offset = -2;
+    struct timespec start = entry.added;
+    if (table_->Get(entry.path, &file, &offset) && !file.empty()) {
+      struct timespec ts;
+      if (FileCtim(entry.path + "/" + file, &ts) && Later(ts, start))
+        start = ts;
+    }
+
+    for (auto& dent : scanned[i]) {
+      if (dent.name == file)
+        continue;
+
+      std::string inner = entry.path + "/" + dent.name;
+      if (dent.IsDir()) {
+        // sub dictionary created while events dropped
+        if (watched.find(NormalDirPath(inner)) == watched.end())
+          AddWatchPath(TopicIds::Name(entry.topic_id), inner, -1);
+      } else if (dent.IsFile()) {
+        if (!dent.has_stat)
+          continue;
+
+        table_->UpdatePath(dent.st.st_dev, dent.st.st_ino, inner);
+        off_t offset = 0;
+        OffsetTable::FileStatus status = table_->Classify(inner, dent.st,
+                                                          &offset);
+        if (status == OffsetTable::kFileDone ||
+            (status == OffsetTable::kFileNew &&
+             !Later(dent.st.st_ctim, start)))
+          continue;
+
+        LOG(INFO) << "Inotify Rescan push topic["
+                  << TopicIds::Name(entry.topic_id) << "] path[" << inner
+                  << "] offset[" << offset << "]";
+        records.emplace_back(entry.topic_id, std::move(inner), offset,
+                             entry.tail);
+      }
+    }
+
+    queue_->PushN(records.data(), records.size());
+    records.clear();
+  }
+}
+
 }   // namespace log2hdfs
@@ -3,11 +3,15 @@
 #ifndef LOG2HDFS_LOG2KAFKA_INOTIFY_H_
 #define LOG2HDFS_LOG2KAFKA_INOTIFY_H_
 
+#include <time.h>
 #include <string>
 #include <memory>
 #include <mutex>
 #include <thread>
+#include <vector>
 #include <unordered_map>
+#include <unordered_set>
+#include "log2kafka/file_record.h"
 #include "util/queue.h"
 
 namespace log2hdfs {
@@ -17,6 +21,10 @@ class OffsetTable;
 
 /**
  * linux inotify
+ *
+ * Events are read in large batches and resolved under one lock per
+ * batch. When the kernel event queue overflows, all watched dirs are
+ * rescanned for files newer than their OffsetTable watermark.
  */
 class Inotify {
  public:
@@ -30,16 +38,17 @@ class Inotify {
    *          nullptr otherwise.
    */
   static std::unique_ptr<Inotify> Init(
-      std::shared_ptr<Queue<std::string>> queue,
+      std::shared_ptr<Queue<FileRecord>> queue,
       std::shared_ptr<OffsetTable> table);
 
   /**
    * Constructor
    */
   Inotify(int inot_fd,
-          std::shared_ptr<Queue<std::string>> queue,
+          std::shared_ptr<Queue<FileRecord>> queue,
           std::shared_ptr<OffsetTable> table):
-      inot_fd_(inot_fd), queue_(std::move(queue)), table_(std::move(table)) {}
+      inot_fd_(inot_fd), queue_(std::move(queue)), table_(std::move(table)),
+      buf_(INOT_BUF_LEN) {}
 
   /**
    * Add inotify watch topic paths
@@ -82,6 +91,21 @@ class Inotify {
   }
 
  private:
+  /**
+   * Watched dir
+   */
+  struct WatchEntry {
+    int topic_id;
+    std::string path;
+    // tail mode, also watch IN_MODIFY
+    bool tail;
+    // time the watch was added
+    struct timespec added;
+  };
+
+  // 256 KB holds several thousand events of short file names
+  static const size_t INOT_BUF_LEN = 256 * 1024;
+
   void CreateThread() {
     std::thread t(&Inotify::StartInternal, this);
     t.detach();
@@ -95,14 +119,18 @@ class Inotify {
 
   int ReadInotify();
 
+  void Rescan();
+
   int inot_fd_;
-  std::shared_ptr<Queue<std::string>> queue_;
+  std::shared_ptr<Queue<FileRecord>> queue_;
   std::shared_ptr<OffsetTable> table_;
   mutable std::mutex mutex_;
-  // wd <--> topic
-  std::unordered_map<int, std::string> wd_topic_;
-  // wd <--> path
-  std::unordered_map<int, std::string> wd_path_;
+  // wd <--> watched dir
+  std::unordered_map<int, WatchEntry> watches_;
+  // topics in tail mode, also watch IN_MODIFY
+  std::unordered_set<std::string> tail_topics_;
+  // event buffer, only used by inotify thread
+  std::vector<char> buf_;
   std::once_flag flag_;
 };
 
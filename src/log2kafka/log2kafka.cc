@@ -3,12 +3,16 @@
 #include <unistd.h>
 #include <signal.h>
 #include "log2kafka/errmsg_handle.h"
+#include "log2kafka/delivery_tracker.h"
+#include "log2kafka/topic_opaque.h"
 #include "log2kafka/offset_table.h"
 #include "log2kafka/topic_conf.h"
 #include "log2kafka/produce.h"
 #include "log2kafka/inotify.h"
+#include "log2kafka/bulk_ingest.h"
 #include "kafka/kafka_producer.h"
 #include "util/configparser.h"
+#include "util/system_utils.h"
 #include "easylogging++.h"
 
 // Init logging
@@ -22,6 +26,10 @@ static bool stop = false;
 // conf file path
 static char *conf_path = NULL;
 
+// bulk ingest root dir and topic
+static char *bulk_dir = NULL;
+static char *bulk_topic = NULL;
+
 static std::shared_ptr<ErrmsgHandle> handle;
 static std::shared_ptr<OffsetTable> table;
 static std::unordered_map<std::string,
@@ -52,23 +60,34 @@ void err_cb(rd_kafka_t* rk, int err, const char* reason, void* opaque) {
  */
 void dr_msg_cb(rd_kafka_t* rk, const rd_kafka_message_t* rkmessage,
                void* opaque) {
-  if (rkmessage->err == 0)
+  // release in-flight credit of the topic
+  TopicOpaque* topic_opaque = static_cast<TopicOpaque*>(
+      rd_kafka_topic_opaque(rkmessage->rkt));
+  if (topic_opaque)
+    topic_opaque->flow.Release(1, rkmessage->len);
+
+  // msg_opaque is delivery slot of the line, ack it after handled
+  if (rkmessage->err == 0) {
+    DeliveryTracker::Ack(rkmessage->_private);
     return;
+  }
 
   // handle produce failed message
   const std::string topic = rd_kafka_topic_name(rkmessage->rkt);
   char *payload = static_cast<char *>(rkmessage->payload);
   size_t len = rkmessage->len;
 
-  std::string msg(payload, len);
   if (handle) {
-    handle->ArchiveMsg(topic, msg);
+    handle->ArchiveMsg(topic, payload, len);
     LOG(WARNING) << "dr_msg_cb topic[" << topic << "] partition["
                  << rkmessage->partition << "] failed with error["
                  << rd_kafka_err2str(rkmessage->err) << "]";
   } else {
-    LOG(WARNING) << "dr_msg_cb topic[" << topic << "] msg[" << payload << "]";
+    LOG(WARNING) << "dr_msg_cb topic[" << topic << "] msg["
+                 << std::string(payload, len) << "]";
   }
+
+  DeliveryTracker::Ack(rkmessage->_private);
 }
 
 /**
@@ -151,11 +170,128 @@ void set_signal_handlers() {
   signal(SIGUSR1, signals_handler);
 }
 
+/*
+ * Bulk ingest defaults
+ */
+#define DEFAULT_BULK_INFLIGHT_MESSAGES "500000"
+#define DEFAULT_BULK_INFLIGHT_BYTES "268435456"
+// progress report interval(s)
+#define BULK_REPORT_INTERVAL 10
+
+/**
+ * log bulk ingest progress and throughput since start_us
+ */
+void bulk_report(const BulkIngest* bulk, int64_t start_us) {
+  DeliveryTracker::Stats acked = produce->Acked();
+  double seconds = (NowMicros() - start_us) / 1000000.0;
+  if (seconds <= 0)
+    seconds = 1;
+  LOG(INFO) << "bulk progress enumerated[" << bulk->Enumerated()
+            << "] files[" << acked.files << "/" << bulk->Submitted()
+            << "] skipped[" << produce->Skipped() << "] done before["
+            << bulk->Done() << "] messages[" << acked.messages
+            << "] bytes[" << acked.bytes << "/" << bulk->Bytes()
+            << "] rate[" << static_cast<uint64_t>(acked.messages / seconds)
+            << " msgs/s, " << acked.bytes / seconds / 1048576
+            << " MB/s] elapsed[" << static_cast<uint64_t>(seconds) << "s]";
+}
+
+/**
+ * Produce every file under bulk_dir to bulk_topic and exit when all of
+ * them are acknowledged.
+ */
+int run_bulk(std::shared_ptr<IniConfigParser> conf,
+             std::shared_ptr<Section> global_section,
+             std::shared_ptr<Queue<FileRecord>> queue,
+             std::shared_ptr<KafkaProducer> producer) {
+  const std::string topic = bulk_topic;
+
+  // topic section is optional, files are enumerated by BulkIngest
+  std::shared_ptr<Section> topic_section = conf->GetSection(topic);
+  topic_section = topic_section ? std::make_shared<Section>(*topic_section)
+                                : Section::Init();
+  topic_section->Set("dirs", bulk_dir);
+  topic_section->Set("tail", "false");
+  topic_section->Set("inflight.messages", global_section->Get(
+      "bulk.inflight.messages", DEFAULT_BULK_INFLIGHT_MESSAGES));
+  topic_section->Set("inflight.bytes", global_section->Get(
+      "bulk.inflight.bytes", DEFAULT_BULK_INFLIGHT_BYTES));
+
+  std::shared_ptr<TopicConf> topic_conf = TopicConf::Init(topic);
+  if (!topic_conf || !topic_conf->InitConf(topic_section)) {
+    LOG(ERROR) << "run_bulk TopicConf InitConf topic[" << topic
+               << "] failed";
+    return EXIT_FAILURE;
+  }
+
+  produce = Produce::Init(global_section, std::move(producer), queue, table,
+                          handle, true);
+  if (!produce) {
+    LOG(ERROR) << "run_bulk Produce Init failed";
+    return EXIT_FAILURE;
+  }
+
+  if (!produce->AddTopic(topic_conf)) {
+    LOG(ERROR) << "run_bulk Produce AddTopic topic[" << topic << "] failed";
+    return EXIT_FAILURE;
+  }
+
+  std::unique_ptr<BulkIngest> bulk = BulkIngest::Init(global_section, topic,
+                                                      bulk_dir, queue, table);
+  if (!bulk) {
+    LOG(ERROR) << "run_bulk BulkIngest Init failed";
+    return EXIT_FAILURE;
+  }
+
+  // no reload in bulk mode
+  signal(SIGTERM, signals_handler);
+  signal(SIGINT, signals_handler);
+
+  handle->Start();
+  table->Start();
+  produce->Start();
+  int64_t start_us = NowMicros();
+  bulk->Start();
+
+  bool completed = false;
+  for (int i = 1; !stop; ++i) {
+    sleep(1);
+    // submitted counted before pushed, acked never runs ahead of it
+    uint64_t handled = produce->Acked().files + produce->Skipped();
+    if (bulk->Enumerated() && handled >= bulk->Submitted()) {
+      completed = true;
+      break;
+    }
+    if (i % BULK_REPORT_INTERVAL == 0)
+      bulk_report(bulk.get(), start_us);
+  }
+
+  bulk->Stop();
+  bulk->Join();
+  bulk_report(bulk.get(), start_us);
+
+  produce->Stop();
+  handle->Stop();
+  table->Stop();
+
+  if (!completed) {
+    LOG(WARNING) << "run_bulk stopped before all files acknowledged, run "
+                 << "again to resume";
+    return EXIT_FAILURE;
+  }
+  if (produce->Skipped() > 0) {
+    LOG(WARNING) << "run_bulk files skipped[" << produce->Skipped() << "]";
+    return EXIT_FAILURE;
+  }
+  LOG(INFO) << "run_bulk all files acknowledged";
+  return EXIT_SUCCESS;
+}
+
 int main(int argc, char *argv[]) {
   int opt;
   char *log_conf_path = NULL;
 
-  while ((opt = getopt(argc, argv, "c:l:")) != -1) {
+  while ((opt = getopt(argc, argv, "c:l:b:t:")) != -1) {
     switch (opt) {
       case 'c':
         conf_path = optarg;
@@ -166,9 +302,15 @@ int main(int argc, char *argv[]) {
         std::cerr << "Log config path for log2kafka: " << log_conf_path
                   << std::endl;
         break;
+      case 'b':
+        bulk_dir = optarg;
+        break;
+      case 't':
+        bulk_topic = optarg;
+        break;
       default:
-        std::cerr << "Usage: ./log2kafka -c conf_path -l log_conf_path"
-                  << std::endl;
+        std::cerr << "Usage: ./log2kafka -c conf_path -l log_conf_path "
+                  << "[-b bulk_dir -t topic]" << std::endl;
     }
   }
 
@@ -184,6 +326,12 @@ int main(int argc, char *argv[]) {
     exit(EXIT_FAILURE);
   }
 
+  if ((bulk_dir == NULL) != (bulk_topic == NULL)) {
+    std::cerr << "Usage: ./log2kafka -c conf_path -l log_conf_path "
+              << "-b bulk_dir -t topic" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
   // Init easylogging++
   el::Loggers::addFlag(el::LoggingFlag::StrictLogFileSizeCheck);
   el::Configurations log_conf(log_conf_path);
@@ -198,7 +346,7 @@ int main(int argc, char *argv[]) {
   }
 
   // Init thread safe queue
-  std::shared_ptr<Queue<std::string>> queue = Queue<std::string>::Init();
+  std::shared_ptr<Queue<FileRecord>> queue = Queue<FileRecord>::Init();
   if (!queue) {
     LOG(ERROR) << "Init thread safe queue failed";
     exit(EXIT_FAILURE);
@@ -211,7 +359,14 @@ int main(int argc, char *argv[]) {
     exit(EXIT_FAILURE);
   }
 
-  handle = ErrmsgHandle::Init(global_section, queue);
+  // bulk ingest only archives failed messages, spooled segments are
+  // replayed by the regular log2kafka
+  if (bulk_dir) {
+    global_section = std::make_shared<Section>(*global_section);
+    global_section->Set("handle.remedy", "false");
+  }
+
+  handle = ErrmsgHandle::Init(global_section);
   if (!handle) {
     LOG(ERROR) << "ErrmsgHandle Init failed";
     exit(EXIT_FAILURE);
@@ -272,6 +427,12 @@ int main(int argc, char *argv[]) {
     }
   }
 
+  if (bulk_dir) {
+    int res = run_bulk(conf, global_section, queue, std::move(producer));
+    el::Helpers::uninstallPreRollOutCallback();
+    return res;
+  }
+
   // Init log2kafka topic confs
   for (auto it = conf->Begin(); it != conf->End(); ++it) {
     const std::string topic = it->first;
@@ -292,7 +453,8 @@ int main(int argc, char *argv[]) {
   }
 
   // Init log2kafka produce
-  produce = Produce::Init(std::move(producer), queue, table, handle);
+  produce = Produce::Init(global_section, std::move(producer), queue, table,
+                         handle);
   if (!produce) {
     LOG(ERROR) << "Produce Init failed";
     exit(EXIT_FAILURE);
@@ -332,6 +494,7 @@ int main(int argc, char *argv[]) {
 
   // Stop thread
   produce->Stop();
+  handle->Stop();
   table->Stop();
   el::Helpers::uninstallPreRollOutCallback();
   return 0;
@@ -1,19 +1,229 @@
 // Copyright (c) 2017 Lanceolata
 
 #include "log2kafka/offset_table.h"
+#include <fcntl.h>
 #include <unistd.h>
-#include <fstream>
+#include <errno.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <chrono>
 #include "util/configparser.h"
+#include "util/dir_scanner.h"
 #include "util/string_utils.h"
 #include "easylogging++.h"
 
 namespace log2hdfs {
 
+namespace {
+
+inline std::string InodeKey(dev_t dev, ino_t ino) {
+  return std::to_string(dev) + "\t" + std::to_string(ino);
+}
+
+// path can be recorded as a field of a journal line
+inline bool ValidField(const std::string& path) {
+  return !path.empty() && path.find_first_of("\t\n") == std::string::npos;
+}
+
+/*
+ * Snapshot and journal records, one per line, fields split by '\t'. A
+ * record is complete only with its trailing '\n'.
+ *
+ *   g    <gen>                         snapshot continued by journal gen
+ *   d    <offset> <dir> <file>         dir offset
+ *   r    <dir>                         dir removed
+ *   tail <dev> <ino> <offset> <path>   tail offset
+ *   x    <dev> <ino>                   tail removed
+ *   f    <dev> <ino> <size> <hash> <offset> <path>
+ *                                      produced file
+ *   y    <dev> <ino>                   produced file removed
+ *
+ * Lines of old format "<dir>/<file>:<offset>" are still accepted.
+ */
+#define TAIL_PREFIX "tail\t"
+#define JOURNAL_SUFFIX ".journal."
+
+void AppendDir(std::string* buf, const std::string& dir,
+               const std::string& file, off_t offset) {
+  buf->append("d\t");
+  buf->append(std::to_string(offset));
+  buf->append("\t");
+  buf->append(dir);
+  buf->append("\t");
+  buf->append(file);
+  buf->append("\n");
+}
+
+void AppendTail(std::string* buf, const std::string& key,
+                const std::string& path, off_t offset) {
+  buf->append(TAIL_PREFIX);
+  buf->append(key);
+  buf->append("\t");
+  buf->append(std::to_string(offset));
+  buf->append("\t");
+  buf->append(path);
+  buf->append("\n");
+}
+
+void AppendFile(std::string* buf, const std::string& key,
+                const std::string& path, const OffsetTable::FileIdentity& id,
+                off_t offset) {
+  buf->append("f\t");
+  buf->append(key);
+  buf->append("\t");
+  buf->append(std::to_string(id.size));
+  buf->append("\t");
+  buf->append(std::to_string(id.head_hash));
+  buf->append("\t");
+  buf->append(std::to_string(offset));
+  buf->append("\t");
+  buf->append(path);
+  buf->append("\n");
+}
+
+// whether path still names the inode of key
+inline bool SameInode(const std::string& path, const std::string& key) {
+  struct stat st;
+  return stat(path.c_str(), &st) == 0 &&
+         InodeKey(st.st_dev, st.st_ino) == key;
+}
+
+// inodes of files in a dir, scanned once per compaction
+struct DirInodes {
+  DirInodes(): valid(false) {}
+
+  // false if dir could not be scanned for other reasons than removed
+  bool valid;
+  // "dev\tino" <--> path
+  std::unordered_map<std::string, std::string> paths;
+};
+
+/*
+ * Whether inode of key still exists. Path is the last known path of the
+ * inode, set to the current path if the file was renamed in its dir.
+ * Inodes gone from the dir of their last known path are gone, records
+ * are kept if the dir can not be scanned.
+ */
+bool LocateInode(const std::string& key, std::string* path,
+                 std::unordered_map<std::string, DirInodes>* dirs) {
+  if (SameInode(*path, key))
+    return true;
+
+  std::string dir = DirName(*path);
+  if (dir.empty())
+    dir = ".";
+
+  auto it = dirs->find(dir);
+  if (it == dirs->end()) {
+    DirInodes& inodes = (*dirs)[dir];
+    std::vector<DirEntry> entries;
+    if (DirScanner::Scan(dir, DirScanner::kStat, &entries)) {
+      inodes.valid = true;
+      for (auto& entry : entries) {
+        if (entry.has_stat && entry.IsFile())
+          inodes.paths[InodeKey(entry.st.st_dev, entry.st.st_ino)] =
+              dir + "/" + entry.name;
+      }
+    } else {
+      inodes.valid = errno == ENOENT || errno == ENOTDIR;
+    }
+    it = dirs->find(dir);
+  }
+
+  if (!it->second.valid)
+    return true;
+
+  auto found = it->second.paths.find(key);
+  if (found == it->second.paths.end())
+    return false;
+  *path = found->second;
+  return true;
+}
+
+bool WriteAll(int fd, const std::string& buf) {
+  const char* p = buf.data();
+  size_t left = buf.size();
+  while (left > 0) {
+    ssize_t n = write(fd, p, left);
+    if (n == -1) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    p += n;
+    left -= n;
+  }
+  return true;
+}
+
+/*
+ * Read complete records of file. A last record without '\n' was torn by
+ * a crash, it is dropped and the file is truncated after the last
+ * complete record, so records appended later are not joined to it.
+ */
+bool ReadRecords(const std::string& path, std::vector<std::string>* lines) {
+  int fd = open(path.c_str(), O_RDWR | O_CLOEXEC);
+  if (fd == -1)
+    return false;
+
+  std::string buf;
+  char chunk[65536];
+  while (true) {
+    ssize_t n = read(fd, chunk, sizeof(chunk));
+    if (n == -1) {
+      if (errno == EINTR)
+        continue;
+      close(fd);
+      return false;
+    } else if (n == 0) {
+      break;
+    }
+    buf.append(chunk, n);
+  }
+
+  size_t complete = buf.rfind('\n');
+  complete = complete == std::string::npos ? 0 : complete + 1;
+  if (complete < buf.size()) {
+    LOG(WARNING) << "OffsetTable ReadRecords path[" << path << "] torn "
+                 << "record[" << buf.substr(complete) << "] dropped";
+    if (ftruncate(fd, complete) != 0) {
+      LOG(WARNING) << "OffsetTable ReadRecords ftruncate path[" << path
+                   << "] failed with errno[" << errno << "]";
+    }
+  }
+  close(fd);
+
+  size_t start = 0;
+  while (start < complete) {
+    size_t end = buf.find('\n', start);
+    lines->push_back(buf.substr(start, end - start));
+    start = end + 1;
+  }
+  return true;
+}
+
+bool SyncDir(const std::string& path) {
+  std::string dir = DirName(path);
+  if (dir.empty())
+    dir = ".";
+
+  int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd == -1)
+    return false;
+  int res = fsync(fd);
+  close(fd);
+  return res == 0;
+}
+
+}   // namespace
+
 /*
  * Default configuration
  */
 #define DEFAULT_TABLE_PATH "offset_table"
 #define DEFAULT_TABLE_INTERVAL "30"
+#define DEFAULT_TABLE_COMMIT_MS "1000"
 
 std::shared_ptr<OffsetTable> OffsetTable::Init(
     std::shared_ptr<Section> section) {
@@ -36,19 +246,48 @@ std::shared_ptr<OffsetTable> OffsetTable::Init(
     return nullptr;
   }
 
+  std::string commit_str = section->Get("table.commit.ms",
+                                        DEFAULT_TABLE_COMMIT_MS);
+  int commit_ms = atoi(commit_str.c_str());
+  if (commit_ms <= 0) {
+    LOG(ERROR) << "OffsetTable Init invalid commit.ms[" << commit_ms << "]";
+    return nullptr;
+  }
+
+  // snapshot and journals of one table written by one process only
+  std::string lock_path = path + ".lock";
+  int lock_fd = open(lock_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC,
+                     0644);
+  if (lock_fd == -1) {
+    LOG(ERROR) << "OffsetTable Init open lock[" << lock_path
+               << "] failed with errno[" << errno << "]";
+    return nullptr;
+  }
+
+  if (flock(lock_fd, LOCK_EX | LOCK_NB) != 0) {
+    LOG(ERROR) << "OffsetTable Init flock[" << lock_path << "] failed "
+               << "with errno[" << errno << "], table used by another "
+               << "process";
+    close(lock_fd);
+    return nullptr;
+  }
+
   LOG(INFO) << "OffsetTable Init parameters path[" << path
-            << "] interval[" << interval << "]";
-  return std::make_shared<OffsetTable>(path, interval);
+            << "] interval[" << interval << "] commit.ms[" << commit_ms
+            << "]";
+  return std::make_shared<OffsetTable>(path, interval, commit_ms,
+                                       lock_fd);
 }
 
 bool OffsetTable::Update(const std::string& dir, const std::string& file,
                          off_t offset) {
-  if (dir.empty() || file.empty() || offset < -1)
+  if (!ValidField(dir) || !ValidField(file) || offset < -1)
     return false;
 
   FileOffset fo(file, offset);
   std::lock_guard<std::mutex> lock(mutex_);
   table_[dir] = std::move(fo);
+  dirty_.insert(dir);
   return true;
 }
 
@@ -72,78 +311,506 @@ bool OffsetTable::Remove(const std::string& dir) {
     return false;
 
   std::lock_guard<std::mutex> lock(mutex_);
-  return table_.erase(dir);
+  if (table_.erase(dir) == 0)
+    return false;
+  dirty_.insert(dir);
+  return true;
 }
 
-bool OffsetTable::Save() const {
-  FILE *fp = fopen(path_.c_str(), "w");
-  if (fp == NULL) {
-    LOG(ERROR) << "OffsetTable Save fopen path[" << path_
-               << "] failed with errno[" << errno << "]";
+bool OffsetTable::UpdateTail(dev_t dev, ino_t ino, const std::string& path,
+                             off_t offset) {
+  if (!ValidField(path) || offset < 0)
+    return false;
+
+  FileOffset fo(path, offset);
+  std::string key = InodeKey(dev, ino);
+  std::lock_guard<std::mutex> lock(mutex_);
+  tails_[key] = std::move(fo);
+  dirty_tails_.insert(std::move(key));
+  return true;
+}
+
+bool OffsetTable::GetTail(dev_t dev, ino_t ino, off_t* offset) const {
+  if (!offset)
+    return false;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = tails_.find(InodeKey(dev, ino));
+  if (it == tails_.end())
     return false;
+
+  *offset = it->second.offset_;
+  return true;
+}
+
+bool OffsetTable::RemoveTail(dev_t dev, ino_t ino) {
+  std::string key = InodeKey(dev, ino);
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (tails_.erase(key) == 0)
+    return false;
+  dirty_tails_.insert(std::move(key));
+  return true;
+}
+
+uint64_t OffsetTable::HeadHash(const char* data, size_t size) {
+  // FNV-1a
+  uint64_t hash = 14695981039346656037ULL;
+  size_t len = size < IDENTITY_HEAD_LEN ? size : IDENTITY_HEAD_LEN;
+  for (size_t i = 0; i < len; ++i) {
+    hash ^= static_cast<unsigned char>(data[i]);
+    hash *= 1099511628211ULL;
   }
+  return hash;
+}
+
+bool OffsetTable::UpdateFile(const std::string& path, const FileIdentity& id,
+                             off_t offset) {
+  if (!ValidField(path) || offset < -1)
+    return false;
 
-  char buf[512];
+  std::string key = InodeKey(id.dev, id.ino);
   std::lock_guard<std::mutex> lock(mutex_);
-  for (auto it = table_.begin(); it != table_.end(); ++it) {
-    snprintf(buf, sizeof(buf), "%s/%s:%ld\n", it->first.c_str(),
-             it->second.filename_.c_str(), it->second.offset_);
-    int n = fputs(buf, fp);
-    if (n == EOF) {
-      LOG(ERROR) << "OffsetTable Save fputs path[" << path_
-                 << "] value[" << buf << "] failed";
+  FileState& state = files_[key];
+  state.path = path;
+  state.id = id;
+  state.offset = offset;
+  dirty_files_.insert(std::move(key));
+  return true;
+}
+
+OffsetTable::FileStatus OffsetTable::Classify(const std::string& path,
+                                              const struct stat& st,
+                                              off_t* offset) const {
+  if (path.empty() || !offset)
+    return kFileNew;
+
+  FileState state;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = files_.find(InodeKey(st.st_dev, st.st_ino));
+    if (it == files_.end())
+      return kFileNew;
+    state = it->second;
+  }
+
+  // truncated or inode reused by a smaller file
+  if (st.st_size < state.id.size)
+    return kFileNew;
+
+  // hash the same head length as when produced
+  char buf[IDENTITY_HEAD_LEN];
+  size_t len = static_cast<size_t>(state.id.size);
+  if (len > IDENTITY_HEAD_LEN)
+    len = IDENTITY_HEAD_LEN;
+  if (len > 0) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+      return kFileNew;
+    ssize_t n = pread(fd, buf, len, 0);
+    close(fd);
+    if (n != static_cast<ssize_t>(len))
+      return kFileNew;
+  }
+
+  if (HeadHash(buf, len) != state.id.head_hash)
+    return kFileNew;
+
+  if (state.offset >= 0) {
+    *offset = state.offset;
+    return kFilePartial;
+  }
+
+  // appended after produced
+  if (st.st_size > state.id.size) {
+    *offset = state.id.size;
+    return kFilePartial;
+  }
+  return kFileDone;
+}
+
+bool OffsetTable::UpdatePath(dev_t dev, ino_t ino, const std::string& path) {
+  if (!ValidField(path))
+    return false;
+
+  std::string key = InodeKey(dev, ino);
+  bool res = false;
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = files_.find(key);
+  if (it != files_.end() && it->second.path != path) {
+    it->second.path = path;
+    dirty_files_.insert(key);
+    res = true;
+  }
+
+  auto tail = tails_.find(key);
+  if (tail != tails_.end() && tail->second.filename_ != path) {
+    tail->second.filename_ = path;
+    dirty_tails_.insert(key);
+    res = true;
+  }
+  return res;
+}
+
+bool OffsetTable::RemoveFile(const std::string& key) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (files_.erase(key) == 0)
+    return false;
+  dirty_files_.insert(key);
+  return true;
+}
+
+bool OffsetTable::Save() {
+  bool res = Commit();
+  return Compact() && res;
+}
+
+std::string OffsetTable::JournalPath(uint64_t gen) const {
+  return path_ + JOURNAL_SUFFIX + std::to_string(gen);
+}
+
+bool OffsetTable::OpenJournal(uint64_t gen) {
+  int fd = open(JournalPath(gen).c_str(),
+                O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (fd == -1) {
+    LOG(ERROR) << "OffsetTable OpenJournal path[" << JournalPath(gen)
+               << "] failed with errno[" << errno << "]";
+    return false;
+  }
+
+  if (journal_fd_ != -1)
+    close(journal_fd_);
+  journal_fd_ = fd;
+  gen_ = gen;
+  return true;
+}
+
+bool OffsetTable::Commit() {
+  // group commit all changes since last commit with one write and sync
+  std::string buf;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (dirty_.empty() && dirty_tails_.empty() && dirty_files_.empty())
+      return true;
+
+    for (auto& dir : dirty_) {
+      auto it = table_.find(dir);
+      if (it == table_.end()) {
+        buf.append("r\t" + dir + "\n");
+      } else {
+        AppendDir(&buf, dir, it->second.filename_, it->second.offset_);
+      }
+    }
+
+    for (auto& key : dirty_tails_) {
+      auto it = tails_.find(key);
+      if (it == tails_.end()) {
+        buf.append("x\t" + key + "\n");
+      } else {
+        AppendTail(&buf, key, it->second.filename_, it->second.offset_);
+      }
     }
+
+    for (auto& key : dirty_files_) {
+      auto it = files_.find(key);
+      if (it == files_.end()) {
+        buf.append("y\t" + key + "\n");
+      } else {
+        AppendFile(&buf, key, it->second.path, it->second.id,
+                   it->second.offset);
+      }
+    }
+    dirty_.clear();
+    dirty_tails_.clear();
+    dirty_files_.clear();
+  }
+
+  std::lock_guard<std::mutex> guard(journal_mutex_);
+  if (journal_fd_ == -1 && !OpenJournal(gen_))
+    return false;
+
+  if (!WriteAll(journal_fd_, buf) || fdatasync(journal_fd_) != 0) {
+    // records are kept in memory, next snapshot saves them
+    LOG(ERROR) << "OffsetTable Commit journal[" << JournalPath(gen_)
+               << "] failed with errno[" << errno << "]";
+    return false;
   }
-  fclose(fp);
   return true;
 }
 
-void OffsetTable::Remedy() {
-  std::ifstream ifs(path_);
-  if (!ifs.is_open()) {
-    LOG(ERROR) << "OffsetTable Remedy ifstream path[" << path_
-               << "] open failed";
-    return;
+bool OffsetTable::Compact() {
+  std::lock_guard<std::mutex> guard(journal_mutex_);
+  uint64_t old_gen = gen_;
+  uint64_t gen = gen_ + 1;
+
+  // Changes after this point are committed to journal gen, the snapshot
+  // covers journal old_gen. Dirty keys stay dirty and are committed to
+  // journal gen as well, replay of newer records is idempotent.
+  std::string buf = "g\t" + std::to_string(gen) + "\n";
+  std::vector<std::pair<std::string, FileOffset>> tails;
+  std::vector<std::pair<std::string, FileState>> files;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = table_.begin(); it != table_.end(); ++it)
+      AppendDir(&buf, it->first, it->second.filename_, it->second.offset_);
+
+    tails.reserve(tails_.size());
+    for (auto& it : tails_)
+      tails.push_back(it);
+
+    files.reserve(files_.size());
+    for (auto& it : files_)
+      files.push_back(it);
   }
 
-  std::string line;
-  while (getline(ifs, line)) {
-    std::vector<std::string> vec = SplitString(line, ":",
-        kTrimWhitespace, kSplitNonempty);
-    if (vec.size() != 2) {
-      LOG(WARNING) << "OffsetTable Remedy invalid line[" << line << "]";
+  // locate files without blocking updates, records follow renamed files
+  // and are dropped once the inode is gone
+  std::unordered_map<std::string, DirInodes> dirs;
+  for (auto& it : tails) {
+    std::string path = it.second.filename_;
+    if (!LocateInode(it.first, &path, &dirs)) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (dirty_tails_.find(it.first) == dirty_tails_.end())
+        tails_.erase(it.first);
       continue;
     }
 
-    if (!IsFile(vec[0])) {
-      LOG(WARNING) << "OffsetTable Remedy line[" << line << "] not exists";
+    if (path != it.second.filename_) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto found = tails_.find(it.first);
+      if (found != tails_.end() &&
+          found->second.filename_ == it.second.filename_)
+        found->second.filename_ = path;
+    }
+    AppendTail(&buf, it.first, path, it.second.offset_);
+  }
+
+  for (auto& it : files) {
+    std::string path = it.second.path;
+    if (!LocateInode(it.first, &path, &dirs)) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (dirty_files_.find(it.first) == dirty_files_.end())
+        files_.erase(it.first);
       continue;
     }
 
-    std::string dir = DirName(vec[0]);
-    std::string file = BaseName(vec[0]);
-    off_t offset = atol(vec[1].c_str());
-    if (dir.empty() || file.empty() || offset < -1) {
-      LOG(WARNING) << "OffsetTable Remedy invalid line[" << line << "]";
+    if (path != it.second.path) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto found = files_.find(it.first);
+      if (found != files_.end() && found->second.path == it.second.path)
+        found->second.path = path;
+    }
+    AppendFile(&buf, it.first, path, it.second.id, it.second.offset);
+  }
+
+  std::string tmp_path = path_ + ".tmp";
+  int fd = open(tmp_path.c_str(),
+                O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd == -1) {
+    LOG(ERROR) << "OffsetTable Compact open path[" << tmp_path
+               << "] failed with errno[" << errno << "]";
+    return false;
+  }
+
+  if (!WriteAll(fd, buf) || fsync(fd) != 0) {
+    LOG(ERROR) << "OffsetTable Compact write path[" << tmp_path
+               << "] failed with errno[" << errno << "]";
+    close(fd);
+    unlink(tmp_path.c_str());
+    return false;
+  }
+  close(fd);
+
+  // open next journal before snapshot points to it
+  int old_fd = journal_fd_;
+  journal_fd_ = -1;
+  if (!OpenJournal(gen)) {
+    journal_fd_ = old_fd;
+    unlink(tmp_path.c_str());
+    return false;
+  }
+
+  if (!Rename(tmp_path, path_) || !SyncDir(path_)) {
+    LOG(ERROR) << "OffsetTable Compact rename from[" << tmp_path << "] to["
+               << path_ << "] failed with errno[" << errno << "]";
+    // keep appending to new journal, it is replayed after old one
+    if (old_fd != -1)
+      close(old_fd);
+    return false;
+  }
+
+  if (old_fd != -1)
+    close(old_fd);
+  unlink(JournalPath(old_gen).c_str());
+  return true;
+}
+
+void OffsetTable::Remedy() {
+  // step 1: load snapshot
+  std::vector<std::string> lines;
+  if (IsFile(path_)) {
+    if (!ReadRecords(path_, &lines)) {
+      LOG(ERROR) << "OffsetTable Remedy ReadRecords path[" << path_
+                 << "] failed with errno[" << errno << "]";
+    }
+    for (auto& line : lines)
+      Replay(line);
+  }
+  uint64_t snapshot_gen = gen_;
+
+  // step 2: replay journals continuing snapshot in order
+  std::string dir = DirName(path_);
+  if (dir.empty())
+    dir = ".";
+  std::string prefix = BaseName(path_) + JOURNAL_SUFFIX;
+
+  std::vector<DirEntry> entries;
+  std::vector<uint64_t> gens;
+  if (DirScanner::Scan(dir, DirScanner::kNone, &entries)) {
+    for (auto& entry : entries) {
+      if (StartsWith(entry.name, prefix))
+        gens.push_back(strtoull(entry.name.c_str() + prefix.size(), NULL,
+                                10));
+    }
+  }
+  std::sort(gens.begin(), gens.end());
+
+  uint64_t max_gen = snapshot_gen;
+  for (auto gen : gens) {
+    if (gen < snapshot_gen) {
+      unlink(JournalPath(gen).c_str());
       continue;
     }
 
-    if (Update(dir, file, offset)) {
-      LOG(INFO) << "OffsetTable Remedy construct record dir[" << dir
-                << "] file[" << file << "] offset[" << offset << "] success";
-    } else {
-      LOG(WARNING) << "OffsetTable Remedy construct record dir[" << dir
-                   << "] file[" << file << "] offset[" << offset << "] failed";
+    lines.clear();
+    if (!ReadRecords(JournalPath(gen), &lines)) {
+      LOG(ERROR) << "OffsetTable Remedy ReadRecords path["
+                 << JournalPath(gen) << "] failed with errno[" << errno
+                 << "]";
     }
+    for (auto& line : lines)
+      Replay(line);
+    max_gen = gen;
   }
-  ifs.close();
+
+  // step 3: drop records of files no longer exist
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = table_.begin(); it != table_.end();) {
+      std::string path = it->first + "/" + it->second.filename_;
+      if (!IsFile(path)) {
+        LOG(WARNING) << "OffsetTable Remedy path[" << path
+                     << "] not exists";
+        it = table_.erase(it);
+      } else {
+        LOG(INFO) << "OffsetTable Remedy construct record path[" << path
+                  << "] offset[" << it->second.offset_ << "] success";
+        ++it;
+      }
+    }
+
+    std::unordered_map<std::string, DirInodes> dirs;
+    for (auto it = tails_.begin(); it != tails_.end();) {
+      if (!LocateInode(it->first, &it->second.filename_, &dirs)) {
+        LOG(WARNING) << "OffsetTable Remedy tail path["
+                     << it->second.filename_ << "] file gone";
+        it = tails_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+
+    for (auto it = files_.begin(); it != files_.end();) {
+      if (!LocateInode(it->first, &it->second.path, &dirs)) {
+        it = files_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    dirty_.clear();
+    dirty_tails_.clear();
+    dirty_files_.clear();
+  }
+
+  OpenJournal(max_gen);
+}
+
+void OffsetTable::Replay(const std::string& line) {
+  if (line.empty())
+    return;
+
+  // fields kept as written, paths may have leading or trailing spaces
+  std::vector<std::string> vec = SplitString(line, "\t",
+      kKeepWhitespace, kSplitAll);
+  if (vec.empty()) {
+    LOG(WARNING) << "OffsetTable Replay invalid line[" << line << "]";
+    return;
+  }
+
+  const std::string& type = vec[0];
+  if (type == "g" && vec.size() == 2) {
+    gen_ = strtoull(vec[1].c_str(), NULL, 10);
+  } else if (type == "d" && vec.size() == 4) {
+    Update(vec[2], vec[3], atol(vec[1].c_str()));
+  } else if (type == "r" && vec.size() == 2) {
+    Remove(vec[1]);
+  } else if (type == "tail" && vec.size() == 5) {
+    RemedyTail(vec);
+  } else if (type == "f" && vec.size() == 7) {
+    RemedyFile(vec);
+  } else if (type == "y" && vec.size() == 3) {
+    RemoveFile(vec[1] + "\t" + vec[2]);
+  } else if (type == "x" && vec.size() == 3) {
+    RemoveTail(strtoul(vec[1].c_str(), NULL, 10),
+               strtoul(vec[2].c_str(), NULL, 10));
+  } else if (vec.size() == 1) {
+    // old format "<dir>/<file>:<offset>"
+    auto end = line.rfind(":");
+    if (end == std::string::npos) {
+      LOG(WARNING) << "OffsetTable Replay invalid line[" << line << "]";
+      return;
+    }
+
+    std::string path = line.substr(0, end);
+    std::string dir = DirName(path);
+    std::string file = BaseName(path);
+    off_t offset = atol(line.c_str() + end + 1);
+    if (dir.empty() || file.empty() || offset < -1) {
+      LOG(WARNING) << "OffsetTable Replay invalid line[" << line << "]";
+      return;
+    }
+    Update(dir, file, offset);
+  } else {
+    LOG(WARNING) << "OffsetTable Replay invalid line[" << line << "]";
+  }
+}
+
+void OffsetTable::RemedyTail(const std::vector<std::string>& vec) {
+  dev_t dev = strtoul(vec[1].c_str(), NULL, 10);
+  ino_t ino = strtoul(vec[2].c_str(), NULL, 10);
+  off_t offset = atol(vec[3].c_str());
+  UpdateTail(dev, ino, vec[4], offset);
+}
+
+void OffsetTable::RemedyFile(const std::vector<std::string>& vec) {
+  FileIdentity id;
+  id.dev = strtoul(vec[1].c_str(), NULL, 10);
+  id.ino = strtoul(vec[2].c_str(), NULL, 10);
+  id.size = atol(vec[3].c_str());
+  id.head_hash = strtoull(vec[4].c_str(), NULL, 10);
+  UpdateFile(vec[6], id, atol(vec[5].c_str()));
 }
 
 void OffsetTable::StartInternal() {
   LOG(INFO) << "OffsetTable thread created";
+  time_t last_compact = time(NULL);
   while (!stop_.load()) {
-    sleep(interval_);
-    Save();
+    std::this_thread::sleep_for(std::chrono::milliseconds(commit_ms_));
+    Commit();
+
+    if (time(NULL) - last_compact >= interval_) {
+      Compact();
+      last_compact = time(NULL);
+    }
   }
   LOG(INFO) << "OffsetTable thread existing";
 }
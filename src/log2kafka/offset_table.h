@@ -3,12 +3,17 @@
 #ifndef LOG2HDFS_LOG2KAFKA_OFFSET_TABLE_H_
 #define LOG2HDFS_LOG2KAFKA_OFFSET_TABLE_H_
 
+#include <unistd.h>
+#include <stdint.h>
+#include <sys/stat.h>
 #include <string>
+#include <vector>
 #include <memory>
 #include <mutex>
 #include <thread>
 #include <atomic>
 #include <unordered_map>
+#include <unordered_set>
 #include "util/system_utils.h"
 
 namespace log2hdfs {
@@ -17,11 +22,56 @@ class Section;
 
 /**
  * Archive offset
+ * 
+ * Changes are appended to a journal by group commit every commit
+ * interval, the journal is compacted into a snapshot every interval.
+ * Snapshot is written to a temp file, fsynced and renamed, and names
+ * the journal generation that continues it. On startup the snapshot is
+ * loaded and newer journals are replayed.
+ *
+ * Besides the offset of the last file per dir, every produced file is
+ * recorded by identity (dev, inode, size and hash of its head), so a
+ * restart resumes each file exactly instead of guessing by ctime. The
+ * path of a record follows renames seen by scans, inotify moves or
+ * compaction, the record is dropped only once the inode is gone from the
+ * dir of its last known path.
+ *
+ * Records are tab separated lines, paths containing '\t' or '\n' are
+ * rejected.
  */
 class OffsetTable {
  public:
+  /**
+   * Identity of a produced file.
+   */
+  // bytes of file head hashed into file identity
+  static const size_t IDENTITY_HEAD_LEN = 4096;
+
+  struct FileIdentity {
+    FileIdentity(): dev(0), ino(0), size(0), head_hash(0) {}
+
+    dev_t dev;
+    ino_t ino;
+    // file size when produced
+    off_t size;
+    // see HeadHash()
+    uint64_t head_hash;
+  };
+
+  /**
+   * Produce status of a file
+   */
+  enum FileStatus {
+    kFileNew,
+    kFilePartial,
+    kFileDone,
+  };
+
   /**
    * Static function to create a OffsetTable shared_ptr
+   *
+   * Takes an exclusive flock on `<path>.lock`, fails if another process
+   * holds the table.
    * 
    * @param section             Ini configuration section
    * 
@@ -35,12 +85,15 @@ class OffsetTable {
    * Constructor
    * 
    * @param path                archive file path
-   * @param interval            archive interval
+   * @param interval            snapshot interval(s)
+   * @param commit_ms           journal commit interval(ms)
+   * @param lock_fd             locked fd of table, closed in destructor
    */
-  OffsetTable(const std::string& path, int interval):
-      path_(path), interval_(interval), stop_(true) {
-    if (IsFile(path_))
-      Remedy();
+  OffsetTable(const std::string& path, int interval, int commit_ms,
+              int lock_fd = -1):
+      path_(path), interval_(interval), commit_ms_(commit_ms),
+      lock_fd_(lock_fd), journal_fd_(-1), gen_(0), stop_(true) {
+    Remedy();
   }
 
   /**
@@ -50,6 +103,10 @@ class OffsetTable {
    */
   ~OffsetTable() {
     Stop();
+    if (journal_fd_ != -1)
+      close(journal_fd_);
+    if (lock_fd_ != -1)
+      close(lock_fd_);
   }
 
   OffsetTable(const OffsetTable& other) = delete;
@@ -85,12 +142,96 @@ class OffsetTable {
   bool Remove(const std::string& dir);
 
   /**
-   * Archive to local file.
+   * Update tail offset of a growing file.
+   *
+   * Tail records are keyed by inode, so they follow the file when it is
+   * renamed by log rotation, and are dropped only once the inode is gone.
+   *
+   * @param dev                 file device
+   * @param ino                 file inode
+   * @param path                current file path
+   * @param offset              offset after last complete line
+   *
+   * @returns True if update success, false otherwise.
    */
-  bool Save() const;
+  bool UpdateTail(dev_t dev, ino_t ino, const std::string& path,
+                  off_t offset);
 
   /**
-   * Load offset table from local file.
+   * Get tail offset of a growing file.
+   *
+   * @param dev                 file device
+   * @param ino                 file inode
+   * @param offset              offset to set
+   *
+   * @returns True if get success, false otherwise.
+   */
+  bool GetTail(dev_t dev, ino_t ino, off_t* offset) const;
+
+  /**
+   * Remove tail record of a file.
+   *
+   * @param dev                 file device
+   * @param ino                 file inode
+   */
+  bool RemoveTail(dev_t dev, ino_t ino);
+
+  /**
+   * Hash of file head, identifies a file together with dev and inode
+   * when inodes are reused.
+   *
+   * @param data                file data
+   * @param size                file size, only the head is hashed
+   *
+   * @returns hash of head.
+   */
+  static uint64_t HeadHash(const char* data, size_t size);
+
+  /**
+   * Update produce offset of a file.
+   *
+   * @param path                file path
+   * @param id                  file identity
+   * @param offset              offset after last acked line, -1 for done
+   *
+   * @returns True if update success, false otherwise.
+   */
+  bool UpdateFile(const std::string& path, const FileIdentity& id,
+                  off_t offset);
+
+  /**
+   * Classify a file by identity.
+   *
+   * @param path                file path
+   * @param st                  stat of file
+   * @param offset              set to resume offset on kFilePartial
+   *
+   * @returns kFileDone if file produced, kFilePartial if file produced to
+   *          offset or appended after produced, kFileNew if file unknown
+   *          or replaced.
+   */
+  FileStatus Classify(const std::string& path, const struct stat& st,
+                      off_t* offset) const;
+
+  /**
+   * Refresh path of records of an inode, called when the inode is seen
+   * under a new name.
+   *
+   * @param dev                 file device
+   * @param ino                 file inode
+   * @param path                current file path
+   *
+   * @returns True if path changed, false otherwise.
+   */
+  bool UpdatePath(dev_t dev, ino_t ino, const std::string& path);
+
+  /**
+   * Commit changes to journal and compact journal to snapshot.
+   */
+  bool Save();
+
+  /**
+   * Load offset table from snapshot and journals.
    */
   void Remedy();
 
@@ -120,6 +261,28 @@ class OffsetTable {
  private:
   void StartInternal();
 
+  bool Commit();
+
+  bool Compact();
+
+  bool OpenJournal(uint64_t gen);
+
+  std::string JournalPath(uint64_t gen) const;
+
+  void Replay(const std::string& line);
+
+  void RemedyTail(const std::vector<std::string>& vec);
+
+  void RemedyFile(const std::vector<std::string>& vec);
+
+  bool RemoveFile(const std::string& key);
+
+  struct FileState {
+    std::string path;
+    FileIdentity id;
+    off_t offset;
+  };
+
   class FileOffset {
    public:
     FileOffset(): filename_(), offset_(0) {}
@@ -153,11 +316,25 @@ class OffsetTable {
 
   std::string path_;
   int interval_;
+  int commit_ms_;
+  int lock_fd_;
+  // journal_fd_ and gen_ guarded by journal_mutex_
+  std::mutex journal_mutex_;
+  int journal_fd_;
+  uint64_t gen_;
   mutable std::mutex mutex_;
   std::atomic<bool> stop_;
   std::mutex thread_mutex_;
   std::thread thread_;
   std::unordered_map<std::string, FileOffset> table_;
+  // "dev\tino" <--> path and tail offset
+  std::unordered_map<std::string, FileOffset> tails_;
+  // "dev\tino" <--> produced file
+  std::unordered_map<std::string, FileState> files_;
+  // keys changed since last commit
+  std::unordered_set<std::string> dirty_;
+  std::unordered_set<std::string> dirty_tails_;
+  std::unordered_set<std::string> dirty_files_;
 };
 
 }   // namespace log2hdfs
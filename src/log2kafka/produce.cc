@@ -1,29 +1,73 @@
 // Copyright (c) 2017 Lanceolata
 
 #include "log2kafka/produce.h"
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <chrono>
+#include <functional>
+#include <vector>
 #include "log2kafka/topic_conf.h"
 #include "log2kafka/offset_table.h"
 #include "log2kafka/errmsg_handle.h"
+#include "log2kafka/delivery_tracker.h"
+#include "log2kafka/topic_opaque.h"
+#include "log2kafka/field_partitioner.h"
 #include "kafka/kafka_producer.h"
 #include "kafka/kafka_topic_producer.h"
+#include "util/configparser.h"
 #include "util/string_utils.h"
 #include "util/system_utils.h"
 #include "easylogging++.h"
 
 namespace log2hdfs {
 
+/*
+ * Default configuration
+ */
+#define DEFAULT_PRODUCE_WORKERS "1"
+#define DEFAULT_BULK_WORKERS "8"
+
+// Max wait for in flight messages on Stop
+#define STOP_FLUSH_TIMEOUT_MS 10000
+
 std::unique_ptr<Produce> Produce::Init(
+    std::shared_ptr<Section> section,
     std::shared_ptr<KafkaProducer> producer,
-    std::shared_ptr<Queue<std::string>> queue,
+    std::shared_ptr<Queue<FileRecord>> queue,
     std::shared_ptr<OffsetTable> table,
-    std::shared_ptr<ErrmsgHandle> handle) {
-  if (!producer || !queue || !table || !handle) {
+    std::shared_ptr<ErrmsgHandle> handle,
+    bool bulk) {
+  if (!section || !producer || !queue || !table || !handle) {
     LOG(ERROR) << "Produce Init invalid parameters";
     return nullptr;
   }
+
+  std::string workers_str = bulk ?
+      section->Get("bulk.workers", DEFAULT_BULK_WORKERS) :
+      section->Get("produce.workers", DEFAULT_PRODUCE_WORKERS);
+  int workers = atoi(workers_str.c_str());
+  if (workers <= 0 || workers > 256) {
+    LOG(ERROR) << "Produce Init invalid workers[" << workers_str << "]";
+    return nullptr;
+  }
+
+  std::shared_ptr<DeliveryTracker> tracker = DeliveryTracker::Init(table);
+  if (!tracker) {
+    LOG(ERROR) << "Produce Init DeliveryTracker failed";
+    return nullptr;
+  }
+
+  std::shared_ptr<Queue<FileRecord>> replay_queue = handle->replay_queue();
+  int replay_rate = handle->replay_rate();
+
+  LOG(INFO) << "Produce Init parameters workers[" << workers << "] bulk["
+            << bulk << "]";
   return std::unique_ptr<Produce>(new Produce(
-             std::move(producer), std::move(queue),
-             std::move(table), std::move(handle)));
+             workers, std::move(producer), std::move(queue),
+             std::move(table), std::move(tracker), std::move(handle),
+             std::move(replay_queue), replay_rate, bulk));
 }
 
 bool Produce::AddTopic(std::shared_ptr<TopicConf> conf) {
@@ -35,6 +79,26 @@ bool Produce::AddTopic(std::shared_ptr<TopicConf> conf) {
   std::unique_ptr<KafkaTopicConf> topic_conf = conf->kafka_topic_conf();
   const std::string topic = conf->topic();
 
+  // topic readded after removed reuses its opaque, messages of the
+  // removed topic producer might still be in flight
+  std::shared_ptr<TopicOpaque> opaque;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = opaques_.find(topic);
+    if (it != opaques_.end()) {
+      opaque = it->second;
+    } else {
+      opaque = std::make_shared<TopicOpaque>(conf->inflight_messages(),
+                                             conf->inflight_bytes(),
+                                             conf->partition_spread());
+      opaques_[topic] = opaque;
+    }
+  }
+  topic_conf->SetOpaque(opaque.get());
+
+  if (conf->field_partitioner())
+    topic_conf->SetPartitionerCb(FieldPartitioner::Partition);
+
   std::string errstr;
   std::shared_ptr<KafkaTopicProducer> ktp = producer_->CreateTopicProducer(
       topic, topic_conf.get(), &errstr);
@@ -84,158 +148,605 @@ bool Produce::RemoveTopic(const std::string& topic) {
   return true;
 }
 
+void Produce::Start() {
+  std::lock_guard<std::mutex> lock(thread_mutex_);
+  if (thread_.joinable())
+    return;
+
+  stop_.store(false);
+  poll_stop_.store(false);
+  poll_thread_ = std::thread(&Produce::PollInternal, this);
+  for (size_t i = 0; i < worker_queues_.size(); ++i)
+    workers_.push_back(std::thread(&Produce::WorkerInternal, this, i));
+  replay_thread_ = std::thread(&Produce::ReplayInternal, this);
+
+  std::thread t(&Produce::StartInternal, this);
+  thread_ = std::move(t);
+}
+
+void Produce::Stop() {
+  stop_.store(true);
+  std::lock_guard<std::mutex> lock(thread_mutex_);
+  if (!thread_.joinable())
+    return;
+
+  // push empty record to avoid WaitPop.
+  queue_->Push(FileRecord());
+  thread_.join();
+
+  for (auto& worker_queue : worker_queues_)
+    worker_queue->Push(FileRecord());
+
+  for (auto& worker : workers_)
+    worker.join();
+  workers_.clear();
+
+  replay_queue_->Push(FileRecord());
+  replay_thread_.join();
+
+  // deliver in flight messages so their offsets are committed, the rest
+  // is produced again after restart
+  if (!producer_->Flush(STOP_FLUSH_TIMEOUT_MS)) {
+    LOG(WARNING) << "Produce Stop flush timeout[" << STOP_FLUSH_TIMEOUT_MS
+                 << "ms] outq len[" << producer_->OutqLen() << "]";
+  }
+
+  // serve delivery reports until all produce threads exited
+  poll_stop_.store(true);
+  poll_thread_.join();
+}
+
 void Produce::StartInternal() {
-  LOG(INFO) << "Log2kafkaProduce thread created";
+  LOG(INFO) << "Produce dispatch thread created";
 
+  std::hash<std::string> hasher;
+  size_t num = worker_queues_.size();
+  size_t next = 0;
+  FileRecord record;
   while (!stop_.load()) {
-    std::shared_ptr<std::string> record = queue_->WaitPop();
-    if (!record || record->empty()) {
+    queue_->WaitPop(&record);
+    if (record.empty()) {
       LOG(INFO) << "Produce StartInternal WaitPop null";
       continue;
     }
 
-    // check record
-    std::vector<std::string> vec = SplitString(*record, ":",
-        kTrimWhitespace, kSplitNonempty);
-    if (vec.size() < 3) {
-      LOG(WARNING) << "Produce StartInternal invalid record[" << *record<< "]";
-      continue;
+    // Files in one dir go to the same worker to keep offsets in order,
+    // bulk mode spreads files round-robin, offsets are kept per file
+    size_t index = 0;
+    if (spread_) {
+      index = next++ % num;
+    } else if (num > 1) {
+      index = hasher(DirName(record.path)) % num;
     }
+    worker_queues_[index]->Push(std::move(record));
+  }
 
-    const std::string& topic = vec[0];
-    const std::string& path = vec[1];
-    off_t offset = atol(vec[2].c_str());
-    if (topic.empty() || path.empty() || offset < -1) {
-      LOG(WARNING) << "Produce StartInternal invalid record topic[" << topic
-                   << "] path[" << path << "] offset[" << offset << "]";
+  LOG(INFO) << "Produce dispatch thread existing";
+}
+
+void Produce::WorkerInternal(size_t index) {
+  LOG(INFO) << "Produce worker[" << index << "] thread created";
+
+  std::shared_ptr<Queue<FileRecord>> queue = worker_queues_[index];
+  FileRecord record;
+  while (!stop_.load()) {
+    queue->WaitPop(&record);
+    if (record.empty()) {
+      LOG(INFO) << "Produce WorkerInternal WaitPop null";
       continue;
     }
 
-    if (!IsFile(path)) {
-      LOG(WARNING) << "Produce StartInternal IsFile failed topic[" << topic
-                   << "] path[" << path << "] offset[" << "offset" << "]";
+    Context ctx;
+    if (!Prepare(record, &ctx)) {
+      files_skipped_.fetch_add(1);
       continue;
     }
 
-    // get topic producer
-    std::shared_ptr<KafkaTopicProducer> ktp =
-        producer_->GetTopicProducer(topic);
-    if (!ktp) {
-      LOG(WARNING) << "Produce StartInternal GetTopicProducer topic["
-                   << topic << "] failed";
+    if (ctx.tail) {
+      ProduceTail(record, &ctx);
+    } else if (!ProduceAndSave(record, &ctx)) {
+      files_skipped_.fetch_add(1);
+    }
+  }
+
+  LOG(INFO) << "Produce worker[" << index << "] thread existing";
+}
+
+void Produce::ReplayInternal() {
+  LOG(INFO) << "Produce replay thread created";
+
+  FileRecord record;
+  while (!stop_.load()) {
+    replay_queue_->WaitPop(&record);
+    if (record.empty()) {
+      LOG(INFO) << "Produce ReplayInternal WaitPop null";
       continue;
     }
 
-    // get topic conf
-    std::unique_lock<std::mutex> lock(mutex_);
+    Context ctx;
+    if (!Prepare(record, &ctx))
+      continue;
+
+    ProduceAndSave(record, &ctx, true);
+  }
+
+  LOG(INFO) << "Produce replay thread existing";
+}
+
+#define REPLAY_YIELD_MS 100
+
+void Produce::ReplayWait(size_t num) {
+  // fresh files first, replay must not delay recovery of live data
+  while (!stop_.load()) {
+    bool fresh = !queue_->Empty();
+    for (size_t i = 0; !fresh && i < worker_queues_.size(); ++i)
+      fresh = !worker_queues_[i]->Empty();
+    if (!fresh)
+      break;
+    std::this_thread::sleep_for(std::chrono::milliseconds(REPLAY_YIELD_MS));
+  }
+
+  // pace num messages at replay_rate_ per second
+  int64_t now = NowMicros();
+  if (replay_next_us_ > now) {
+    std::this_thread::sleep_for(
+        std::chrono::microseconds(replay_next_us_ - now));
+  } else {
+    replay_next_us_ = now;
+  }
+  replay_next_us_ += static_cast<int64_t>(num) * 1000000 / replay_rate_;
+}
+
+#define POLL_INTERVAL_MS 100
+
+void Produce::PollInternal() {
+  LOG(INFO) << "Produce poll thread created";
+
+  while (!poll_stop_.load())
+    producer_->Poll(POLL_INTERVAL_MS);
+
+  LOG(INFO) << "Produce poll thread existing";
+}
+
+bool Produce::Prepare(const FileRecord& record, Context* ctx) {
+  const std::string& topic = record.topic();
+  const std::string& path = record.path;
+  off_t offset = record.offset;
+  if (topic.empty() || offset < -1) {
+    LOG(WARNING) << "Produce Prepare invalid record topic[" << topic
+                 << "] path[" << path << "] offset[" << offset << "]";
+    return false;
+  }
+
+  if (!IsFile(path)) {
+    LOG(WARNING) << "Produce Prepare IsFile failed topic[" << topic
+                 << "] path[" << path << "] offset[" << offset << "]";
+    return false;
+  }
+
+  // get topic producer
+  ctx->ktp = producer_->GetTopicProducer(topic);
+  if (!ctx->ktp) {
+    LOG(WARNING) << "Produce Prepare GetTopicProducer topic["
+                 << topic << "] failed";
+    return false;
+  }
+
+  // get topic conf
+  std::shared_ptr<TopicConf> conf;
+  std::shared_ptr<TopicOpaque> opaque;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
     auto it = topic_confs_.find(topic);
     if (it == topic_confs_.end()) {
-      LOG(WARNING) << "Produce StartInternal invalid topic_confs topic["
+      LOG(WARNING) << "Produce Prepare invalid topic_confs topic["
                    << topic << "]";
-      lock.unlock();
-      continue;
+      return false;
+    }
+    conf = it->second;
+
+    auto it2 = opaques_.find(topic);
+    if (it2 == opaques_.end()) {
+      LOG(WARNING) << "Produce Prepare invalid opaques topic["
+                   << topic << "]";
+      return false;
     }
+    opaque = it2->second;
+  }
+
+  // runtime configurations
+  opaque->flow.SetBudget(conf->inflight_messages(), conf->inflight_bytes());
+  opaque->partition_spread.store(conf->partition_spread());
+
+  ctx->batch = conf->batch_num();
+  ctx->timeout = conf->poll_timeout();
+  ctx->tail = conf->tail();
+  ctx->flow = &opaque->flow;
+  ctx->extractor = conf->timestamp_extractor();
+  ctx->partitioner = conf->field_partitioner();
+  return true;
+}
+
+#define PRODUCE_TRY_NUM 3
 
-    std::shared_ptr<TopicConf> conf = it->second;
-    lock.unlock();
+namespace {
+
+inline bool Retriable(rd_kafka_resp_err_t err) {
+  return err != RD_KAFKA_RESP_ERR_MSG_SIZE_TOO_LARGE &&
+         err != RD_KAFKA_RESP_ERR__UNKNOWN_TOPIC &&
+         err != RD_KAFKA_RESP_ERR__UNKNOWN_PARTITION;
+}
 
-    // get conf parameter
-    int batch = conf->batch_num();
-    int timeout = conf->poll_timeout();
-    int msgs = conf->poll_messages();
+/**
+ * Produce messages in batch, retry failed messages PRODUCE_TRY_NUM
+ * times and archive the rest. Archived messages ack their delivery
+ * slot.
+ *
+ * Credit of the batch is acquired before produce, and released by
+ * delivery reports or when messages are archived here.
+ *
+ * timestamps are create time of msgs, empty if not extracted.
+ *
+ * @returns number of archived messages.
+ */
+size_t ProduceBatch(KafkaTopicProducer* ktp,
+                    FlowControl* flow,
+                    ErrmsgHandle* handle,
+                    const std::string& path,
+                    int msgflags,
+                    int timeout,
+                    std::vector<rd_kafka_message_t>* msgs,
+                    std::vector<int64_t>* timestamps) {
+  if (msgs->empty())
+    return 0;
+
+  size_t bytes = 0;
+  for (auto& msg : *msgs)
+    bytes += msg.len;
+  flow->Acquire(msgs->size(), bytes);
+
+  size_t archived = 0;
+  for (int i = 0; i < PRODUCE_TRY_NUM && !msgs->empty();) {
+    int num = static_cast<int>(msgs->size());
+    int n;
+    if (timestamps->empty()) {
+      n = ktp->ProduceBatch(msgs->data(), num, msgflags);
+    } else {
+      n = ktp->ProduceBatch(msgs->data(), timestamps->data(), num,
+                            msgflags);
+    }
+    if (n == num) {
+      msgs->clear();
+      timestamps->clear();
+      break;
+    }
+
+    // keep retriable failed messages
+    bool queue_full = false;
+    size_t keep = 0;
+    for (size_t j = 0; j < msgs->size(); ++j) {
+      rd_kafka_message_t& msg = (*msgs)[j];
+      if (msg.err == RD_KAFKA_RESP_ERR_NO_ERROR)
+        continue;
+
+      if (Retriable(msg.err)) {
+        if (msg.err == RD_KAFKA_RESP_ERR__QUEUE_FULL)
+          queue_full = true;
+        if (!timestamps->empty())
+          (*timestamps)[keep] = (*timestamps)[j];
+        (*msgs)[keep++] = msg;
+        continue;
+      }
 
-    ProduceAndSave(topic, path, offset, batch, timeout, msgs, std::move(ktp));
+      LOG(WARNING) << "Produce ProduceBatch topic[" << ktp->Name()
+                   << "] path[" << path << "] failed with error["
+                   << rd_kafka_err2str(msg.err) << "]";
+      handle->ArchiveMsg(ktp->Name(),
+                         static_cast<const char*>(msg.payload), msg.len);
+      DeliveryTracker::Ack(msg._private);
+      flow->Release(1, msg.len);
+      ++archived;
+    }
+    msgs->resize(keep);
+    if (!timestamps->empty())
+      timestamps->resize(keep);
+
+    // Wait for deliveries to free librdkafka queue before retry, queue
+    // full is backpressure and does not count as a try.
+    if (keep > 0 && !flow->WaitRelease(timeout) && queue_full) {
+      LOG(WARNING) << "Produce ProduceBatch topic[" << ktp->Name()
+                   << "] queue full, no delivery in[" << timeout << "ms]";
+    }
+    if (!queue_full)
+      ++i;
   }
 
-  LOG(INFO) << "Produce thread existing";
+  // Try ProduceBatch failed 3 times, handle lines with error msg
+  if (!msgs->empty()) {
+    LOG(WARNING) << "Produce ProduceBatch failed 3 times topic["
+                 << ktp->Name() << "] path[" << path
+                 << "] messages[" << msgs->size() << "] error["
+                 << rd_kafka_err2str(msgs->front().err) << "]";
+    for (auto& msg : *msgs) {
+      handle->ArchiveMsg(ktp->Name(),
+                         static_cast<const char*>(msg.payload), msg.len);
+      DeliveryTracker::Ack(msg._private);
+      flow->Release(1, msg.len);
+      ++archived;
+    }
+    msgs->clear();
+    timestamps->clear();
+  }
+  return archived;
 }
 
-#define PRODUCE_TRY_NUM 3
+}   // namespace
+
+#define READ_CHUNK_SIZE 1048576
+
+bool Produce::ProduceAndSave(const FileRecord& record, Context* ctx,
+                             bool replay) {
+  const std::string& topic = record.topic();
+  const std::string& path = record.path;
+  off_t offset = record.offset;
+  int64_t delay_ms = (NowMicros() - record.enqueue_us) / 1000;
 
-void Produce::ProduceAndSave(
-    const std::string& topic,
-    const std::string& path,
-    off_t offset,
-    int batch,
-    int timeout,
-    int msgs_num,
-    std::shared_ptr<KafkaTopicProducer> ktp) {
   std::string dir = DirName(path);
   std::string file = BaseName(path);
   if (dir.empty() || file.empty()) {
     LOG(WARNING) << "Produce ProduceAndSave invlaid path[" << path << "]";
-    return;
+    return false;
   }
 /*
   table_->Update(dir, file, 0);
   LOG(INFO) << "log sent topic[" << topic << "] path[" << path << "] offset["
-            << offset << "] batch[" << batch << "] timeout[" << timeout
+            << offset << "] batch[" << ctx->batch << "] timeout["
+            << ctx->timeout
             <<"] msgs_num[" << msgs_num << "]";
 */
 
-  std::ifstream ifs(path);
-  if (!ifs.is_open()) {
-    LOG(WARNING) << "Produce ProduceAndSave open path[" << path << "] failed";
-    return;
+  if (offset == -1)
+    return false;
+
+  // Read chunks with pread and produce lines from them without copy, a
+  // mapping of the file would raise SIGBUS if it were truncated
+  // (copytruncate) while in flight. Chunks are released by acks.
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    LOG(WARNING) << "Produce ProduceAndSave open path[" << path
+                 << "] failed with errno[" << errno << "]";
+    return false;
   }
 
-  if (offset == -1)
-    return;
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    LOG(WARNING) << "Produce ProduceAndSave fstat path[" << path
+                 << "] failed with errno[" << errno << "]";
+    close(fd);
+    return false;
+  }
 
-  if (offset != 0)
-    ifs.seekg(offset);
+  OffsetTable::FileIdentity id;
+  id.dev = st.st_dev;
+  id.ino = st.st_ino;
+  id.size = st.st_size;
+  char head_buf[OffsetTable::IDENTITY_HEAD_LEN];
+  size_t head_len = static_cast<size_t>(st.st_size);
+  if (head_len > OffsetTable::IDENTITY_HEAD_LEN)
+    head_len = OffsetTable::IDENTITY_HEAD_LEN;
+  ssize_t head = pread(fd, head_buf, head_len, 0);
+  id.head_hash = OffsetTable::HeadHash(head_buf, head > 0 ? head : 0);
+
+  // offsets are committed by tracker_ when delivery reports arrive
+  DeliveryTracker::FileProgress* progress = tracker_->Begin(
+      dir, file, offset, &id);
+
+  int batch = ctx->batch;
+  TimestampExtractor* extractor = ctx->extractor.get();
+  FieldPartitioner* partitioner = ctx->partitioner.get();
+  std::vector<rd_kafka_message_t> msgs;
+  msgs.reserve(batch);
+  std::vector<int64_t> timestamps;
+  if (extractor)
+    timestamps.reserve(batch);
 
-  int i = 0;
   off_t num = 0;
-  std::string line;
-  while (std::getline(ifs, line)) {
-    ++num;
-    for (i = 0; i < PRODUCE_TRY_NUM; ++i) {
-      int res = ktp->ProduceMessage(line);
-      if (res == 0)
-        break;
-
-      if (res == -2) {
+  size_t archived = 0;
+  off_t pos = offset;
+  while (true) {
+    DeliveryTracker::Chunk* chunk = new DeliveryTracker::Chunk(
+        READ_CHUNK_SIZE);
+    ssize_t n = pread(fd, chunk->data.get(), READ_CHUNK_SIZE, pos);
+    if (n <= 0) {
+      DeliveryTracker::Unref(chunk);
+      if (n == -1 && errno == EINTR)
+        continue;
+      if (n == -1) {
+        LOG(WARNING) << "Produce ProduceAndSave pread path[" << path
+                     << "] failed with errno[" << errno << "]";
+      }
+      break;
+    }
+
+    // carry partial last line to next read, file is complete at end
+    const char* begin = chunk->data.get();
+    const char* end = begin + n;
+    if (n == READ_CHUNK_SIZE) {
+      const char* last = static_cast<const char*>(memrchr(begin, '\n', n));
+      if (last)
+        end = last + 1;
+    }
+
+    for (const char* line = begin; line < end;) {
+      const char* eol = static_cast<const char*>(
+          memchr(line, '\n', end - line));
+      size_t len = (eol ? eol : end) - line;
+      off_t line_end = pos + (line - begin) + len + (eol ? 1 : 0);
+      ++num;
+      if (len == 0) {
         LOG(WARNING) << "Produce ProduceAndSave path[" << path
                      << "] empty line[" << num << "]";
-        break;
+      } else {
+        rd_kafka_message_t msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.payload = const_cast<char*>(line);
+        msg.len = len;
+        msg._private = tracker_->Add(progress, line_end, chunk);
+        const char* key;
+        if (partitioner && partitioner->ExtractKey(line, len, &key,
+                                                   &msg.key_len))
+          msg.key = const_cast<char*>(key);
+        msgs.push_back(msg);
+        if (extractor)
+          timestamps.push_back(extractor->Extract(line, len));
       }
+      line += len + 1;
 
-      if (errno == 105) {
-        producer_->PollOutq(msgs_num, timeout);
-      } else {
-        ktp->Poll(timeout);
+      if (msgs.size() >= static_cast<size_t>(batch)) {
+        if (replay)
+          ReplayWait(msgs.size());
+        archived += ProduceBatch(ctx->ktp.get(), ctx->flow, handle_.get(),
+                                 path, 0, ctx->timeout, &msgs, &timestamps);
       }
     }
 
-    // Try ProduceMessage failed 3 times, handle line with error msg
-    if (i >= 3) {
-      LOG(WARNING) << "Produce ProduceAndSave failed 3 times "
-                   << "topic[" << topic << "] path[" << path << "]"
-                   << " errno[" << errno << "]";
-      handle_->ArchiveMsg(topic, line);
+    if (replay)
+      ReplayWait(msgs.size());
+    archived += ProduceBatch(ctx->ktp.get(), ctx->flow, handle_.get(), path,
+                             0, ctx->timeout, &msgs, &timestamps);
+    pos += end - begin;
+    // lines in flight keep the chunk until acked
+    DeliveryTracker::Unref(chunk);
+  }
+  close(fd);
+
+  // file marked done (-1) after all lines acked
+  tracker_->Finish(progress);
+
+  LOG(INFO) << "log topic[" << topic << "] sent[" << path << "] line["
+            << num << "] archived[" << archived << "] queue delay["
+            << delay_ms << "ms]";
+  return true;
+}
+
+void Produce::ProduceTail(const FileRecord& record, Context* ctx) {
+  const std::string& topic = record.topic();
+  const std::string& path = record.path;
+  // rotated file is complete, produce the last line without '\n'
+  bool final = !record.growing;
+
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    LOG(WARNING) << "Produce ProduceTail open path[" << path
+                 << "] failed with errno[" << errno << "]";
+    return;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    LOG(WARNING) << "Produce ProduceTail fstat path[" << path
+                 << "] failed with errno[" << errno << "]";
+    close(fd);
+    return;
+  }
+
+  // continue after lines in flight, otherwise resume by inode from the
+  // acked offset, file might have been renamed since last read
+  off_t offset = record.offset;
+  if (!tracker_->TailOffset(st.st_dev, st.st_ino, &offset) &&
+      !table_->GetTail(st.st_dev, st.st_ino, &offset) && offset == -1) {
+    close(fd);
+    return;
+  }
+
+  if (offset > st.st_size) {
+    LOG(WARNING) << "Produce ProduceTail path[" << path << "] truncated "
+                 << "offset[" << offset << "] size[" << st.st_size << "]";
+    offset = 0;
+  }
+
+  int batch = ctx->batch;
+  TimestampExtractor* extractor = ctx->extractor.get();
+  FieldPartitioner* partitioner = ctx->partitioner.get();
+  std::vector<char> buf(READ_CHUNK_SIZE);
+  std::vector<rd_kafka_message_t> msgs;
+  msgs.reserve(batch);
+  std::vector<int64_t> timestamps;
+  if (extractor)
+    timestamps.reserve(batch);
+
+  // tail offset advances over acked lines only
+  DeliveryTracker::FileProgress* progress = tracker_->BeginTail(
+      DirName(path), BaseName(path), st.st_dev, st.st_ino, offset);
+
+  off_t num = 0;
+  size_t archived = 0;
+  while (true) {
+    ssize_t n = pread(fd, buf.data(), buf.size(), offset);
+    if (n == -1) {
+      if (errno == EINTR)
+        continue;
+      LOG(WARNING) << "Produce ProduceTail pread path[" << path
+                   << "] failed with errno[" << errno << "]";
+      break;
+    } else if (n == 0) {
+      break;
+    }
+
+    // hold back partial last line until it is complete
+    const char* begin = buf.data();
+    const char* end = begin + n;
+    const char* last = static_cast<const char*>(memrchr(begin, '\n', n));
+    if (last) {
+      end = last + 1;
+    } else if (static_cast<size_t>(n) < buf.size() && !final) {
+      break;
     }
 
-    if (num % batch == 0) {
-      if (!table_->Update(dir, file, ifs.tellg())) {
-        LOG(WARNING) << "Produce ProduceAndSave table Update failed "
-                     << "topic[" << topic << "] path[" << path << "]"
-                     << " offset[" << ifs.tellg() << "]";
+    for (const char* line = begin; line < end;) {
+      const char* eol = static_cast<const char*>(
+          memchr(line, '\n', end - line));
+      size_t len = (eol ? eol : end) - line;
+      if (len > 0) {
+        off_t line_end = offset + (line - begin) + len + (eol ? 1 : 0);
+        rd_kafka_message_t msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.payload = const_cast<char*>(line);
+        msg.len = len;
+        msg._private = tracker_->Add(progress, line_end);
+        const char* key;
+        if (partitioner && partitioner->ExtractKey(line, len, &key,
+                                                   &msg.key_len))
+          msg.key = const_cast<char*>(key);
+        msgs.push_back(msg);
+        if (extractor)
+          timestamps.push_back(extractor->Extract(line, len));
+        ++num;
       }
+      line += len + 1;
+
+      if (msgs.size() >= static_cast<size_t>(batch))
+        archived += ProduceBatch(ctx->ktp.get(), ctx->flow, handle_.get(),
+                                 path, RD_KAFKA_MSG_F_COPY, ctx->timeout,
+                                 &msgs, &timestamps);
     }
-  }
 
-  if (!table_->Update(dir, file, ifs.tellg())) {
-    LOG(WARNING) << "Produce ProduceAndSave table Update failed "
-                 << "topic[" << topic << "] path[" << path << "]"
-                 << " offset[" << ifs.tellg() << "]";
+    // messages are copied, buf can be reused
+    archived += ProduceBatch(ctx->ktp.get(), ctx->flow, handle_.get(), path,
+                             RD_KAFKA_MSG_F_COPY, ctx->timeout, &msgs,
+                             &timestamps);
+    offset += end - begin;
   }
-  ifs.close();
+  close(fd);
 
-  producer_->PollOutq(msgs_num, timeout);
-  LOG(INFO) << "log topic[" << topic << "] sent[" << path << "] line["
-            << num << "]";
+  // rotated file removed from tails and marked done after all lines acked
+  tracker_->FinishTail(progress, offset, final);
 
+  if (num > 0 || final) {
+    LOG(INFO) << "log topic[" << topic << "] tail[" << path << "] line["
+              << num << "] archived[" << archived << "] offset[" << offset
+              << "] final[" << final << "]";
+  }
 }
 
 }   // namespace log2hdfs
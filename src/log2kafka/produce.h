@@ -7,7 +7,10 @@
 #include <mutex>
 #include <atomic>
 #include <thread>
+#include <vector>
 #include <unordered_map>
+#include "log2kafka/file_record.h"
+#include "log2kafka/delivery_tracker.h"
 #include "util/queue.h"
 
 namespace log2hdfs {
@@ -17,41 +20,71 @@ class KafkaTopicProducer;
 class TopicConf;
 class OffsetTable;
 class ErrmsgHandle;
+class FlowControl;
+class TimestampExtractor;
+class FieldPartitioner;
+struct TopicOpaque;
+class Section;
 
 /**
- * Produce thread.
+ * Produce threads.
  * 
- * Produce messages to kafka.
+ * Dispatch thread pops files from queue and hands them to worker
+ * threads by directory, files in one directory are produced in order
+ * by the same worker. Workers produce messages to kafka.
+ *
+ * Replay thread produces spooled messages of ErrmsgHandle at a limited
+ * rate, and only while workers have no fresh files queued.
+ *
+ * Poll thread serves delivery reports. Workers and replay thread block
+ * on the in-flight credit of topic, see FlowControl.
+ *
+ * In bulk mode files are spread over workers round robin, files of one
+ * directory are produced in parallel and resumed by file identity.
  */
 class Produce {
  public:
   /**
    * Static function to create Produce unique_ptr.
    * 
+   * @param section             Ini configuration section
    * @param producer            kafka producer
    * @param queue               file path queue
    * @param table               offset table
    * @param handle              error message handler
+   * @param bulk                bulk ingest, workers set by bulk.workers
    * 
    * @returns std::unique_ptr<Produce> if init success,
    *          nullptr otherwise.
    */
   static std::unique_ptr<Produce> Init(
+      std::shared_ptr<Section> section,
       std::shared_ptr<KafkaProducer> producer,
-      std::shared_ptr<Queue<std::string>> queue,
+      std::shared_ptr<Queue<FileRecord>> queue,
       std::shared_ptr<OffsetTable> table,
-      std::shared_ptr<ErrmsgHandle> handle);
+      std::shared_ptr<ErrmsgHandle> handle,
+      bool bulk = false);
 
   /**
    * Constructor
    */
-  Produce(std::shared_ptr<KafkaProducer> producer,
-          std::shared_ptr<Queue<std::string>> queue,
+  Produce(int workers,
+          std::shared_ptr<KafkaProducer> producer,
+          std::shared_ptr<Queue<FileRecord>> queue,
           std::shared_ptr<OffsetTable> table,
-          std::shared_ptr<ErrmsgHandle> handle):
+          std::shared_ptr<DeliveryTracker> tracker,
+          std::shared_ptr<ErrmsgHandle> handle,
+          std::shared_ptr<Queue<FileRecord>> replay_queue,
+          int replay_rate,
+          bool spread = false):
       producer_(std::move(producer)), queue_(std::move(queue)),
-      table_(std::move(table)), handle_(std::move(handle)),
-      stop_(true) {}
+      table_(std::move(table)), tracker_(std::move(tracker)),
+      handle_(std::move(handle)), replay_queue_(std::move(replay_queue)),
+      replay_rate_(replay_rate), replay_next_us_(0), spread_(spread),
+      files_skipped_(0), stop_(true), poll_stop_(true) {
+    for (int i = 0; i < workers; ++i)
+      worker_queues_.push_back(Queue<FileRecord>::Init());
+  }
 
   ~Produce() {
     Stop();
@@ -79,52 +112,86 @@ class Produce {
   bool RemoveTopic(const std::string& topic);
 
   /**
-   * Start produce thread.
+   * Start produce threads.
    * 
    * Pop file from queue and produce messages to kafka.
    */
-  void Start() {
-    std::lock_guard<std::mutex> lock(thread_mutex_);
-    if (!thread_.joinable()) {
-      stop_.store(false);
-      std::thread t(&Produce::StartInternal, this);
-      thread_ = std::move(t);
-    }
+  void Start();
+
+  /**
+   * Stop produce threads.
+   */
+  void Stop();
+
+  /**
+   * @returns acknowledged totals of files produced.
+   */
+  DeliveryTracker::Stats Acked() const {
+    return tracker_->GetStats();
   }
 
   /**
-   * Stop produce thread.
+   * @returns files popped but not produced, missing or unknown topic.
    */
-  void Stop() {
-    stop_.store(true);
-    std::lock_guard<std::mutex> lock(thread_mutex_);
-    if (thread_.joinable()) {
-      // push empty record to avoid WaitPop.
-      queue_->Push("");
-      thread_.join();
-    }
+  uint64_t Skipped() const {
+    return files_skipped_.load();
   }
 
  private:
   void StartInternal();
 
-  void ProduceAndSave(
-      const std::string& topic,
-      const std::string& path,
-      off_t offset,
-      int batch,
-      int timeout,
-      int msgs_num,
-      std::shared_ptr<KafkaTopicProducer> ktp);
+  void WorkerInternal(size_t index);
+
+  void ReplayInternal();
+
+  void ReplayWait(size_t num);
+
+  void PollInternal();
+
+  // per file produce parameters, taken from topic conf by Prepare
+  struct Context {
+    int batch;
+    int timeout;
+    bool tail;
+    FlowControl* flow;
+    std::unique_ptr<TimestampExtractor> extractor;
+    std::unique_ptr<FieldPartitioner> partitioner;
+    std::shared_ptr<KafkaTopicProducer> ktp;
+  };
+
+  bool Prepare(const FileRecord& record, Context* ctx);
+
+  // returns false if file not produced
+  bool ProduceAndSave(const FileRecord& record, Context* ctx,
+                      bool replay = false);
+
+  void ProduceTail(const FileRecord& record, Context* ctx);
 
+  // topic <--> topic opaque, kept after topic removed. Declared before
+  // producer_, delivery reports served when producer destroyed still
+  // release credit.
+  std::unordered_map<std::string, std::shared_ptr<TopicOpaque>> opaques_;
   std::shared_ptr<KafkaProducer> producer_;
-  std::shared_ptr<Queue<std::string>> queue_;
+  std::shared_ptr<Queue<FileRecord>> queue_;
   std::shared_ptr<OffsetTable> table_;
+  std::shared_ptr<DeliveryTracker> tracker_;
   std::shared_ptr<ErrmsgHandle> handle_;
+  std::shared_ptr<Queue<FileRecord>> replay_queue_;
+  int replay_rate_;
+  // pacing of replay thread
+  int64_t replay_next_us_;
+  // round robin dispatch, bulk mode
+  bool spread_;
+  std::atomic<uint64_t> files_skipped_;
   std::atomic<bool> stop_;
+  std::atomic<bool> poll_stop_;
   mutable std::mutex mutex_;
   std::mutex thread_mutex_;
   std::thread thread_;
+  std::vector<std::shared_ptr<Queue<FileRecord>>> worker_queues_;
+  std::vector<std::thread> workers_;
+  std::thread replay_thread_;
+  std::thread poll_thread_;
   std::unordered_map<std::string,
       std::shared_ptr<TopicConf>> topic_confs_;
 };
@@ -0,0 +1,76 @@
+// Copyright (c) 2017 Lanceolata
+
+#include "log2kafka/timestamp_extractor.h"
+#include <stdlib.h>
+#include "util/string_utils.h"
+#include "util/system_utils.h"
+#include "easylogging++.h"
+
+namespace log2hdfs {
+
+std::unique_ptr<TimestampExtractor> TimestampExtractor::Init(
+    const std::string& format, char delimiter, int index, int length) {
+  if (format.empty() || index < 0 || length < 0) {
+    LOG(ERROR) << "TimestampExtractor Init invalid parameters format["
+               << format << "] index[" << index << "] length["
+               << length << "]";
+    return nullptr;
+  }
+  return std::unique_ptr<TimestampExtractor>(
+             new TimestampExtractor(format, delimiter, index, length));
+}
+
+TimestampExtractor::TimestampExtractor(const std::string& format,
+                                       char delimiter, int index,
+                                       int length):
+    format_(format), kind_(kFormat), delimiter_(delimiter),
+    index_(index), length_(length), last_ts_(0) {
+  if (format_ == "s") {
+    kind_ = kSeconds;
+  } else if (format_ == "ms") {
+    kind_ = kMillis;
+  }
+}
+
+int64_t TimestampExtractor::Extract(const char* line, size_t len) {
+  const char *begin, *end;
+  if (!ExtractField(line, len, delimiter_, index_, &begin, &end))
+    return 0;
+
+  if (length_ > 0) {
+    if (end - begin < length_)
+      return 0;
+    end = begin + length_;
+  }
+
+  if (begin == end)
+    return 0;
+
+  if (last_field_.size() == static_cast<size_t>(end - begin) &&
+      last_field_.compare(0, std::string::npos, begin, end - begin) == 0)
+    return last_ts_;
+
+  int64_t ts = 0;
+  std::string field(begin, end);
+  switch (kind_) {
+    case kSeconds:
+      ts = atoll(field.c_str()) * 1000;
+      break;
+    case kMillis:
+      ts = atoll(field.c_str());
+      break;
+    default: {
+      time_t t = StrToTs(field, format_.c_str());
+      ts = t > 0 ? static_cast<int64_t>(t) * 1000 : 0;
+    }
+  }
+
+  if (ts <= 0)
+    return 0;
+
+  last_field_.swap(field);
+  last_ts_ = ts;
+  return ts;
+}
+
+}   // namespace log2hdfs
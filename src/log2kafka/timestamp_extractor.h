@@ -0,0 +1,76 @@
+// Copyright (c) 2017 Lanceolata
+
+#ifndef LOG2HDFS_LOG2KAFKA_TIMESTAMP_EXTRACTOR_H_
+#define LOG2HDFS_LOG2KAFKA_TIMESTAMP_EXTRACTOR_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <memory>
+
+namespace log2hdfs {
+
+/**
+ * Extract event time of a line at produce time.
+ *
+ * Event time is a delimited field of the line, parsed by format:
+ * "s" epoch seconds, "ms" epoch milliseconds, or a strptime format in
+ * local time. It is set as kafka message timestamp, so consumers need
+ * not to parse payload.
+ *
+ * Not thread safe, the last parsed field is cached because lines of a
+ * file mostly share it.
+ */
+class TimestampExtractor {
+ public:
+  /**
+   * Static function to create a TimestampExtractor unique_ptr
+   *
+   * @param format              "s", "ms" or strptime format
+   * @param delimiter           field delimiter
+   * @param index               field index from 0
+   * @param length              chars of field to parse, 0 whole field
+   *
+   * @returns std::unique_ptr<TimestampExtractor> if init success,
+   *          nullptr otherwise.
+   */
+  static std::unique_ptr<TimestampExtractor> Init(const std::string& format,
+                                                  char delimiter,
+                                                  int index,
+                                                  int length);
+
+  /**
+   * Constructor
+   */
+  TimestampExtractor(const std::string& format, char delimiter,
+                     int index, int length);
+
+  /**
+   * Extract event time of line.
+   *
+   * @param line                line without '\n'
+   * @param len                 line length
+   *
+   * @returns milliseconds since epoch, 0 if not found.
+   */
+  int64_t Extract(const char* line, size_t len);
+
+ private:
+  enum Kind {
+    kSeconds,
+    kMillis,
+    kFormat
+  };
+
+  std::string format_;
+  Kind kind_;
+  char delimiter_;
+  int index_;
+  int length_;
+  std::string last_field_;
+  int64_t last_ts_;
+};
+
+}   // namespace log2hdfs
+
+#endif  // LOG2HDFS_LOG2KAFKA_TIMESTAMP_EXTRACTOR_H_
@@ -14,16 +14,35 @@ namespace log2hdfs {
 TopicConfContents::TopicConfContents():
     kafka_topic_conf_(KafkaTopicConf::Init()),
     remedy_(0),
+    tail_(false),
+    timestamp_delimiter_('\t'),
+    timestamp_index_(0),
+    timestamp_length_(0),
+    partition_delimiter_('\t'),
+    partition_index_(-1),
+    partition_length_(0),
     batch_num_(100),
     poll_timeout_(200),
-    poll_messages_(500) {}
+    inflight_messages_(100000),
+    inflight_bytes_(67108864),
+    partition_spread_(1) {}
 
 TopicConfContents::TopicConfContents(const TopicConfContents& other):
     kafka_topic_conf_(other.kafka_topic_conf_->Copy()),
     remedy_(other.remedy_),
+    tail_(other.tail_),
+    timestamp_format_(other.timestamp_format_),
+    timestamp_delimiter_(other.timestamp_delimiter_),
+    timestamp_index_(other.timestamp_index_),
+    timestamp_length_(other.timestamp_length_),
+    partition_delimiter_(other.partition_delimiter_),
+    partition_index_(other.partition_index_),
+    partition_length_(other.partition_length_),
     batch_num_(other.batch_num_.load()),
     poll_timeout_(other.poll_timeout_.load()),
-    poll_messages_(other.poll_messages_.load()) {}
+    inflight_messages_(other.inflight_messages_.load()),
+    inflight_bytes_(other.inflight_bytes_.load()),
+    partition_spread_(other.partition_spread_.load()) {}
 
 /*
  * rdkafka conf in section[default] start with "kafka.".
@@ -48,6 +67,82 @@ bool TopicConfContents::Update(std::shared_ptr<Section> section) {
   }
   LOG(INFO) << "TopicConfContents Update remedy[" << remedy_ << "] success";
 
+  option = section->Get("tail");
+  if (option.valid() && !option.value().empty()) {
+    if (option.value() == "true") {
+      tail_ = true;
+    } else if (option.value() == "false") {
+      tail_ = false;
+    } else {
+      LOG(WARNING) << "TopicConfContents Update invalid tail["
+                   << option.value() << "]";
+      return false;
+    }
+  }
+  LOG(INFO) << "TopicConfContents Update tail[" << tail_ << "] success";
+
+  option = section->Get("timestamp.format");
+  if (option.valid())
+    timestamp_format_ = option.value();
+
+  option = section->Get("timestamp.delimiter");
+  if (option.valid() && !option.value().empty()) {
+    if (!ParseDelimiter(option.value(), &timestamp_delimiter_)) {
+      LOG(WARNING) << "TopicConfContents Update invalid timestamp.delimiter["
+                   << option.value() << "]";
+      return false;
+    }
+  }
+
+  option = section->Get("timestamp.index");
+  if (option.valid() && !option.value().empty()) {
+    timestamp_index_ = atoi(option.value().c_str());
+    if (timestamp_index_ < 0) {
+      LOG(WARNING) << "TopicConfContents Update invalid timestamp.index["
+                   << option.value() << "]";
+      return false;
+    }
+  }
+
+  option = section->Get("timestamp.length");
+  if (option.valid() && !option.value().empty()) {
+    timestamp_length_ = atoi(option.value().c_str());
+    if (timestamp_length_ < 0) {
+      LOG(WARNING) << "TopicConfContents Update invalid timestamp.length["
+                   << option.value() << "]";
+      return false;
+    }
+  }
+  LOG(INFO) << "TopicConfContents Update timestamp.format["
+            << timestamp_format_ << "] timestamp.index[" << timestamp_index_
+            << "] timestamp.length[" << timestamp_length_ << "] success";
+
+  option = section->Get("partition.delimiter");
+  if (option.valid() && !option.value().empty()) {
+    if (!ParseDelimiter(option.value(), &partition_delimiter_)) {
+      LOG(WARNING) << "TopicConfContents Update invalid partition.delimiter["
+                   << option.value() << "]";
+      return false;
+    }
+  }
+
+  option = section->Get("partition.index");
+  if (option.valid() && !option.value().empty())
+    partition_index_ = atoi(option.value().c_str());
+
+  option = section->Get("partition.length");
+  if (option.valid() && !option.value().empty()) {
+    partition_length_ = atoi(option.value().c_str());
+    if (partition_length_ < 0) {
+      LOG(WARNING) << "TopicConfContents Update invalid partition.length["
+                   << option.value() << "]";
+      return false;
+    }
+  }
+  LOG(INFO) << "TopicConfContents Update partition.index["
+            << partition_index_ << "] partition.length["
+            << partition_length_ << "] success";
+
   std::string errstr;
   for (auto it = section->Begin(); it != section->End(); ++it) {
     if (StartsWith(it->first, KAFKA_PREFIX)) {
@@ -93,13 +188,24 @@ bool TopicConfContents::UpdateRuntime(std::shared_ptr<Section> section) {
     }
   }
 
-  int poll_messages = poll_messages_.load();
-  option = section->Get("poll.messages");
+  int inflight_messages = inflight_messages_.load();
+  option = section->Get("inflight.messages");
   if (option.valid() && !option.value().empty()) {
-    poll_messages = atoi(option.value().c_str());
-    if (poll_messages <= 0) {
-      LOG(WARNING) << "TopicConfContents UpdateRuntime invalid poll_messages["
-                   << poll_messages << "]";
+    inflight_messages = atoi(option.value().c_str());
+    if (inflight_messages <= 0) {
+      LOG(WARNING) << "TopicConfContents UpdateRuntime invalid "
+                   << "inflight_messages[" << inflight_messages << "]";
+      return false;
+    }
+  }
+
+  int64_t inflight_bytes = inflight_bytes_.load();
+  option = section->Get("inflight.bytes");
+  if (option.valid() && !option.value().empty()) {
+    inflight_bytes = atoll(option.value().c_str());
+    if (inflight_bytes <= 0) {
+      LOG(WARNING) << "TopicConfContents UpdateRuntime invalid "
+                   << "inflight_bytes[" << inflight_bytes << "]";
       return false;
     }
   }
@@ -116,10 +222,33 @@ bool TopicConfContents::UpdateRuntime(std::shared_ptr<Section> section) {
               << poll_timeout << "] success";
   }
 
-  if (poll_messages != poll_messages_.load()) {
-    poll_messages_.store(poll_messages);
-    LOG(INFO) << "TopicConfContents UpdateRuntime update poll_messages["
-              << poll_messages << "] success";
+  int partition_spread = partition_spread_.load();
+  option = section->Get("partition.spread");
+  if (option.valid() && !option.value().empty()) {
+    partition_spread = atoi(option.value().c_str());
+    if (partition_spread <= 0) {
+      LOG(WARNING) << "TopicConfContents UpdateRuntime invalid "
+                   << "partition_spread[" << partition_spread << "]";
+      return false;
+    }
+  }
+
+  if (inflight_messages != inflight_messages_.load()) {
+    inflight_messages_.store(inflight_messages);
+    LOG(INFO) << "TopicConfContents UpdateRuntime update inflight_messages["
+              << inflight_messages << "] success";
+  }
+
+  if (inflight_bytes != inflight_bytes_.load()) {
+    inflight_bytes_.store(inflight_bytes);
+    LOG(INFO) << "TopicConfContents UpdateRuntime update inflight_bytes["
+              << inflight_bytes << "] success";
+  }
+
+  if (partition_spread != partition_spread_.load()) {
+    partition_spread_.store(partition_spread);
+    LOG(INFO) << "TopicConfContents UpdateRuntime update partition_spread["
+              << partition_spread << "] success";
   }
   return true;
 }
@@ -3,11 +3,14 @@
 #ifndef LOG2HDFS_LOG2KAFKA_TOPIC_CONF_H_
 #define LOG2HDFS_LOG2KAFKA_TOPIC_CONF_H_
 
+#include <stdint.h>
 #include <string>
 #include <vector>
 #include <memory>
 #include <atomic>
 #include "kafka/kafka_conf.h"
+#include "log2kafka/timestamp_extractor.h"
+#include "log2kafka/field_partitioner.h"
 
 namespace log2hdfs {
 
@@ -33,13 +36,25 @@ class TopicConfContents {
 
   std::unique_ptr<KafkaTopicConf> kafka_topic_conf_;
   time_t remedy_;
+  bool tail_;
+  // event time extraction, disabled if format empty
+  std::string timestamp_format_;
+  char timestamp_delimiter_;
+  int timestamp_index_;
+  int timestamp_length_;
+  // partition key field, disabled if index < 0
+  char partition_delimiter_;
+  int partition_index_;
+  int partition_length_;
 
   /*
    * Update runtime
    */
   std::atomic<int> batch_num_;
   std::atomic<int> poll_timeout_;
-  std::atomic<int> poll_messages_;
+  std::atomic<int> inflight_messages_;
+  std::atomic<int64_t> inflight_bytes_;
+  std::atomic<int> partition_spread_;
 };
 
 /**
@@ -80,8 +95,9 @@ class TopicConf {
   /**
    * Update topic conf runtime.
    * 
-   * Just can update 4 configurations
-   * [batch.num, poll.timeout, poll.messages]
+   * Just can update 5 configurations
+   * [batch.num, poll.timeout, inflight.messages, inflight.bytes,
+   *  partition.spread]
    */
   bool UpdateRuntime(std::shared_ptr<Section> section);
 
@@ -101,6 +117,33 @@ class TopicConf {
     return contents_.remedy_;
   }
 
+  bool tail() const {
+    return contents_.tail_;
+  }
+
+  /**
+   * @returns new TimestampExtractor, nullptr if not configured.
+   */
+  std::unique_ptr<TimestampExtractor> timestamp_extractor() const {
+    if (contents_.timestamp_format_.empty())
+      return nullptr;
+    return TimestampExtractor::Init(contents_.timestamp_format_,
+                                    contents_.timestamp_delimiter_,
+                                    contents_.timestamp_index_,
+                                    contents_.timestamp_length_);
+  }
+
+  /**
+   * @returns new FieldPartitioner, nullptr if not configured.
+   */
+  std::unique_ptr<FieldPartitioner> field_partitioner() const {
+    if (contents_.partition_index_ < 0)
+      return nullptr;
+    return FieldPartitioner::Init(contents_.partition_delimiter_,
+                                  contents_.partition_index_,
+                                  contents_.partition_length_);
+  }
+
   int batch_num() const {
     return contents_.batch_num_.load();
   }
@@ -109,8 +152,16 @@ class TopicConf {
     return contents_.poll_timeout_.load();
   }
 
-  int poll_messages() const {
-    return contents_.poll_messages_.load();
+  int inflight_messages() const {
+    return contents_.inflight_messages_.load();
+  }
+
+  int64_t inflight_bytes() const {
+    return contents_.inflight_bytes_.load();
+  }
+
+  int partition_spread() const {
+    return contents_.partition_spread_.load();
   }
 
  private:
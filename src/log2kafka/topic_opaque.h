@@ -0,0 +1,32 @@
+// Copyright (c) 2017 Lanceolata
+
+#ifndef LOG2HDFS_LOG2KAFKA_TOPIC_OPAQUE_H_
+#define LOG2HDFS_LOG2KAFKA_TOPIC_OPAQUE_H_
+
+#include <stdint.h>
+#include <atomic>
+#include "log2kafka/flow_control.h"
+
+namespace log2hdfs {
+
+/**
+ * Per topic state attached to kafka topic as opaque.
+ *
+ * Delivery report callback releases in-flight credit of flow,
+ * FieldPartitioner reads partition spread. Kept for the whole process
+ * lifetime, callbacks might be served after topic removed.
+ */
+struct TopicOpaque {
+  TopicOpaque(int max_msgs, int64_t max_bytes, int spread):
+      flow(max_msgs, max_bytes), partition_spread(spread) {}
+
+  TopicOpaque(const TopicOpaque& other) = delete;
+  TopicOpaque& operator=(const TopicOpaque& other) = delete;
+
+  FlowControl flow;
+  std::atomic<int> partition_spread;
+};
+
+}   // namespace log2hdfs
+
+#endif  // LOG2HDFS_LOG2KAFKA_TOPIC_OPAQUE_H_
@@ -0,0 +1,134 @@
+// Copyright (c) 2017 Lanceolata
+
+#include "util/dir_scanner.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+namespace log2hdfs {
+
+namespace {
+
+struct linux_dirent64 {
+  uint64_t d_ino;
+  int64_t d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[];
+};
+
+#define GETDENTS_BUF_LEN (64 * 1024)
+
+unsigned char ModeToType(mode_t mode) {
+  if (S_ISREG(mode))
+    return DT_REG;
+  if (S_ISDIR(mode))
+    return DT_DIR;
+  if (S_ISLNK(mode))
+    return DT_LNK;
+  return DT_UNKNOWN;
+}
+
+}   // namespace
+
+bool DirScanner::Scan(const std::string& path, int flags,
+                      std::vector<DirEntry>* entries) {
+  if (path.empty() || !entries) {
+    errno = EINVAL;
+    return false;
+  }
+
+  int fd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd == -1)
+    return false;
+
+  entries->clear();
+  char buf[GETDENTS_BUF_LEN]
+      __attribute__((aligned(__alignof__(struct linux_dirent64))));
+  while (true) {
+    long n = syscall(SYS_getdents64, fd, buf, sizeof(buf));
+    if (n == -1) {
+      int err = errno;
+      close(fd);
+      errno = err;
+      return false;
+    } else if (n == 0) {
+      break;
+    }
+
+    for (long pos = 0; pos < n;) {
+      struct linux_dirent64* dep =
+          reinterpret_cast<struct linux_dirent64*>(buf + pos);
+      pos += dep->d_reclen;
+
+      const char* name = dep->d_name;
+      if (name[0] == '.') {
+        if ((flags & kSkipHidden) != 0 || name[1] == '\0' ||
+            (name[1] == '.' && name[2] == '\0'))
+          continue;
+      }
+
+      entries->emplace_back();
+      DirEntry& entry = entries->back();
+      entry.name = name;
+      entry.type = dep->d_type;
+
+      // stat follows symbolic links like IsFile() and IsDir()
+      if ((flags & kStat) != 0 || entry.type == DT_UNKNOWN ||
+          entry.type == DT_LNK) {
+        if (fstatat(fd, name, &entry.st, 0) == 0) {
+          entry.has_stat = true;
+          entry.type = ModeToType(entry.st.st_mode);
+        }
+      }
+    }
+  }
+  close(fd);
+
+  if ((flags & kSort) != 0) {
+    std::sort(entries->begin(), entries->end(),
+              [](const DirEntry& a, const DirEntry& b) {
+                return a.name < b.name;
+              });
+  }
+  return true;
+}
+
+size_t DirScanner::ScanAll(const std::vector<std::string>& paths, int flags,
+                           size_t threads,
+                           std::vector<std::vector<DirEntry>>* entries) {
+  if (!entries)
+    return 0;
+
+  entries->clear();
+  entries->resize(paths.size());
+  if (threads == 0)
+    threads = 1;
+  threads = std::min(threads, paths.size());
+
+  std::atomic<size_t> next(0);
+  std::atomic<size_t> scanned(0);
+  auto worker = [&]() {
+    size_t i;
+    while ((i = next.fetch_add(1)) < paths.size()) {
+      if (Scan(paths[i], flags, &(*entries)[i]))
+        scanned.fetch_add(1);
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (size_t i = 1; i < threads; ++i)
+    workers.emplace_back(worker);
+  worker();
+  for (auto& t : workers)
+    t.join();
+  return scanned.load();
+}
+
+}   // namespace log2hdfs
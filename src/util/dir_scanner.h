@@ -0,0 +1,87 @@
+// Copyright (c) 2017 Lanceolata
+
+#ifndef LOG2HDFS_UTIL_DIR_SCANNER_H_
+#define LOG2HDFS_UTIL_DIR_SCANNER_H_
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+
+namespace log2hdfs {
+
+/**
+ * Directory entry with metadata snapshot.
+ */
+struct DirEntry {
+  DirEntry(): type(DT_UNKNOWN), has_stat(false) {}
+
+  bool IsFile() const {
+    return type == DT_REG;
+  }
+
+  bool IsDir() const {
+    return type == DT_DIR;
+  }
+
+  std::string name;
+  // DT_* of the entry, symbolic links are resolved when stat is taken
+  unsigned char type;
+  // st is valid
+  bool has_stat;
+  struct stat st;
+};
+
+/**
+ * Directory scanner
+ *
+ * Entries are read with getdents64 in large chunks and stat'ed with
+ * fstatat relative to the open dir fd, so a scan costs one syscall per
+ * entry at most instead of one path lookup per metadata field.
+ */
+class DirScanner {
+ public:
+  /**
+   * Scan flags
+   */
+  enum Flags {
+    kNone       = 0,
+    kStat       = 1,          /**< stat every entry */
+    kSort       = 2,          /**< sort entries by name */
+    kSkipHidden = 4,          /**< skip names start with '.' */
+  };
+
+  /**
+   * Scan a dir, '.' and '..' are always skipped.
+   *
+   * Without kStat only entries the file system reports as DT_UNKNOWN
+   * are stat'ed to get their type.
+   *
+   * @param path                dir path
+   * @param flags               or of Flags
+   * @param entries             entries in dir
+   *
+   * @returns On success, true is returned. On error, false is returned,
+   *          and errno is set appropriately.
+   */
+  static bool Scan(const std::string& path, int flags,
+                   std::vector<DirEntry>* entries);
+
+  /**
+   * Scan dirs in parallel.
+   *
+   * @param paths               dir paths
+   * @param flags               or of Flags
+   * @param threads             max scan threads
+   * @param entries             entries of every dir, empty on error
+   *
+   * @returns number of dirs scanned successfully.
+   */
+  static size_t ScanAll(const std::vector<std::string>& paths, int flags,
+                        size_t threads,
+                        std::vector<std::vector<DirEntry>>* entries);
+};
+
+}   // namespace log2hdfs
+
+#endif  // LOG2HDFS_UTIL_DIR_SCANNER_H_
@@ -33,8 +33,28 @@ std::shared_ptr<FILE> FpCache::Get(const std::string& key) {
   return res;
 }
 
+std::shared_ptr<FILE> FpCache::Get(const std::string& key,
+                                   const PathCallback& callback) {
+  std::shared_ptr<FILE> res;
+
+  pthread_rwlock_rdlock(&lock_);
+
+  auto it = cache_.find(key);
+  if (it != cache_.end()) {
+    res = it->second;
+    auto pit = paths_.find(key);
+    if (pit != paths_.end())
+      callback(pit->second);
+  }
+
+  pthread_rwlock_unlock(&lock_);
+
+  return res;
+}
+
 std::shared_ptr<FILE> FpCache::Get(
-    const std::string& key, const std::string& path) {
+    const std::string& key, const std::string& path,
+    const PathCallback& callback) {
   std::shared_ptr<FILE> res;
 
   pthread_rwlock_rdlock(&lock_);
@@ -58,6 +78,13 @@ std::shared_ptr<FILE> FpCache::Get(
     }
   }
 
+  // opened by another thread with its own path
+  if (res && callback) {
+    auto pit = paths_.find(key);
+    if (pit != paths_.end())
+      callback(pit->second);
+  }
+
   pthread_rwlock_unlock(&lock_);
 
   return res;
@@ -7,6 +7,7 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <functional>
 #include <unordered_map>
 
 namespace log2hdfs {
@@ -48,6 +49,12 @@ class FpCache {
   FpCache(const FpCache& other) = delete;
   FpCache& operator=(const FpCache& other) = delete;
 
+  /**
+   * Called with path of returned fp while lock held, so Remove() of
+   * the fp can not run before it returns.
+   */
+  typedef std::function<void(const std::string&)> PathCallback;
+
   /**
    * Get fp cache from map.
    * 
@@ -62,11 +69,26 @@ class FpCache {
    * 
    * @param key                 key to match
    * @param path                If key not math, path to open
+   * @param callback            called with path of returned fp, might
+   *                            differ from path if opened by another
+   *                            thread
    * 
    * @returns std::shared_ptr<FILE> if key was found or open(path) success;
    *          nullptr otherwise.
    */
-  std::shared_ptr<FILE> Get(const std::string& key, const std::string& path);
+  std::shared_ptr<FILE> Get(const std::string& key, const std::string& path,
+                            const PathCallback& callback = nullptr);
+
+  /**
+   * Get fp cache from map and pass its path to callback.
+   *
+   * @param key                 key to match
+   * @param callback            called with path of returned fp
+   *
+   * @returns std::shared_ptr<FILE> if key was found; nullptr otherwise.
+   */
+  std::shared_ptr<FILE> Get(const std::string& key,
+                            const PathCallback& callback);
 
   /**
    * FpCache Remove result
@@ -0,0 +1,90 @@
+// Copyright (c) 2017 Lanceolata
+
+#ifndef LOG2HDFS_UTIL_FUTEX_H_
+#define LOG2HDFS_UTIL_FUTEX_H_
+
+#include <time.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <atomic>
+
+namespace log2hdfs {
+
+/**
+ * Futex based event count.
+ *
+ * Waiters read the sequence with Load(), re-check their condition and
+ * then call Wait() with the value they read. Notifiers change the
+ * condition first and then call Notify(). The syscall is skipped when
+ * nobody is waiting.
+ */
+class Futex {
+ public:
+  /**
+   * Constructor
+   */
+  Futex(): seq_(0), waiters_(0) {}
+
+  Futex(const Futex& other) = delete;
+  Futex& operator=(const Futex& other) = delete;
+
+  /**
+   * @returns current sequence to pass to Wait().
+   */
+  uint32_t Load() const {
+    return seq_.load(std::memory_order_acquire);
+  }
+
+  /**
+   * Block while sequence equals expected.
+   *
+   * @param expected            sequence returned by Load()
+   * @param timeout_ms          wait timeout, -1 to wait indefinitely
+   */
+  void Wait(uint32_t expected, int timeout_ms = -1) {
+    struct timespec ts;
+    struct timespec* pts = NULL;
+    if (timeout_ms >= 0) {
+      ts.tv_sec = timeout_ms / 1000;
+      ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+      pts = &ts;
+    }
+
+    waiters_.fetch_add(1, std::memory_order_seq_cst);
+    if (seq_.load(std::memory_order_seq_cst) == expected) {
+      syscall(SYS_futex, reinterpret_cast<uint32_t*>(&seq_),
+              FUTEX_WAIT_PRIVATE, expected, pts, NULL, 0);
+    }
+    waiters_.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  /**
+   * Advance sequence and wake waiters.
+   *
+   * @param num                 max number of waiters to wake
+   */
+  void Notify(int num = 1) {
+    seq_.fetch_add(1, std::memory_order_seq_cst);
+    if (waiters_.load(std::memory_order_seq_cst) > 0) {
+      syscall(SYS_futex, reinterpret_cast<uint32_t*>(&seq_),
+              FUTEX_WAKE_PRIVATE, num, NULL, NULL, 0);
+    }
+  }
+
+  /**
+   * Advance sequence and wake all waiters.
+   */
+  void NotifyAll() {
+    Notify(INT32_MAX);
+  }
+
+ private:
+  std::atomic<uint32_t> seq_;
+  std::atomic<uint32_t> waiters_;
+};
+
+}   // namespace log2hdfs
+
+#endif  // LOG2HDFS_UTIL_FUTEX_H_
@@ -3,15 +3,24 @@
 #ifndef LOG2HDFS_UTIL_QUEUE_H_
 #define LOG2HDFS_UTIL_QUEUE_H_
 
-#include <queue>
+#include <stddef.h>
+#include <deque>
 #include <mutex>
+#include <atomic>
 #include <memory>
-#include <condition_variable>
+#include "util/ring_buffer.h"
+
+#define QUEUE_DEFAULT_CAPACITY 4096
 
 namespace log2hdfs {
 
 /**
  * Simple thread safe queue.
+ *
+ * Values are kept by value in a lock-free RingBuffer. When the ring is
+ * full, values spill into a mutex guarded overflow list, so the queue
+ * stays unbounded. While overflow is not empty pushes go to overflow,
+ * which keeps values of one producer in order.
  */
 template<class T>
 class Queue {
@@ -19,16 +28,22 @@ class Queue {
   /**
    * Static function to create a Queue shared_ptr.
    * 
+   * @param capacity            ring buffer capacity
+   *
    * @returns std::shared_ptr<Queue>
    */
-  static std::shared_ptr<Queue> Init() {
-    return std::make_shared<Queue>();
+  static std::shared_ptr<Queue> Init(
+      size_t capacity = QUEUE_DEFAULT_CAPACITY) {
+    return std::make_shared<Queue>(capacity);
   }
 
   /**
    * Constructor
+   *
+   * @param capacity            ring buffer capacity
    */
-  Queue() {}
+  explicit Queue(size_t capacity = QUEUE_DEFAULT_CAPACITY):
+      ring_(capacity < 2 ? 2 : capacity), overflow_size_(0) {}
 
   Queue(const Queue& other) = delete;
   Queue& operator=(const Queue& other) = delete;
@@ -37,10 +52,41 @@ class Queue {
    * Push T value to queue.
    */
   void Push(T value) {
-    std::shared_ptr<T> data(std::make_shared<T>(std::move(value)));
-    std::lock_guard<std::mutex> lock(mutex_);
-    queue_.push(data);
-    cond_.notify_one();
+    if (overflow_size_.load(std::memory_order_acquire) == 0 &&
+        ring_.TryPush(std::move(value)))
+      return;
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      overflow_.push_back(std::move(value));
+      overflow_size_.fetch_add(1, std::memory_order_release);
+    }
+    ring_.not_empty()->Notify();
+  }
+
+  /**
+   * Push values to queue.
+   *
+   * @param values              values to push
+   * @param num                 number of values
+   */
+  void PushN(T* values, size_t num) {
+    if (!values || num == 0)
+      return;
+
+    size_t pushed = 0;
+    if (overflow_size_.load(std::memory_order_acquire) == 0)
+      pushed = ring_.TryPushN(values, num);
+    if (pushed == num)
+      return;
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (size_t i = pushed; i < num; ++i)
+        overflow_.push_back(std::move(values[i]));
+      overflow_size_.fetch_add(num - pushed, std::memory_order_release);
+    }
+    ring_.not_empty()->NotifyAll();
   }
 
   /**
@@ -52,10 +98,35 @@ class Queue {
     if (!value)
       return;
 
-    std::unique_lock<std::mutex> lock(mutex_);
-    cond_.wait(lock, [this]{ return !queue_.empty(); });
-    *value = std::move(*queue_.front());
-    queue_.pop();
+    Futex* futex = ring_.not_empty();
+    while (true) {
+      if (TryPop(value))
+        return;
+      uint32_t seq = futex->Load();
+      if (TryPop(value))
+        return;
+      futex->Wait(seq);
+    }
+  }
+
+  /**
+   * Wait to pop a value from queue with timeout.
+   *
+   * @param value               pop value
+   * @param timeout_ms          max wait time
+   *
+   * @returns true if pop success; false if timed out.
+   */
+  bool WaitPop(T* value, int timeout_ms) {
+    if (!value)
+      return false;
+
+    Futex* futex = ring_.not_empty();
+    uint32_t seq = futex->Load();
+    if (TryPop(value))
+      return true;
+    futex->Wait(seq, timeout_ms);
+    return TryPop(value);
   }
 
   /**
@@ -64,10 +135,8 @@ class Queue {
    * @returns std::shared_ptr<T> point to pop value.
    */
   std::shared_ptr<T> WaitPop() {
-    std::unique_lock<std::mutex> lock(mutex_);
-    cond_.wait(lock, [this]{ return !queue_.empty(); });
-    std::shared_ptr<T> res = queue_.front();
-    queue_.pop();
+    std::shared_ptr<T> res = std::make_shared<T>();
+    WaitPop(res.get());
     return res;
   }
 
@@ -82,12 +151,19 @@ class Queue {
     if (!value)
       return false;
 
+    if (ring_.TryPop(value))
+      return true;
+
+    if (overflow_size_.load(std::memory_order_acquire) == 0)
+      return false;
+
     std::lock_guard<std::mutex> lock(mutex_);
-    if (queue_.empty())
+    if (overflow_.empty())
       return false;
 
-    *value = std::move(*queue_.front());
-    queue_.pop();
+    *value = std::move(overflow_.front());
+    overflow_.pop_front();
+    overflow_size_.fetch_sub(1, std::memory_order_release);
     return true;
   }
 
@@ -98,29 +174,45 @@ class Queue {
    *          nullptr otherwise.
    */
   std::shared_ptr<T> TryPop() {
-    std::lock_guard<std::mutex> lock(mutex_);
-    if (queue_.empty())
+    std::shared_ptr<T> res = std::make_shared<T>();
+    if (!TryPop(res.get()))
       return nullptr;
-
-    std::shared_ptr<T> res = queue_.front();
-    queue_.pop();
     return res;
   }
 
+  /**
+   * Try to pop values from queue.
+   *
+   * @param values              array to set
+   * @param num                 max number of values to pop
+   *
+   * @returns number of values popped.
+   */
+  size_t TryPopN(T* values, size_t num) {
+    if (!values || num == 0)
+      return 0;
+
+    size_t popped = ring_.TryPopN(values, num);
+    while (popped < num && TryPop(values + popped))
+      ++popped;
+    return popped;
+  }
+
   /**
    * Whether the queue is empty.
    * 
    * @returns true if queue is empty; false otherwise.
    */
   bool Empty() const {
-    std::lock_guard<std::mutex> lock(mutex_);
-    return queue_.empty();
+    return ring_.Empty() &&
+        overflow_size_.load(std::memory_order_acquire) == 0;
   }
 
  private:
-  mutable std::mutex mutex_;
-  std::condition_variable cond_;
-  std::queue<std::shared_ptr<T>> queue_;
+  RingBuffer<T> ring_;
+  std::mutex mutex_;
+  std::deque<T> overflow_;
+  std::atomic<size_t> overflow_size_;
 };
 
 }   // namespace log2hdfs
@@ -0,0 +1,336 @@
+// Copyright (c) 2017 Lanceolata
+
+#ifndef LOG2HDFS_UTIL_RING_BUFFER_H_
+#define LOG2HDFS_UTIL_RING_BUFFER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <type_traits>
+#include "util/futex.h"
+
+namespace log2hdfs {
+
+/**
+ * Bounded lock-free MPMC ring buffer.
+ *
+ * Dmitry Vyukov's bounded queue, every cell carries a sequence number
+ * that tells producers and consumers whether the cell is free for the
+ * current lap. Values are stored in place and moved in and out, nothing
+ * is allocated after construction.
+ *
+ * Capacity is rounded up to a power of two.
+ */
+template<class T>
+class RingBuffer {
+ public:
+  /**
+   * Static function to create a RingBuffer shared_ptr.
+   *
+   * @param capacity            max number of values
+   *
+   * @returns std::shared_ptr<RingBuffer> if capacity valid,
+   *          nullptr otherwise.
+   */
+  static std::shared_ptr<RingBuffer> Init(size_t capacity) {
+    if (capacity < 2)
+      return nullptr;
+    return std::make_shared<RingBuffer>(capacity);
+  }
+
+  /**
+   * Constructor
+   *
+   * @param capacity            max number of values, at least 2
+   */
+  explicit RingBuffer(size_t capacity):
+      mask_(RoundUp(capacity) - 1),
+      cells_(new Cell[mask_ + 1]),
+      enqueue_pos_(0), dequeue_pos_(0) {
+    for (size_t i = 0; i <= mask_; ++i)
+      cells_[i].seq.store(i, std::memory_order_relaxed);
+  }
+
+  /**
+   * Destructor
+   *
+   * Destroy values still in buffer.
+   */
+  ~RingBuffer() {
+    T value;
+    while (TryPop(&value)) {}
+  }
+
+  RingBuffer(const RingBuffer& other) = delete;
+  RingBuffer& operator=(const RingBuffer& other) = delete;
+
+  /**
+   * Try to push a value.
+   *
+   * @param value               value to push, moved only on success
+   *
+   * @returns true if push success; false if buffer is full.
+   */
+  bool TryPush(T&& value) {
+    Cell* cell;
+    size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    while (true) {
+      cell = &cells_[pos & mask_];
+      size_t seq = cell->seq.load(std::memory_order_acquire);
+      intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+      if (diff == 0) {
+        if (enqueue_pos_.compare_exchange_weak(pos, pos + 1,
+                std::memory_order_relaxed))
+          break;
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+
+    new (&cell->storage) T(std::move(value));
+    cell->seq.store(pos + 1, std::memory_order_release);
+    not_empty_.Notify();
+    return true;
+  }
+
+  /**
+   * Try to push a copy of value.
+   */
+  bool TryPush(const T& value) {
+    T temp(value);
+    return TryPush(std::move(temp));
+  }
+
+  /**
+   * Try to push values in one reservation.
+   *
+   * @param values              values to push, values[0, n) are moved
+   *                            when n is returned
+   * @param num                 number of values
+   *
+   * @returns number of values pushed, a prefix of values.
+   */
+  size_t TryPushN(T* values, size_t num) {
+    if (!values || num == 0)
+      return 0;
+
+    size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    size_t count;
+    while (true) {
+      // count the free cells of this lap starting at pos
+      count = 0;
+      while (count < num && count <= mask_) {
+        Cell* cell = &cells_[(pos + count) & mask_];
+        if (cell->seq.load(std::memory_order_acquire) != pos + count)
+          break;
+        ++count;
+      }
+
+      if (count == 0) {
+        size_t seq = cells_[pos & mask_].seq.load(std::memory_order_acquire);
+        if (static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos) < 0)
+          return 0;
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+        continue;
+      }
+
+      if (enqueue_pos_.compare_exchange_weak(pos, pos + count,
+              std::memory_order_relaxed))
+        break;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+      Cell* cell = &cells_[(pos + i) & mask_];
+      new (&cell->storage) T(std::move(values[i]));
+      cell->seq.store(pos + i + 1, std::memory_order_release);
+    }
+    not_empty_.Notify(static_cast<int>(count));
+    return count;
+  }
+
+  /**
+   * Try to pop a value.
+   *
+   * @param value               value to set
+   *
+   * @returns true if pop success; false if buffer is empty.
+   */
+  bool TryPop(T* value) {
+    if (!value)
+      return false;
+
+    Cell* cell;
+    size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    while (true) {
+      cell = &cells_[pos & mask_];
+      size_t seq = cell->seq.load(std::memory_order_acquire);
+      intptr_t diff = static_cast<intptr_t>(seq) -
+          static_cast<intptr_t>(pos + 1);
+      if (diff == 0) {
+        if (dequeue_pos_.compare_exchange_weak(pos, pos + 1,
+                std::memory_order_relaxed))
+          break;
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = dequeue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+
+    T* ptr = reinterpret_cast<T*>(&cell->storage);
+    *value = std::move(*ptr);
+    ptr->~T();
+    cell->seq.store(pos + mask_ + 1, std::memory_order_release);
+    not_full_.Notify();
+    return true;
+  }
+
+  /**
+   * Try to pop values in one reservation.
+   *
+   * @param values              array to set
+   * @param num                 max number of values to pop
+   *
+   * @returns number of values popped.
+   */
+  size_t TryPopN(T* values, size_t num) {
+    if (!values || num == 0)
+      return 0;
+
+    size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    size_t count;
+    while (true) {
+      count = 0;
+      while (count < num && count <= mask_) {
+        Cell* cell = &cells_[(pos + count) & mask_];
+        if (cell->seq.load(std::memory_order_acquire) != pos + count + 1)
+          break;
+        ++count;
+      }
+
+      if (count == 0) {
+        size_t seq = cells_[pos & mask_].seq.load(std::memory_order_acquire);
+        if (static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1) < 0)
+          return 0;
+        pos = dequeue_pos_.load(std::memory_order_relaxed);
+        continue;
+      }
+
+      if (dequeue_pos_.compare_exchange_weak(pos, pos + count,
+              std::memory_order_relaxed))
+        break;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+      Cell* cell = &cells_[(pos + i) & mask_];
+      T* ptr = reinterpret_cast<T*>(&cell->storage);
+      values[i] = std::move(*ptr);
+      ptr->~T();
+      cell->seq.store(pos + i + mask_ + 1, std::memory_order_release);
+    }
+    not_full_.Notify(static_cast<int>(count));
+    return count;
+  }
+
+  /**
+   * Push a value, wait while buffer is full.
+   */
+  void WaitPush(T value) {
+    while (true) {
+      if (TryPush(std::move(value)))
+        return;
+      uint32_t seq = not_full_.Load();
+      if (TryPush(std::move(value)))
+        return;
+      not_full_.Wait(seq);
+    }
+  }
+
+  /**
+   * Pop a value, wait while buffer is empty.
+   *
+   * @param value               value to set
+   * @param timeout_ms          max wait time, -1 to wait indefinitely
+   *
+   * @returns true if pop success; false if timed out.
+   */
+  bool WaitPop(T* value, int timeout_ms = -1) {
+    if (!value)
+      return false;
+
+    while (true) {
+      if (TryPop(value))
+        return true;
+      uint32_t seq = not_empty_.Load();
+      if (TryPop(value))
+        return true;
+      not_empty_.Wait(seq, timeout_ms);
+      if (timeout_ms >= 0)
+        return TryPop(value);
+    }
+  }
+
+  /**
+   * Approximate number of values in buffer.
+   */
+  size_t Size() const {
+    size_t head = dequeue_pos_.load(std::memory_order_relaxed);
+    size_t tail = enqueue_pos_.load(std::memory_order_relaxed);
+    return tail > head ? tail - head : 0;
+  }
+
+  /**
+   * Whether buffer is empty (approximate).
+   */
+  bool Empty() const {
+    return Size() == 0;
+  }
+
+  /**
+   * @returns buffer capacity.
+   */
+  size_t capacity() const {
+    return mask_ + 1;
+  }
+
+  /**
+   * @returns futex notified after every push.
+   */
+  Futex* not_empty() {
+    return &not_empty_;
+  }
+
+ private:
+  static size_t RoundUp(size_t capacity) {
+    size_t n = 2;
+    while (n < capacity)
+      n <<= 1;
+    return n;
+  }
+
+  struct Cell {
+    std::atomic<size_t> seq;
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+  };
+
+  const size_t mask_;
+  std::unique_ptr<Cell[]> cells_;
+
+  // keep producer and consumer positions on different cache lines
+  char pad0_[64];
+  std::atomic<size_t> enqueue_pos_;
+  char pad1_[64];
+  std::atomic<size_t> dequeue_pos_;
+  char pad2_[64];
+
+  Futex not_empty_;
+  Futex not_full_;
+};
+
+}   // namespace log2hdfs
+
+#endif  // LOG2HDFS_UTIL_RING_BUFFER_H_
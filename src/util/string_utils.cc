@@ -1,6 +1,8 @@
 // Copyright (c) 2017 Lanceolata
 
 #include "util/string_utils.h"
+#include <ctype.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sstream>
 
@@ -85,4 +87,48 @@ bool EndsWith(const std::string& input, const std::string& suffix) {
   return memcmp(end, suffix.c_str(), len2) == 0;
 }
 
+bool ExtractField(const char* line, size_t len, char delimiter,
+                  int index, const char** begin, const char** end) {
+  if (!line || index < 0 || !begin || !end)
+    return false;
+
+  const char* p = line;
+  const char* last = line + len;
+  for (int i = 0; i < index; ++i) {
+    const void* next = memchr(p, delimiter, last - p);
+    if (!next)
+      return false;
+    p = static_cast<const char*>(next) + 1;
+  }
+
+  const void* next = memchr(p, delimiter, last - p);
+  *begin = p;
+  *end = next ? static_cast<const char*>(next) : last;
+  return true;
+}
+
+bool ParseDelimiter(const std::string& input, char* delimiter) {
+  if (!delimiter)
+    return false;
+
+  if (input.size() == 1) {
+    *delimiter = input[0];
+    return true;
+  }
+
+  if (input == "\\t") {
+    *delimiter = '\t';
+  } else if (input == "\\n") {
+    *delimiter = '\n';
+  } else if (input == "\\\\") {
+    *delimiter = '\\';
+  } else if (input.size() == 4 && StartsWith(input, "\\x") &&
+             isxdigit(input[2]) && isxdigit(input[3])) {
+    *delimiter = static_cast<char>(strtol(input.c_str() + 2, NULL, 16));
+  } else {
+    return false;
+  }
+  return true;
+}
+
 }   // namespace log2hdfs
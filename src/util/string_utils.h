@@ -98,6 +98,32 @@ extern bool StartsWith(const std::string& input, const std::string& prefix);
  */
 extern bool EndsWith(const std::string& input, const std::string& suffix);
 
+/**
+ * Locate a delimited field of a line, line need not end with '\0'.
+ * 
+ * @param line                  line
+ * @param len                   line length
+ * @param delimiter             field delimiter
+ * @param index                 field index from 0
+ * @param begin                 field begin to set
+ * @param end                   field end to set
+ * 
+ * @returns true if field found; false otherwise.
+ */
+extern bool ExtractField(const char* line, size_t len, char delimiter,
+                         int index, const char** begin, const char** end);
+
+/**
+ * Parse delimiter configuration, a single char or escape sequence
+ * "\t", "\n", "\\" and "\xHH".
+ * 
+ * @param input                 delimiter configuration
+ * @param delimiter             delimiter to set
+ * 
+ * @returns true if parse success; false otherwise.
+ */
+extern bool ParseDelimiter(const std::string& input, char* delimiter);
+
 }   // namespace log2hdfs
 
 #endif  // LOG2HDFS_UTIL_STRING_UTILS_H_
@@ -159,6 +159,12 @@ bool Rename(const std::string& oldpath, const std::string& newpath) {
   return rename(oldpath.c_str(), newpath.c_str()) == 0;
 }
 
+bool Link(const std::string& oldpath, const std::string& newpath) {
+  if (oldpath.empty() || newpath.empty())
+    return false;
+  return link(oldpath.c_str(), newpath.c_str()) == 0;
+}
+
 time_t StrToTs(const std::string& str, const char* format) {
   if (str.empty() || !format || format[0] == '\0')
     return -1;
@@ -171,6 +177,12 @@ time_t StrToTs(const std::string& str, const char* format) {
   return mktime(&timeinfo);
 }
 
+int64_t NowMicros() {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
 bool ExecuteCommand(const std::string& command, std::string* errstr) {
   if (command.empty()) {
     if (errstr)
@@ -4,6 +4,7 @@
 #define LOG2HDFS_UTIL_SYSTEM_UTILS_H_
 
 #include <dirent.h>
+#include <stdint.h>
 #include <string>
 #include <vector>
 #include "util/optional.h"
@@ -115,6 +116,14 @@ extern bool ScanDir(
  */
 extern bool Rename(const std::string& oldpath, const std::string& newpath);
 
+/**
+ * Hard link new path to old path
+ * 
+ * @returns On success, true is returned. On error, false is returned,
+ *          and errno is set appropriately.
+ */
+extern bool Link(const std::string& oldpath, const std::string& newpath);
+
 /**
  * Convert a string representation of time to a time_t
  * 
@@ -122,6 +131,13 @@ extern bool Rename(const std::string& oldpath, const std::string& newpath);
  */
 extern time_t StrToTs(const std::string& str, const char* format);
 
+/**
+ * Current realtime clock in microseconds
+ * 
+ * @returns Microseconds since epoch.
+ */
+extern int64_t NowMicros();
+
 /**
  * Execute Command
  * 
@@ -33,6 +33,11 @@ class ThreadPool {
   auto Enqueue(F&& f, Args&&... args)
       -> std::future<typename std::result_of<F(Args...)>::type>;
 
+  /**
+   * Block until task queue empty and no task running.
+   */
+  void WaitIdle();
+
   ~ThreadPool();
 
  private:
@@ -46,10 +51,14 @@ class ThreadPool {
   std::mutex mutex_;
   std::condition_variable cond_;
   volatile bool stop_;
+
+  /**< running tasks */
+  size_t active_;
+  std::condition_variable idle_cond_;
 };
 
 inline ThreadPool::ThreadPool(size_t threads):
-    stop_(false) {
+    stop_(false), active_(0) {
   for (size_t i = 0; i < threads; ++i) {
     workers_.emplace_back(
       [this] {
@@ -65,9 +74,17 @@ inline ThreadPool::ThreadPool(size_t threads):
 
             task = std::move(this->tasks_.front());
             this->tasks_.pop();
+            ++this->active_;
           }
 
           task();
+
+          {
+            std::unique_lock<std::mutex> lock(this->mutex_);
+            --this->active_;
+            if (this->tasks_.empty() && this->active_ == 0)
+              this->idle_cond_.notify_all();
+          }
         }
       }
     );
@@ -91,6 +108,11 @@ auto ThreadPool::Enqueue(F&& f, Args&&... args)
   return res;
 }
 
+inline void ThreadPool::WaitIdle() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  idle_cond_.wait(lock, [this]{ return tasks_.empty() && active_ == 0; });
+}
+
 inline ThreadPool::~ThreadPool() {
   {
     std::unique_lock<std::mutex> lock(mutex_);
@@ -1,5 +1,5 @@
-LIBRDKAFKA_VERSION="0.9.1"
-LIBRDKAFKA_URL="https://github.com/edenhill/librdkafka/archive/${LIBRDKAFKA_VERSION}.tar.gz"
+LIBRDKAFKA_VERSION="1.9.2"
+LIBRDKAFKA_URL="https://github.com/edenhill/librdkafka/archive/v${LIBRDKAFKA_VERSION}.tar.gz"
 LIBRDKAFKA_BASEDIR="librdkafka-${LIBRDKAFKA_VERSION}"
 
 EASYLOGGINGPP_VERSION="9.94.2"